@@ -15,7 +15,7 @@ typedef struct {
 
     n_Camera     cam;
 
-    SDL_TimerID  spawnTimerID;
+    n_Timer      spawnTimer;
 
     SDL_Texture* tex;
 
@@ -35,7 +35,7 @@ void DrawBombs(n_Animation *restrict bombAnim, const n_Camera *restrict cam);
 void Shoot(float x, float y, float dy);
 void UpdateBombs(float dt);
 
-uint32_t SpawnInvadersCallback(uint32_t interval, void* param);
+void SpawnInvadersCallback(n_Timer timer, void* param);
 void SpawnInvaders(float y);
 void UpdateInvaders(n_GameTime gt);
 void DrawInvaders(SDL_Texture* tex, const n_Camera *restrict cam);
@@ -142,8 +142,7 @@ void DrawHitbox(Entity *restrict self, const n_Camera *restrict cam)
         return;
     }
 
-    n_SetRendererDrawColor(SDL_Color(.g = 100, .b = 100));
-    n_DrawFilledRect(cam, &self->hitbox);
+    n_DebugFilledRect(cam, &self->hitbox, SDL_Color(.g = 100, .b = 100));
 }
 
 
@@ -154,7 +153,10 @@ void DrawHitbox(Entity *restrict self, const n_Camera *restrict cam)
 // --------------------------------------------------------
 
 
-#define USER_EVENT_SPAWN_CODE   1
+#define SPAWN_TIMER_TIME 4000
+
+
+static n_Rng rng;
 
 
 void Init(n_IGame *restrict game, n_GameTime gameTime)
@@ -180,7 +182,13 @@ void Init(n_IGame *restrict game, n_GameTime gameTime)
         .flip  = SDL_FLIP_HORIZONTAL
     };
     
-    g->spawnTimerID  = SDL_AddTimer(1000, &SpawnInvadersCallback, NULL);
+    g->spawnTimer    = n_AddTimer(
+        n_Clock_Game,
+        1.0f,
+        SPAWN_TIMER_TIME / 1000.0f,
+        &SpawnInvadersCallback,
+        NULL
+    );
 
     g->explosionAnim->dest = n_Rect(.x = 0, .y = 0, .w = 1.0f, .h = 1.0f);
     g->bombAnim->dest      = n_Rect(.x = 0, .y = 0, .w = 0.5f, .h = 0.5f);
@@ -192,7 +200,7 @@ void Init(n_IGame *restrict game, n_GameTime gameTime)
     InitPlayer();
     MakeWalls();
 
-    srand(time(NULL));
+    n_SeedRng(&rng, UInt64(time(NULL)), 0);
 }
 
 void Step(n_IGame *restrict game, n_GameTime gameTime)
@@ -211,7 +219,7 @@ void Finalize(n_IGame *restrict game, n_GameTime gameTime)
 {
     Game* g = Ptr(game);
 
-    SDL_RemoveTimer(g->spawnTimerID);
+    n_CancelTimer(g->spawnTimer);
 
     n_DeleteAnimation(&g->bombAnim);
     n_DeleteAnimation(&g->explosionAnim);
@@ -222,11 +230,7 @@ void Finalize(n_IGame *restrict game, n_GameTime gameTime)
 
 void EventHandler(n_IGame *restrict game, const SDL_Event *restrict e)
 {
-    switch(e->type) {
-    case SDL_USEREVENT:
-        SpawnInvaders(WIN_HEIGHT);
-        break;
-    }
+    // Do nothing
 }
 
 
@@ -241,7 +245,6 @@ void UpdateInvader(n_GameTime gt)
     const float Y_ACC        = 5.0f;
     const float MAX_SHIFT    = 3.0f;
     const int   SHOOT_CHANCE = 2;
-    int         chance;
 
     for (int i = 0; i < nOfInvaders; i++) {
         DigletInvader* di = &invaders[i];
@@ -256,8 +259,7 @@ void UpdateInvader(n_GameTime gt)
 
         n_Accelerate(di->body, di->acceleration, gt.deltaTime);
 
-        chance = rand() % 1000;
-        if (chance <= SHOOT_CHANCE) {
+        if (n_RandomBelow(&rng, 1000) <= SHOOT_CHANCE) {
             Shoot(di->body->hitbox.x, di->body->hitbox.y, -1);
         }
     }
@@ -329,8 +331,6 @@ void Shoot(float x, float y, float dy)
 // --------------------------------------------------------
 
 
-#define SPAWN_TIMER_TIME 4000
-
 #define DIGLET_INVADER_MAX_DX  10
 #define DIGLET_INVADER_MAX_NUM 50
 
@@ -364,21 +364,9 @@ void SpawnInvaders(float y)
     nOfInvaders += i;
 }
 
-uint32_t SpawnInvadersCallback(uint32_t interval, void* param)
+void SpawnInvadersCallback(n_Timer timer, void* param)
 {
-    SDL_Event     e;
-    SDL_UserEvent ue;
-
-    ue.type  = SDL_USEREVENT;
-    ue.code  = USER_EVENT_SPAWN_CODE;
-    ue.data1 = NULL;
-    ue.data2 = NULL;
-
-    e.type = SDL_USEREVENT;
-    e.user = ue;
-
-    SDL_PushEvent(&e);
-    return SPAWN_TIMER_TIME;
+    SpawnInvaders(WIN_HEIGHT);
 }
 
 
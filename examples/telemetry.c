@@ -0,0 +1,135 @@
+// Samples the telemetry a nolib game publishes with n_StartTelemetry().
+//
+//     telemetry.bin [name] [interval in ms]
+//
+// Only the layout of the block comes from nolib.h: it doesn't link
+// against SDL.
+#define _POSIX_C_SOURCE 200809L
+#include "../nolib.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+
+// Copies the block once no frame is being written.
+static bool Sample(const n_Telemetry* shared, n_Telemetry* out)
+{
+    const volatile uint32_t* seq = &shared->seq;
+
+    for (int tries = 0; tries < 1000; tries++) {
+        uint32_t before = *seq;
+
+        if (before & 1) {
+            continue;
+        }
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        memcpy(out, shared, sizeof(*out));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (*seq == before) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Frame time (ms) under which <p> of the frames fall.
+static int Percentile(const n_Telemetry* t, double p)
+{
+    uint64_t total = 0;
+    uint64_t seen  = 0;
+
+    for (int i = 0; i < nG_TELEMETRY_BUCKETS; i++) {
+        total += t->histogram[i];
+    }
+
+    for (int i = 0; i < nG_TELEMETRY_BUCKETS; i++) {
+        seen += t->histogram[i];
+        if (total > 0 && seen >= p * total) {
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    const char* name     = argc > 1 ? argv[1] : "/nolib";
+    long        interval = argc > 2 ? atol(argv[2]) : 1000;
+    int         fd       = shm_open(name, O_RDONLY, 0);
+
+    if (fd < 0) {
+        fprintf(stderr, "No telemetry in '%s'.\n", name);
+        return 1;
+    }
+
+    const n_Telemetry* shared = mmap(NULL, sizeof(n_Telemetry), PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (shared == MAP_FAILED) {
+        fprintf(stderr, "Unable to map '%s'.\n", name);
+        return 1;
+    }
+
+    if (shared->magic != n_TelemetryMagic
+        || shared->version != n_TelemetryVersion
+        || shared->size != sizeof(n_Telemetry)) {
+        fprintf(stderr, "'%s' has a different telemetry layout.\n", name);
+        return 1;
+    }
+
+    struct timespec wait = {
+        .tv_sec  = interval / 1000,
+        .tv_nsec = (interval % 1000) * 1000000L
+    };
+
+    printf("pid %u\n", shared->pid);
+
+    for (;;) {
+        n_Telemetry t;
+
+        if (!Sample(shared, &t)) {
+            fprintf(stderr, "The block keeps changing, retrying.\n");
+        } else {
+            printf(
+                "%8.1fs frame %-8llu %6.2f ms (avg %6.2f, max %6.2f, p50 %d, p99 %d)"
+                " events %.2f update %.2f systems %.2f present %.2f"
+                " | memory %lld, %u allocs | textures %u/%u resident, %lld bytes, %u evictions, %u reloads",
+                t.uptime,
+                (unsigned long long) t.frame,
+                t.frameMs,
+                t.avgFrameMs,
+                t.maxFrameMs,
+                Percentile(&t, 0.5),
+                Percentile(&t, 0.99),
+                t.eventsMs,
+                t.updateMs,
+                t.systemsMs,
+                t.presentMs,
+                (long long) t.memoryBytes,
+                t.frameAllocs,
+                t.residentTextures,
+                t.textures,
+                (long long) t.textureBytes,
+                t.evictions,
+                t.reloads
+            );
+
+            for (uint32_t i = 0; i < t.nGauges && i < nG_TELEMETRY_GAUGES; i++) {
+                printf(" | %.*s %g", (int) sizeof(t.gauges[i].name), t.gauges[i].name, t.gauges[i].value);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        nanosleep(&wait, NULL);
+    }
+
+    return 0;
+}
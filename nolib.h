@@ -26,11 +26,26 @@
 //
 // * Math
 // * Util
+// * Random
 //
+// * Raster
+// * Dirty Rectangles
 // * Graphics
+// * Debug Draw
+// * Transforms
+// * Particles
+// * Path Grid
+// * World
 // * Joystick
+// * Input
 // * Loader
+// * Audio
+// * Capture
+// * Timer
+// * Coroutines
 // * Runtime
+// * Systems
+// * Telemetry
 //
 // * Initialization and Finalization
 #ifndef _NOLIB_H_
@@ -42,12 +57,37 @@
 #include <SDL2/SDL_ttf.h>
 
 #include <math.h>
+#include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// World files are mapped and telemetry is published with POSIX calls.
+// Under a strict -std=c99 they are only declared with _POSIX_C_SOURCE
+// (200112L or later) defined before the program's first #include:
+// without it, as with nG_NO_POSIX, worlds are read with fread() and
+// there's no telemetry.
+#if !defined(nG_NO_POSIX) && defined(__STRICT_ANSI__) && !defined(__APPLE__) \
+    && (!defined(_POSIX_C_SOURCE) || _POSIX_C_SOURCE < 200112L)
+    #define nG_NO_POSIX 1
+#endif // !nG_NO_POSIX && __STRICT_ANSI__ && !_POSIX_C_SOURCE
+
+#if !defined(nG_NO_POSIX) && (defined(__unix__) || defined(__APPLE__))
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define nG_POSIX 1
+#endif // !nG_NO_POSIX && (__unix__ || __APPLE__)
+
+#if !defined(nG_NO_SIMD) && (defined(__SSE__) || defined(_M_X64))
+    #include <xmmintrin.h>
+    #define nG_SIMD_SSE 1
+#endif // !nG_NO_SIMD && __SSE__
+
 
 // ========================================================
 //
@@ -94,6 +134,29 @@ bool n_IsValidRect(const n_Rect *restrict r);
 bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b);
 
 
+// Result of a swept rect query: <time> is the fraction of the move
+// where the rects first touch and <normal> the face of the other rect
+// that was hit. <index> is which rect of a set was hit (-1 for none).
+typedef struct {
+    float  time;
+    n_Vec2 normal;
+    int    index;
+} n_Sweep;
+
+// Moves <a> by <delta> against <b>. Returns false if they don't meet
+// along the move (a rect that starts overlapping <b> hits at time 0).
+bool n_SweepRect(const n_Rect *restrict a, n_Vec2 delta, const n_Rect *restrict b, n_Sweep* hit);
+
+// Earliest hit of <a> moving by <delta> against <count> rects.
+bool n_SweepRects(const n_Rect *restrict a, n_Vec2 delta, const n_Rect *restrict set, int count, n_Sweep* hit);
+
+// Moves <r> by <delta> unless it hits one of the <set>, in which case
+// it stops at the contact. Only <bullet> rects (fast movers) pay for the
+// swept test; the rest are only checked at the end of the move, like
+// n_RectsOverlap(), and stay where they were on a hit.
+bool n_MoveRect(n_Rect* r, n_Vec2 delta, bool bullet, const n_Rect *restrict set, int count, n_Sweep* hit);
+
+
 // ========================================================
 //
 // UTIL
@@ -105,15 +168,158 @@ bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b);
     #define nG_LOG_BUFFER stderr
 #endif // !nG_LOG_BUFFER
 
+// Messages below this level are compiled out.
+#ifndef nG_LOG_LEVEL
+    #define nG_LOG_LEVEL 0
+#endif // !nG_LOG_LEVEL
+
+// Number of messages the log queue holds (power of 2) and the bytes
+// each one has for the format string and its arguments.
+#ifndef nG_LOG_SLOTS
+    #define nG_LOG_SLOTS 1024
+#endif // !nG_LOG_SLOTS
+
+#ifndef nG_LOG_SLOT_SIZE
+    #define nG_LOG_SLOT_SIZE 240
+#endif // !nG_LOG_SLOT_SIZE
+
+// Messages with the same format string past this many per second
+// are counted instead of written (0 disables the limit).
+#ifndef nG_LOG_RATE_LIMIT
+    #define nG_LOG_RATE_LIMIT 20
+#endif // !nG_LOG_RATE_LIMIT
+
+
+// Between n_Init() and n_Finalize() log calls copy the format string
+// and its arguments into a lock-free queue and return; a writer thread
+// does the formatting and the IO. Outside of it, they print directly.
+typedef enum {
+    n_LogLevel_Debug = 0,
+    n_LogLevel_Info  = 1,
+    n_LogLevel_Warn  = 2,
+    n_LogLevel_Error = 3,
+    n_LogLevel_Off   = 4
+} n_LogLevel;
+
+
+#if nG_LOG_LEVEL <= 0
+    #define n_LogDebugf(...) n_Log(n_LogLevel_Debug, __VA_ARGS__)
+#else
+    #define n_LogDebugf(...) ((void) 0)
+#endif
+
+#if nG_LOG_LEVEL <= 1
+    #define n_LogInfof(...) n_Log(n_LogLevel_Info, __VA_ARGS__)
+#else
+    #define n_LogInfof(...) ((void) 0)
+#endif
+
+#if nG_LOG_LEVEL <= 2
+    #define n_LogWarnf(...) n_Log(n_LogLevel_Warn, __VA_ARGS__)
+#else
+    #define n_LogWarnf(...) ((void) 0)
+#endif
+
+#if nG_LOG_LEVEL <= 3
+    #define n_LogErrorf(...) n_Log(n_LogLevel_Error, __VA_ARGS__)
+#else
+    #define n_LogErrorf(...) ((void) 0)
+#endif
+
+// Unprefixed info message, printf() style.
+#define n_Logf(...) n_LogInfof(__VA_ARGS__)
+
+
+// Supports the conversions of printf() except %n. Never blocks: when
+// the queue is full the message is dropped (and the drop counted).
+void n_Log(n_LogLevel level, const char *restrict fmt, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+// Blocks until every queued message is written.
+void n_FlushLog(void);
+
+// Runtime filter on top of nG_LOG_LEVEL.
+void n_SetLogLevel(n_LogLevel level);
+
+
+// Allocations made through n_New() and friends are tagged. With
+// nG_TRACK_ALLOCATIONS defined, bytes and counts are kept per tag and
+// per call site (see n_ReportAllocations()), and the leaks are dumped
+// by n_Finalize(). Otherwise the tags cost nothing.
+typedef enum {
+    n_AllocTag_General    = 0,
+    n_AllocTag_Engine     = 1,
+    n_AllocTag_Textures   = 2,
+    n_AllocTag_Animations = 3,
+    n_AllocTag_Frames     = 4,
+    n_AllocTag_Particles  = 5,
+    n_AllocTag_Sounds     = 6,
+    // user tags go from here up to nG_ALLOC_TAGS - 1
+    n_AllocTag_User       = 8
+} n_AllocTag;
+
+
+#ifndef nG_ALLOC_TAGS
+    #define nG_ALLOC_TAGS 32
+#endif // !nG_ALLOC_TAGS
+
+#ifndef nG_ALLOC_SITES
+    #define nG_ALLOC_SITES 1024
+#endif // !nG_ALLOC_SITES
+
+
+#ifdef nG_TRACK_ALLOCATIONS
+
+    #define n_Delete(obj) {       \
+        n_TrackedFree(obj);       \
+        obj = NULL;               \
+    }
+
+    #define n_NewTagged(T, n, tag) \
+        ((T *) n_TrackedCalloc(n, sizeof(T), tag, __FILE__, __LINE__))
+
+    #define n_ResizeTagged(obj, T, n, tag) \
+        ((T *) n_TrackedRealloc(obj, (n) * sizeof(T), tag, __FILE__, __LINE__))
+
+#else
+
+    #define n_Delete(obj) { \
+        free(obj);          \
+        obj = NULL;         \
+    }
+
+    #define n_NewTagged(T, n, tag) ((T *) calloc(n, sizeof(T)))
+
+    #define n_ResizeTagged(obj, T, n, tag) ((T *) realloc(obj, (n) * sizeof(T)))
+
+#endif // nG_TRACK_ALLOCATIONS
+
+#define n_New(T, n) n_NewTagged(T, n, n_AllocTag_General)
+
+// Like realloc(): the new elements are not zeroed.
+#define n_Resize(obj, T, n) n_ResizeTagged(obj, T, n, n_AllocTag_General)
 
-#define n_Delete(obj) { \
-    free(obj);          \
-    obj = NULL;         \
-}
 
-#define n_Logf(...) fprintf(nG_LOG_BUFFER, __VA_ARGS__)
+// Number of allocations made in the last frame (always 0 without
+// nG_TRACK_ALLOCATIONS).
+uint32_t n_GetFrameAllocations(void);
 
-#define n_New(T, n) ((T *) calloc(n, sizeof(T)))
+// Logs live and peak bytes/counts per tag and the live allocations
+// per call site.
+void n_ReportAllocations(void);
+
+void n_SetAllocTagName(int tag, const char *restrict name);
+
+// Counts memory that isn't allocated by n_New() (e.g. textures) in
+// a tag. <bytes> and <count> may be negative.
+void n_TrackMemory(int tag, long bytes, int count);
+
+void* n_TrackedCalloc(size_t n, size_t size, int tag, const char* file, int line);
+void  n_TrackedFree(void* p);
+void* n_TrackedRealloc(void* p, size_t size, int tag, const char* file, int line);
 
 
 #define Short(x)  ((short)    (x))
@@ -134,6 +340,118 @@ bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b);
 #define Ptr(x)    ((void *)   (x))
 
 
+// ========================================================
+//
+// RANDOM
+//
+// ========================================================
+
+
+// xoshiro256** generator. Streams are plain values: give each system
+// or thread its own instead of sharing one (nothing is locked), and the
+// same seed and stream always give the same numbers.
+typedef struct {
+    uint64_t s[4];
+} n_Rng;
+
+
+// <stream> picks one of the independent sequences of <seed>.
+void n_SeedRng(n_Rng* rng, uint64_t seed, uint64_t stream);
+
+// Moves <rng> 2^128 numbers ahead: calling it on copies of a stream
+// gives sequences that are guaranteed not to overlap.
+void n_JumpRng(n_Rng* rng);
+
+uint64_t n_RandomU64(n_Rng* rng);
+uint32_t n_RandomU32(n_Rng* rng);
+
+// In [0, 1).
+float n_RandomFloat(n_Rng* rng);
+
+// Between <lo> and <hi>.
+float n_RandomFloatRange(n_Rng* rng, float lo, float hi);
+
+// In [0, bound), without modulo bias (0 if <bound> is 0).
+uint32_t n_RandomBelow(n_Rng* rng, uint32_t bound);
+
+// In [lo, hi], both included.
+int n_RandomRange(n_Rng* rng, int lo, int hi);
+
+// Bulk fills, 4 numbers at a time (SSE2 when available). They draw a
+// few numbers from <rng> to seed the lanes, so the results are the same
+// with and without SIMD.
+void n_FillRandomU32(n_Rng* rng, uint32_t* out, uint32_t n);
+void n_FillRandomFloats(n_Rng* rng, float* out, uint32_t n, float lo, float hi);
+
+
+// ========================================================
+//
+// RASTER
+//
+// ========================================================
+
+
+typedef enum {
+    // Draws through the SDL renderer.
+    n_RenderBackend_SDL    = 0,
+    // Draws into a streaming texture on the CPU, splitting the
+    // screen into tiles that are rasterized in parallel. Meant for
+    // hosts with no GPU.
+    n_RenderBackend_Raster = 1
+} n_RenderBackend;
+
+
+#ifndef nG_RENDER_BACKEND
+    #define nG_RENDER_BACKEND n_RenderBackend_SDL
+#endif // !nG_RENDER_BACKEND
+
+// 0 means one thread per CPU.
+#ifndef nG_RASTER_THREADS
+    #define nG_RASTER_THREADS 0
+#endif // !nG_RASTER_THREADS
+
+#ifndef nG_RASTER_TILE
+    #define nG_RASTER_TILE 64
+#endif // !nG_RASTER_TILE
+
+
+// Picks the backend n_Init() sets up (nG_RENDER_BACKEND until called).
+// Has no effect on a running game.
+void n_SetRenderBackend(n_RenderBackend backend);
+
+n_RenderBackend n_GetRenderBackend(void);
+
+
+// ========================================================
+//
+// DIRTY RECTANGLES
+//
+// ========================================================
+
+
+#ifndef nG_DIRTY_MAX_REGIONS
+    #define nG_DIRTY_MAX_REGIONS 8
+#endif // !nG_DIRTY_MAX_REGIONS
+
+// Fraction of the screen above which the whole screen is redrawn.
+#ifndef nG_DIRTY_THRESHOLD
+    #define nG_DIRTY_THRESHOLD 0.5f
+#endif // !nG_DIRTY_THRESHOLD
+
+
+// Regions redrawn in the last frame.
+int n_GetDamageRegions(const SDL_Rect** regions);
+
+// Forces the whole screen to be redrawn in the next frame.
+void n_InvalidateScreen(void);
+
+// In dirty-rect mode only the parts of the screen where something
+// changed since the last frame are cleared and redrawn. The game still
+// draws everything every frame. It needs the SDL backend with the
+// software renderer (the only one that keeps the back buffer).
+bool n_SetDirtyRectMode(bool enabled);
+
+
 // ========================================================
 //
 // GRAPHICS
@@ -145,6 +463,11 @@ bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b);
     #define nG_IMG_FLAGS IMG_INIT_PNG
 #endif // !nG_IMG_FLAGS
 
+// Frames between two changes of the dynamic render scale.
+#ifndef nG_SCALE_INTERVAL
+    #define nG_SCALE_INTERVAL 30
+#endif // !nG_SCALE_INTERVAL
+
 
 typedef struct {
     SDL_Texture*     tex;
@@ -177,6 +500,56 @@ typedef struct {
 } n_Sprite;
 
 
+// A render layer keeps what its <draw> function draws in a target
+// texture (as large as the window plus <margin> meters on each side),
+// so that it can be put on the screen with a single copy per frame.
+// It is drawn again only when marked dirty, when the camera moves
+// past the margin, or when the zoom or the window size change.
+typedef void (* n_RenderLayerFn)(const n_Camera *restrict cam, void* data);
+
+typedef struct {
+    SDL_Texture*    tex;
+    n_RenderLayerFn draw;
+    void*           data;
+    n_Camera        cam;
+    float           margin;
+    int             w;
+    int             h;
+    uint32_t        version;
+    bool            dirty;
+} n_RenderLayer;
+
+// A scene keeps a frame's draws in world space, so that they can be
+// drawn by several cameras (split screen, minimaps...) while the
+// code that makes them runs once. See n_BeginScene().
+typedef struct n_Scene n_Scene;
+
+// Render scaling: the frame is drawn into a smaller target texture,
+// upscaled to the window by n_Present(). Either <width> x <height>
+// pixels (pixel art, the ppm is then in those pixels) or <scale>
+// times the window's size (the ppm is scaled with it).
+typedef struct {
+    float scale;
+    int   width;
+    int   height;
+    // upscales by a whole factor (letterboxed)
+    bool  integer;
+    // lowers the scale (down to <minScale>) while the frames take more
+    // than <targetMs> to draw, and raises it back when they are fast
+    bool  dynamic;
+    float targetMs;
+    float minScale;
+} n_RenderScale;
+
+typedef struct {
+    float scale;
+    int   width;
+    int   height;
+    // time to draw a frame, averaged
+    float frameMs;
+} n_RenderScaleStats;
+
+
 #define n_Animation(...) ((n_Animation) {    \
     .tex           = NULL,                   \
     .frames        = NULL,                   \
@@ -200,6 +573,17 @@ typedef struct {
     __VA_ARGS__                     \
 })
 
+#define n_RenderScale(...) ((n_RenderScale) { \
+    .scale    = 1.0f,                          \
+    .width    = 0,                             \
+    .height   = 0,                             \
+    .integer  = false,                         \
+    .dynamic  = false,                         \
+    .targetMs = 16.0f,                         \
+    .minScale = 0.5f,                          \
+    __VA_ARGS__                                \
+})
+
 #define n_Camera(...) ((n_Camera) { \
     .center       = n_Vec2(),       \
     .acceleration = n_Vec2(),       \
@@ -214,6 +598,18 @@ typedef struct {
 void n_Animate(n_Animation *restrict a, float totalTime);
 
 
+// Empties <scene> and records into it, until n_EndScene(), what
+// n_DrawTexture() (and so sprites and animations), n_DrawRect() and
+// n_DrawFilledRect() draw, with the draw color, instead of drawing
+// it. Their camera is ignored. n_DrawParticles(), n_DrawRenderLayer()
+// and the debug shapes are recorded too: the emitters and the layers
+// are drawn as they are when the scene is, so they must outlive it,
+// and the debug shapes are queued then (over the whole frame, not
+// clipped to the viewport). Managed textures the scene draws aren't
+// evicted until it's emptied or deleted.
+void n_BeginScene(n_Scene *restrict scene);
+
+
 // TODO
 // Makes the camera follow a certain point. The Camera position
 // is so that <point> is at the center of the screen.
@@ -230,6 +626,10 @@ void n_ClearBackground(uint8_t r, uint8_t g, uint8_t b, uint8_t a);
 
 void n_DeleteAnimation(n_Animation** a);
 
+void n_DeleteRenderLayer(n_RenderLayer** layer);
+
+void n_DeleteScene(n_Scene** scene);
+
 
 void n_DrawAnimation(const n_Camera *restrict cam, const n_Animation *restrict a);
 
@@ -237,6 +637,18 @@ void n_DrawFilledRect(const n_Camera *restrict cam, const n_Rect *restrict rect)
 
 void n_DrawRect(const n_Camera *restrict cam, const n_Rect *restrict rect);
 
+// Rebuilds the layer if needed and copies it to the screen.
+void n_DrawRenderLayer(const n_Camera *restrict cam, n_RenderLayer *restrict layer);
+
+// Draws what <scene> recorded as seen by <cam> in <viewport> (in
+// pixels, the whole screen when NULL), skipping what is out of view.
+// The camera's origin is the viewport's bottom left corner.
+void n_DrawScene(
+    const n_Camera *restrict cam,
+    const n_Scene *restrict  scene,
+    const SDL_Rect *restrict viewport
+);
+
 void n_DrawSprite(const n_Camera *restrict cam, const n_Sprite *restrict sprite);
 
 void n_DrawTexture(
@@ -248,6 +660,10 @@ void n_DrawTexture(
     SDL_RendererFlip flip
 );
 
+
+void n_EndScene(void);
+
+
 n_Animation* n_NewAnimation(
     SDL_Texture* tex,
     SDL_Rect*    frames,
@@ -255,16 +671,416 @@ n_Animation* n_NewAnimation(
     float        frameDuration
 );
 
+n_RenderLayer* n_NewRenderLayer(float margin, n_RenderLayerFn draw, void* data);
+
+n_Scene* n_NewScene(void);
+
 // Renders the scenes.
 void n_Present(void);
 
 
+void n_MarkRenderLayerDirty(n_RenderLayer *restrict layer);
+
+
 void n_SetRendererDrawColor(SDL_Color color);
 
+// Main context only. n_RenderScale() (scale 1, no size, not dynamic)
+// draws to the window again.
+bool n_SetRenderScale(n_RenderScale opts);
+
+n_RenderScaleStats n_GetRenderScaleStats(void);
+
 
 SDL_Rect n_Unproject(const n_Camera *restrict cam, const n_Rect *restrict r);
 
 
+// ========================================================
+//
+// DEBUG DRAW
+//
+// ========================================================
+
+
+// Debug shapes are queued as colored triangles and drawn over the
+// frame by n_Present() in a single SDL_RenderGeometry() call. Each
+// context has its own queue. Define nG_NO_DEBUG_DRAW to compile them
+// (and their arguments) out.
+#ifndef nG_NO_DEBUG_DRAW
+
+void n_DebugRect(const n_Camera *restrict cam, const n_Rect *restrict rect, SDL_Color color);
+void n_DebugFilledRect(const n_Camera *restrict cam, const n_Rect *restrict rect, SDL_Color color);
+void n_DebugLine(const n_Camera *restrict cam, n_Vec2 from, n_Vec2 to, SDL_Color color);
+void n_DebugCircle(const n_Camera *restrict cam, n_Vec2 center, float radius, SDL_Color color);
+void n_DebugArrow(const n_Camera *restrict cam, n_Vec2 from, n_Vec2 to, SDL_Color color);
+
+// Draws the queued shapes now (n_Present() does it otherwise).
+void n_FlushDebugDraw(void);
+
+#else
+
+#define n_DebugRect(...)       ((void) 0)
+#define n_DebugFilledRect(...) ((void) 0)
+#define n_DebugLine(...)       ((void) 0)
+#define n_DebugCircle(...)     ((void) 0)
+#define n_DebugArrow(...)      ((void) 0)
+#define n_FlushDebugDraw()     ((void) 0)
+
+#endif // !nG_NO_DEBUG_DRAW
+
+
+// ========================================================
+//
+// TRANSFORMS
+//
+// ========================================================
+
+
+// Position (meters), angle (degrees, clockwise like n_DrawTexture())
+// and scale, relative to the parent node.
+typedef struct {
+    n_Vec2 position;
+    float  angle;
+    float  scale;
+} n_Transform;
+
+// Handle of a node (0 is none).
+typedef uint32_t n_TransformNode;
+
+// Nodes are kept in flat arrays sorted by depth (parents before their
+// children), so n_UpdateTransforms() is a single forward pass that
+// starts at the first dirty node and only recomputes the nodes that
+// changed or whose parent did. Nothing is done when nothing changed.
+typedef struct {
+    n_Transform*     local;
+    n_Transform*     world;
+    uint32_t*        parent;
+    uint32_t*        stamp;
+    uint8_t*         flags;
+    n_Rect*          bindLocal;
+    n_Rect**         bindDest;
+    float**          bindAngle;
+    // slot -> handle index, handle index -> slot
+    uint32_t*        ids;
+    uint32_t*        slots;
+    uint16_t*        gens;
+    uint32_t*        free;
+    void*            scratch;
+    uint32_t         count;
+    uint32_t         nFree;
+    uint32_t         nIds;
+    uint32_t         capacity;
+    uint32_t         firstDirty;
+    uint32_t         frame;
+    bool             unsorted;
+} n_TransformTree;
+
+
+#define n_Transform(...) ((n_Transform) { \
+    .position = n_Vec2(),                 \
+    .angle    = 0.0f,                     \
+    .scale    = 1.0f,                     \
+    __VA_ARGS__                           \
+})
+
+
+n_TransformTree* n_NewTransformTree(uint32_t capacity);
+void             n_DeleteTransformTree(n_TransformTree** tree);
+
+// <parent> 0 makes a root. Returns 0 on failure.
+n_TransformNode n_AddTransform(n_TransformTree* tree, n_TransformNode parent, n_Transform local);
+
+// Removes the node and its descendants.
+void n_RemoveTransform(n_TransformTree* tree, n_TransformNode node);
+
+// Keeps the local transform. Refused if <parent> is <node> or one of
+// its descendants.
+bool n_SetTransformParent(n_TransformTree* tree, n_TransformNode node, n_TransformNode parent);
+
+void        n_SetTransform(n_TransformTree* tree, n_TransformNode node, n_Transform local);
+n_Transform n_GetTransform(const n_TransformTree* tree, n_TransformNode node);
+
+// As of the last n_UpdateTransforms().
+n_Transform n_GetWorldTransform(const n_TransformTree* tree, n_TransformNode node);
+
+n_Vec2 n_TransformPoint(const n_TransformTree* tree, n_TransformNode node, n_Vec2 local);
+
+// World rect (and angle, if not NULL) of a rect given in the node's
+// space, ready for n_DrawTexture().
+n_Rect n_TransformRect(const n_TransformTree* tree, n_TransformNode node, n_Rect local, float* angle);
+
+// Makes n_UpdateTransforms() write the world rect and angle of
+// <local> to <dest> and <angle> whenever the node moves (e.g. the dest
+// and angle of a n_Sprite or a n_Animation). NULL <dest> unbinds.
+void n_BindTransform(n_TransformTree* tree, n_TransformNode node, n_Rect local, n_Rect* dest, float* angle);
+
+void n_UpdateTransforms(n_TransformTree* tree);
+
+
+// ========================================================
+//
+// PARTICLES
+//
+// ========================================================
+
+
+// Particles are stored as a structure of arrays: every attribute
+// lives in its own contiguous array, so that integration runs over
+// plain float streams (4 at a time when SSE is available).
+typedef struct {
+    float*       data;
+    float*       x;
+    float*       y;
+    float*       vx;
+    float*       vy;
+    float*       life;
+    float*       size;
+    float*       r;
+    float*       g;
+    float*       b;
+    float*       a;
+    float*       dr;
+    float*       dg;
+    float*       db;
+    float*       da;
+    SDL_Vertex*  vertices;
+    int*         indices;
+    SDL_Texture* tex;
+    SDL_FPoint   uv0;
+    SDL_FPoint   uv1;
+    n_Vec2       gravity;
+    uint32_t     count;
+    uint32_t     capacity;
+} n_ParticleEmitter;
+
+
+void n_DeleteParticleEmitter(n_ParticleEmitter** e);
+
+// Draws every live particle of the emitter with a single
+// SDL_RenderGeometry() call. A particle's position is its center.
+void n_DrawParticles(const n_Camera *restrict cam, n_ParticleEmitter *restrict e);
+
+// Adds a particle to the emitter. Its color goes linearly from
+// <start> to <end> during its <life> (in seconds). Returns false
+// if the emitter is full.
+bool n_EmitParticle(
+    n_ParticleEmitter *restrict e,
+    n_Vec2    position,
+    n_Vec2    velocity,
+    float     life,
+    float     size,
+    SDL_Color start,
+    SDL_Color end
+);
+
+// <tex> may be NULL (untextured quads). If <src> is NULL the whole
+// texture is used.
+n_ParticleEmitter* n_NewParticleEmitter(
+    uint32_t     capacity,
+    SDL_Texture* tex,
+    const SDL_Rect *restrict src
+);
+
+// Integrates the particles and removes the dead ones.
+void n_UpdateParticles(n_ParticleEmitter *restrict e, float dt);
+
+
+// ========================================================
+//
+// PATH GRID
+//
+// ========================================================
+
+
+// How many cell changes a flow field can lag behind its grid and
+// still be updated incrementally.
+#ifndef nG_PATH_CHANGES
+    #define nG_PATH_CHANGES 256
+#endif // !nG_PATH_CHANGES
+
+
+// A grid of walkable and blocked cells laid over the world, in meters.
+// Moves go to the 8 neighbors, and diagonal moves can't cut corners.
+// The search buffers are allocated with the grid and the fields, so
+// queries never allocate; a grid (and its fields) must not be used
+// from two threads at once.
+typedef struct {
+    uint8_t*  blocked;
+    int       width;
+    int       height;
+    // world position of the (0, 0) corner of cell (0, 0)
+    n_Vec2    origin;
+    float     cellSize;
+    // ring of the cells changed by n_SetPathCell()
+    uint32_t  changes[nG_PATH_CHANGES];
+    uint32_t  version;
+    float*    g;
+    float*    f;
+    uint32_t* parent;
+    uint32_t* seen;
+    uint32_t* heap;
+    uint32_t* heapPos;
+    uint32_t  heapSize;
+    uint32_t  search;
+} n_PathGrid;
+
+// Distance from every cell to a target, shared by every agent that
+// heads there: each of them only looks up its cell's neighbors.
+typedef struct {
+    n_PathGrid* grid;
+    float*      dist;
+    uint32_t*   heap;
+    uint32_t*   heapPos;
+    uint32_t*   stack;
+    uint32_t    heapSize;
+    uint32_t    target;
+    n_Vec2      targetPos;
+    uint32_t    version;
+} n_FlowField;
+
+
+n_PathGrid* n_NewPathGrid(int width, int height, n_Vec2 origin, float cellSize);
+void        n_DeletePathGrid(n_PathGrid** grid);
+
+void n_SetPathCell(n_PathGrid* grid, int x, int y, bool blocked);
+
+// Cells outside of the grid are blocked.
+bool n_IsPathCellBlocked(const n_PathGrid* grid, int x, int y);
+
+// Returns false if <p> is outside of the grid.
+bool   n_PathCellAt(const n_PathGrid* grid, n_Vec2 p, int* x, int* y);
+n_Vec2 n_PathCellCenter(const n_PathGrid* grid, int x, int y);
+
+// Jump point search from <from> to <to>. Writes up to <maxPoints>
+// waypoints (cell centers, the start excluded, <to> last) and returns
+// how many the path has, or -1 if there's none. <path> may be NULL to
+// only count them.
+int n_FindPath(n_PathGrid* grid, n_Vec2 from, n_Vec2 to, n_Vec2* path, int maxPoints);
+
+n_FlowField* n_NewFlowField(n_PathGrid* grid);
+void         n_DeleteFlowField(n_FlowField** field);
+
+// Computes the whole field. Returns false if <target> is outside of
+// the grid or blocked.
+bool n_SetFlowTarget(n_FlowField* field, n_Vec2 target);
+
+// Catches up with the cells changed since the last update, redoing
+// only the area whose distances they affect.
+void n_UpdateFlowField(n_FlowField* field);
+
+// Unit vector to follow from <pos>; (0, 0) when unreachable.
+n_Vec2 n_GetFlowDirection(const n_FlowField* field, n_Vec2 pos);
+
+// In meters; INFINITY when unreachable.
+float n_GetFlowDistance(const n_FlowField* field, n_Vec2 pos);
+
+
+// ========================================================
+//
+// WORLD
+//
+// ========================================================
+
+
+// Chunks that can be on their way between n_UpdateWorld() and the
+// loader thread at once (power of 2).
+#ifndef nG_WORLD_QUEUE
+    #define nG_WORLD_QUEUE 256
+#endif // !nG_WORLD_QUEUE
+
+// Alignment of the chunks' data in world files (a multiple of the
+// page size, so chunks map to whole pages).
+#ifndef nG_WORLD_ALIGN
+    #define nG_WORLD_ALIGN 4096
+#endif // !nG_WORLD_ALIGN
+
+
+// A world streamed in square chunks, from a file written by
+// n_WriteWorld(). The file is memory-mapped where the platform allows
+// it (and read otherwise); a background thread brings in the chunks
+// around the camera, and n_UpdateWorld() hands them to the game.
+typedef struct n_World n_World;
+
+typedef struct {
+    // chunk coordinates (0, 0 is the one at the world's origin)
+    int         x;
+    int         y;
+    // in meters
+    n_Rect      bounds;
+    const void* data;
+    uint32_t    size;
+} n_WorldChunk;
+
+typedef void (* n_WorldChunkFn)(const n_WorldChunk* chunk, void* data);
+
+typedef struct {
+    // chunks kept around the camera's view, on each side
+    int            margin;
+    // seconds of the camera's velocity to load ahead
+    float          lookahead;
+    // time n_UpdateWorld() may spend handing chunks to the game
+    float          budgetMs;
+    // called by n_UpdateWorld() when a chunk comes in, and before it
+    // goes (its data isn't valid after that)
+    n_WorldChunkFn load;
+    n_WorldChunkFn unload;
+    void*          data;
+} n_WorldOptions;
+
+typedef struct {
+    uint32_t resident;
+    // requested, not handed to the game yet
+    uint32_t pending;
+    uint32_t loaded;
+    uint32_t unloaded;
+    // requests dropped because the camera went away first
+    uint32_t skipped;
+    // loader thread, per chunk
+    float    avgLoadMs;
+    // last n_UpdateWorld()
+    float    integrateMs;
+} n_WorldStats;
+
+
+#define n_WorldOptions(...) ((n_WorldOptions) { \
+    .margin    = 1,                             \
+    .lookahead = 0.5f,                          \
+    .budgetMs  = 2.0f,                          \
+    .load      = NULL,                          \
+    .unload    = NULL,                          \
+    .data      = NULL,                          \
+    __VA_ARGS__                                 \
+})
+
+
+// Writes a world of <cols> x <rows> chunks of <chunkSize> meters, the
+// first one at <origin>. <chunks> and <sizes> are indexed by
+// y * cols + x; empty chunks (size 0) are never loaded.
+bool n_WriteWorld(
+    const char *restrict path,
+    n_Vec2               origin,
+    float                chunkSize,
+    int                  cols,
+    int                  rows,
+    const void* const*   chunks,
+    const uint32_t*      sizes
+);
+
+n_World* n_OpenWorld(const char *restrict path, n_WorldOptions options);
+
+// Unloads the resident chunks first.
+void n_CloseWorld(n_World** world);
+
+// Once per frame: requests the chunks around the camera (nearest first),
+// drops the ones far from it and hands the loaded ones to the game
+// within the budget.
+void n_UpdateWorld(n_World* world, const n_Camera *restrict cam);
+
+// A resident chunk (data is NULL otherwise).
+n_WorldChunk n_GetWorldChunk(const n_World* world, int x, int y);
+
+n_WorldStats n_GetWorldStats(const n_World* world);
+
+
 // ========================================================
 //
 // JOYSTICK
@@ -311,80 +1127,728 @@ typedef enum {
 
 // ========================================================
 //
-// LOADER
+// INPUT
 //
 // ========================================================
 
 
-static inline void n_DeleteTexture(SDL_Texture** tex)
-{
-    if (tex && *tex) {
-        SDL_DestroyTexture(*tex);
-        *tex = NULL;
-    }
-}
-
+#ifndef nG_INPUT_MAX_AXES
+    #define nG_INPUT_MAX_AXES 8
+#endif // !nG_INPUT_MAX_AXES
 
-SDL_Texture* n_LoadTexture(const char *restrict name);
+#ifndef nG_INPUT_MAX_BUTTONS
+    #define nG_INPUT_MAX_BUTTONS 32
+#endif // !nG_INPUT_MAX_BUTTONS
 
-bool n_SetLoaderSearchPath(const char *restrict path);
+#ifndef nG_INPUT_MAX_HATS
+    #define nG_INPUT_MAX_HATS 4
+#endif // !nG_INPUT_MAX_HATS
 
 
-// ========================================================
-//
-// RUNTIME
-//
-// ========================================================
+// Snapshot of the keyboard, the mouse and the first joystick, taken
+// by n_Run() once per frame (after the events are handled). Reading
+// input from here, instead of SDL_GetKeyboardState() and friends,
+// makes the game replayable.
+typedef struct {
+    float    deltaTime;
+    uint32_t mouseButtons;
+    int32_t  mouseX;
+    int32_t  mouseY;
+    int16_t  axes[nG_INPUT_MAX_AXES];
+    uint8_t  buttons[nG_INPUT_MAX_BUTTONS];
+    uint8_t  hats[nG_INPUT_MAX_HATS];
+    uint8_t  keys[SDL_NUM_SCANCODES];
+} n_Input;
 
+typedef enum {
+    n_InputMode_Live   = 0,
+    n_InputMode_Record = 1,
+    n_InputMode_Replay = 2
+} n_InputMode;
 
-typedef struct n_IGame n_IGame;
 
-typedef struct {
-    float deltaTime;
-    float totalTime;
-} n_GameTime;
+const n_Input* n_GetInput(void);
 
-typedef void (* n_GameEventHandler)(n_IGame *restrict self, const SDL_Event *restrict e);
-typedef void (* n_GameRuntimeFn)(n_IGame *restrict self, n_GameTime gameTime);
+n_InputMode n_GetInputMode(void);
 
-struct n_IGame {
-    n_GameRuntimeFn    init;
-    n_GameRuntimeFn    step;
-    n_GameRuntimeFn    finalize;
-    n_GameEventHandler ehandler;
-};
+// <axis>, <button> and <hat> are meant to be n_DualShock values.
+int16_t n_GetJoystickAxis(int axis);
+bool    n_GetJoystickButton(int button);
+uint8_t n_GetJoystickHat(int hat);
 
+bool n_IsKeyDown(SDL_Scancode key);
 
-void n_Quit(void);
+// Records every frame's snapshot (and delta time) to <path>.
+bool n_RecordInput(const char *restrict path);
 
-void n_Run(uint32_t fps, n_IGame *restrict game);
+// Feeds the snapshots recorded in <path> to the game, frame by frame,
+// with the recorded delta times. Live keyboard, mouse and joystick
+// events are not handed to the ehandler meanwhile. The game loop stops
+// when the recording ends.
+bool n_ReplayInput(const char *restrict path);
 
-void n_SetBackgroundColor(const SDL_Color *restrict color);
+// Stops recording or replaying and goes back to live input.
+void n_StopInput(void);
 
 
 // ========================================================
 //
-// INITIALIZATION AND FINALIZATION
+// LOADER
 //
 // ========================================================
 
 
-bool n_Init(const char* gameName, int windowWidth, int windowHeight, float ppm);
-void n_Finalize(void);
+void n_DeleteTexture(SDL_Texture** tex);
 
 
-#endif // !_NOLIB_H_
+SDL_Texture* n_LoadTexture(const char *restrict name);
 
+bool n_SetLoaderSearchPath(const char *restrict path);
 
+// Opens a font relative to the loader's search path (SDL_ttf is
+// initialized on the first call).
+TTF_Font* n_LoadFont(const char *restrict path, int ptsize);
 
+void n_DeleteFont(TTF_Font** font);
 
-// ========================================================
-// ****                                                ****
-// ****                                                ****
-// ****               IMPLEMENTATION                   ****
-// ****                                                ****
-// ****                                                ****
-// ========================================================
+// Creates a texture from a surface (e.g. the text rendered by
+// SDL_ttf). Textures that the raster backend draws must come from
+// here or from n_LoadTexture().
+SDL_Texture* n_TextureFromSurface(SDL_Surface *restrict s);
+
+
+// A texture loaded from a file that may be evicted to stay within the
+// texture budget, and is reloaded from the same file on its next use.
+typedef struct n_Texture n_Texture;
+
+typedef struct {
+    long     bytes;
+    long     budget;
+    uint32_t textures;
+    uint32_t resident;
+    uint32_t evictions;
+    uint32_t reloads;
+} n_TextureStats;
+
+
+// Bytes (4 per pixel) the managed textures may use, 0 for no limit.
+// The least recently used ones are evicted when it's exceeded, but
+// never the ones used during the current frame. Those of another
+// context are evicted by its next n_Present().
+void n_SetTextureBudget(long bytes);
+
+n_Texture* n_LoadManagedTexture(const char *restrict path);
+void       n_DeleteManagedTexture(n_Texture** tex);
+
+// The texture to draw, reloaded if it was evicted (NULL if that
+// fails, while another thread reloads it, or outside of the context
+// it was loaded in). It stays valid until the end of the frame: ask
+// again every frame rather than keeping it (e.g. in a n_Sprite) for
+// longer.
+SDL_Texture* n_GetTexture(n_Texture* tex);
+
+n_TextureStats n_GetTextureStats(void);
+
+
+// ========================================================
+//
+// AUDIO
+//
+// ========================================================
+
+
+#ifndef nG_AUDIO_FREQ
+    #define nG_AUDIO_FREQ 48000
+#endif // !nG_AUDIO_FREQ
+
+// Frames per callback: the mixer's latency.
+#ifndef nG_AUDIO_SAMPLES
+    #define nG_AUDIO_SAMPLES 512
+#endif // !nG_AUDIO_SAMPLES
+
+#ifndef nG_AUDIO_VOICES
+    #define nG_AUDIO_VOICES 32
+#endif // !nG_AUDIO_VOICES
+
+// Size of the command queue (power of 2).
+#ifndef nG_AUDIO_COMMANDS
+    #define nG_AUDIO_COMMANDS 256
+#endif // !nG_AUDIO_COMMANDS
+
+
+// Sounds are decoded once, when loaded, to the mixer's format:
+// interleaved stereo 32-bit float at nG_AUDIO_FREQ.
+typedef struct {
+    float*   samples;
+    uint32_t frames;
+} n_Sound;
+
+// Handle of a playing sound (0 is none). Voices are mixed in the
+// SDL audio callback; the functions below only queue commands for it,
+// so they never wait on the audio thread. Call them from the main
+// thread.
+typedef uint32_t n_Voice;
+
+typedef struct {
+    uint32_t callbacks;
+    float    avgCallbackMs;
+    float    maxCallbackMs;
+    // time a callback has before the device runs dry
+    float    budgetMs;
+    uint32_t overBudget;
+    // callbacks that came late enough for the device to starve
+    uint32_t underruns;
+    int      voices;
+    uint32_t droppedCommands;
+} n_AudioStats;
+
+
+// Loads and decodes a WAV file.
+n_Sound* n_LoadSound(const char *restrict path);
+
+// Stops the voices playing the sound before freeing it.
+void n_DeleteSound(n_Sound** sound);
+
+// <volume> is a gain (1 is unchanged) and <pan> goes from -1 (left)
+// to 1 (right). Returns 0 if every voice is busy.
+n_Voice n_PlaySound(n_Sound* sound, float volume, float pan, bool loop);
+
+void n_StopVoice(n_Voice voice);
+
+void n_StopAllVoices(void);
+
+// The change is ramped over one callback to avoid clicks.
+void n_SetVoiceVolume(n_Voice voice, float volume, float pan);
+
+bool n_IsVoicePlaying(n_Voice voice);
+
+void n_SetMasterVolume(float volume);
+
+void n_GetAudioStats(n_AudioStats* stats);
+
+
+// ========================================================
+//
+// CAPTURE
+//
+// ========================================================
+
+
+// Frames read back and waiting for the writer thread.
+#ifndef nG_CAPTURE_BUFFERS
+    #define nG_CAPTURE_BUFFERS 4
+#endif // !nG_CAPTURE_BUFFERS
+
+
+typedef enum {
+    // Every frame appended to a single file as rows of 32-bit BGRA
+    // pixels, e.g. for ffmpeg -f rawvideo -pixel_format bgra.
+    n_CaptureFormat_Raw,
+    // One PNG per frame: <path>000000.png, <path>000001.png...
+    n_CaptureFormat_PNG
+} n_CaptureFormat;
+
+typedef struct {
+    uint32_t captured;
+    uint32_t written;
+    // the writer was too far behind (or the output was resized)
+    uint32_t dropped;
+    // time taken from the frame by the readback
+    float    avgReadbackMs;
+    float    maxReadbackMs;
+    // time the writer thread spends on a frame
+    float    avgWriteMs;
+} n_CaptureStats;
+
+
+// Captures the frames n_Present() shows in the current context, every
+// <interval> frames (1 for all of them). Frames are read back into
+// nG_CAPTURE_BUFFERS preallocated buffers and written by a background
+// thread; when all of them are waiting, frames are dropped rather than
+// stalling the game.
+bool n_StartCapture(const char *restrict path, n_CaptureFormat format, uint32_t interval);
+
+// Waits for the frames already read back to be written.
+void n_StopCapture(void);
+
+bool n_IsCapturing(void);
+
+n_CaptureStats n_GetCaptureStats(void);
+
+
+// ========================================================
+//
+// TIMER
+//
+// ========================================================
+
+
+#ifndef nG_TIMER_CAPACITY
+    #define nG_TIMER_CAPACITY 4096
+#endif // !nG_TIMER_CAPACITY
+
+
+// Timers are kept in a hierarchical timing wheel (1 ms resolution)
+// advanced by n_Run() on the main thread, right before the step
+// function. Scheduling and canceling are O(1).
+typedef uint32_t n_Timer;
+
+typedef void (* n_TimerFn)(n_Timer timer, void* data);
+
+typedef enum {
+    // Affected by n_SetTimeScale(); that's the time step() sees.
+    n_Clock_Game = 0,
+    // Real time, it never stops.
+    n_Clock_Wall = 1
+} n_Clock;
+
+
+// Schedules <fn> to run after <delay> seconds and then every
+// <interval> seconds (if <interval> is 0 it runs only once).
+// Returns 0 if there are no free timers.
+n_Timer n_AddTimer(
+    n_Clock   clock,
+    float     delay,
+    float     interval,
+    n_TimerFn fn,
+    void*     data
+);
+
+// Returns false if the timer had already run (or been canceled).
+bool n_CancelTimer(n_Timer timer);
+
+// Scales the game clock: 0 pauses it, 1 is real time.
+void n_SetTimeScale(float scale);
+
+
+// ========================================================
+//
+// COROUTINES
+//
+// ========================================================
+
+
+#ifndef nG_COROUTINE_CAPACITY
+    #define nG_COROUTINE_CAPACITY 4096
+#endif // !nG_COROUTINE_CAPACITY
+
+
+// Handle of a running coroutine (0 is none).
+typedef uint32_t n_Coroutine;
+
+// Where a coroutine stopped and what it waits for. Coroutines are
+// stackless: their locals don't survive a wait, keep that state in
+// <data> instead.
+typedef struct {
+    uint32_t line;
+    uint8_t  wait;
+    union {
+        float    seconds;
+        uint32_t frames;
+    } until;
+} n_Co;
+
+typedef void (* n_CoroutineFn)(n_Co* co, void* data);
+
+enum {
+    nG_CoWait_None,
+    nG_CoWait_Seconds,
+    nG_CoWait_Frames,
+    nG_CoWait_Done
+};
+
+
+// The body of a coroutine goes between n_CoBegin() and n_CoEnd(); the
+// waits return from the function and n_Run() calls it again once they
+// are over, jumping back to the line after them. A wait can't be in a
+// switch of its own, nor share a line with another one.
+#define n_CoBegin(co) switch ((co)->line) { case 0:
+
+#define n_CoEnd(co) } (co)->wait = nG_CoWait_Done
+
+// Ends the coroutine.
+#define n_CoExit(co) do {             \
+    (co)->wait = nG_CoWait_Done;      \
+    return;                           \
+} while (0)
+
+// Until the next frame.
+#define n_CoYield(co) n_CoWaitFrames(co, 1)
+
+// Waiting 0 frames is the same as n_CoYield().
+#define n_CoWaitFrames(co, n) do {    \
+    (co)->wait = nG_CoWait_Frames;    \
+    (co)->until.frames = UInt32(n);   \
+    (co)->line = __LINE__;            \
+    return;                           \
+    case __LINE__:;                   \
+} while (0)
+
+// Game time, as seen by step().
+#define n_CoWaitSeconds(co, s) do {   \
+    (co)->wait = nG_CoWait_Seconds;   \
+    (co)->until.seconds = Float(s);   \
+    (co)->line = __LINE__;            \
+    return;                           \
+    case __LINE__:;                   \
+} while (0)
+
+// <cond> is checked right away, then once per frame.
+#define n_CoWaitUntil(co, cond) do {   \
+    (co)->line = __LINE__;             \
+    if (0) {                           \
+        case __LINE__:;                \
+    }                                  \
+    if (!(cond)) {                     \
+        (co)->wait = nG_CoWait_Frames; \
+        (co)->until.frames = 1;        \
+        return;                        \
+    }                                  \
+} while (0)
+
+
+// <fn> is first called in the next frame, by n_Run() right after the
+// timers and before step(). Returns 0 if there are no free coroutines.
+n_Coroutine n_StartCoroutine(n_CoroutineFn fn, void* data);
+
+// Returns false if it had already ended.
+bool n_StopCoroutine(n_Coroutine co);
+
+bool n_IsCoroutineRunning(n_Coroutine co);
+
+
+// ========================================================
+//
+// RUNTIME
+//
+// ========================================================
+
+
+typedef struct n_IGame n_IGame;
+
+typedef struct {
+    float deltaTime;
+    float totalTime;
+} n_GameTime;
+
+typedef void (* n_GameEventHandler)(n_IGame *restrict self, const SDL_Event *restrict e);
+typedef void (* n_GameRuntimeFn)(n_IGame *restrict self, n_GameTime gameTime);
+
+struct n_IGame {
+    n_GameRuntimeFn    init;
+    n_GameRuntimeFn    step;
+    n_GameRuntimeFn    finalize;
+    n_GameEventHandler ehandler;
+};
+
+
+void n_Quit(void);
+
+void n_Run(uint32_t fps, n_IGame *restrict game);
+
+// Time (ms) left as slack before the predicted vsync in low-latency
+// mode.
+#ifndef nG_LATENCY_MARGIN
+    #define nG_LATENCY_MARGIN 1.5
+#endif // !nG_LATENCY_MARGIN
+
+typedef struct {
+    uint32_t frames;
+    // from the input being sampled to the frame being presented
+    float    avgInputMs;
+    float    maxInputMs;
+    // from the oldest input event of the frame to the frame being
+    // presented (SDL's event timestamps are in ms)
+    float    avgEventMs;
+    float    maxEventMs;
+    // time a frame takes to be submitted, as predicted for the next one
+    float    workMs;
+    // time slept before sampling the input
+    float    avgSleepMs;
+} n_LatencyStats;
+
+// In low-latency mode n_Run() sleeps until the next vsync (or frame
+// deadline) is just the expected frame time away, then handles events,
+// samples the input, steps and presents. Off by default.
+void n_SetLowLatency(bool enabled);
+
+// Measured in either mode.
+n_LatencyStats n_GetLatencyStats(void);
+
+void n_SetBackgroundColor(const SDL_Color *restrict color);
+
+// Runs one frame of <game> on the calling thread's context and
+// advances <gt> by <dt>: no pacing, events, input or timers. Meant for
+// headless contexts stepped by hand.
+void n_Step(n_IGame *restrict game, n_GameTime *restrict gt, float dt);
+
+
+// ========================================================
+//
+// SYSTEMS
+//
+// ========================================================
+
+
+// At most 64: the dependency graph is kept as bit masks.
+#ifndef nG_SYSTEM_CAPACITY
+    #define nG_SYSTEM_CAPACITY 64
+#endif // !nG_SYSTEM_CAPACITY
+
+// Workers besides the main thread (-1 means one less than the CPUs).
+#ifndef nG_SYSTEM_THREADS
+    #define nG_SYSTEM_THREADS -1
+#endif // !nG_SYSTEM_THREADS
+
+
+// Handle of a registered system (-1 is none).
+typedef int n_System;
+
+typedef void (* n_SystemFn)(n_GameTime gameTime, void* data);
+
+// What a system touches, as bits of masks whose meaning is up to the
+// game (one bit per component or resource). Two systems conflict when
+// one writes what the other reads or writes; those never run at the
+// same time, and run in the order they were added unless
+// n_OrderSystems() says otherwise. The others may run in parallel.
+typedef struct {
+    const char* name;
+    n_SystemFn  run;
+    void*       data;
+    uint64_t    reads;
+    uint64_t    writes;
+} n_SystemDesc;
+
+typedef struct {
+    const char* name;
+    float       lastMs;
+    float       avgMs;
+    float       maxMs;
+    // worker that ran it last (0 is the main thread)
+    int         thread;
+} n_SystemStats;
+
+
+#define n_SystemDesc(...) ((n_SystemDesc) { \
+    .name   = NULL,                         \
+    .run    = NULL,                         \
+    .data   = NULL,                         \
+    .reads  = 0,                            \
+    .writes = 0,                            \
+    __VA_ARGS__                             \
+})
+
+
+// n_Run() runs the systems every frame, after the coroutines and
+// before step(), and waits for all of them. Returns -1 if there are
+// nG_SYSTEM_CAPACITY systems already.
+n_System n_AddSystem(n_SystemDesc desc);
+
+// <first> ends before <then> starts, conflicting or not. Returns false
+// if that would make a cycle.
+bool n_OrderSystems(n_System first, n_System then);
+
+void n_ClearSystems(void);
+
+// Timings of the last frame's systems, indexed by their handles.
+// Returns the number of systems; <frameMs> (if not NULL) gets the time
+// they took together.
+int n_GetSystemStats(const n_SystemStats** stats, float* frameMs);
+
+// Random stream of <system>, seeded from the n_SeedSystemRngs() seed
+// (0 by default) and the handle. Only the system itself should use it,
+// so it needs no locking. NULL for an invalid handle.
+n_Rng* n_GetSystemRng(n_System system);
+
+// Reseeds the stream of every system, including the ones added later.
+void n_SeedSystemRngs(uint64_t seed);
+
+
+// ========================================================
+//
+// TELEMETRY
+//
+// ========================================================
+
+
+#ifndef nG_TELEMETRY_BUCKETS
+    #define nG_TELEMETRY_BUCKETS 64
+#endif // !nG_TELEMETRY_BUCKETS
+
+#ifndef nG_TELEMETRY_GAUGES
+    #define nG_TELEMETRY_GAUGES 16
+#endif // !nG_TELEMETRY_GAUGES
+
+// "NTLM"
+#define n_TelemetryMagic   0x4D4C544Eu
+#define n_TelemetryVersion 1
+
+
+typedef struct {
+    char  name[28];
+    float value;
+} n_TelemetryGauge;
+
+// The block n_Run() publishes in shared memory once per frame. Readers
+// check <magic>, <version> and <size>, then copy the block while <seq>
+// is even and the same before and after the copy (a seqlock: the
+// writer makes it odd while it writes).
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+    uint32_t pid;
+    uint32_t seq;
+    uint32_t nGauges;
+    uint64_t frame;
+    // seconds since n_StartTelemetry()
+    double   uptime;
+    // from the start of a frame to the start of the next one
+    float    frameMs;
+    float    avgFrameMs;
+    float    maxFrameMs;
+    // events and input; timers, coroutines, systems and step(); the
+    // systems alone; present
+    float    eventsMs;
+    float    updateMs;
+    float    systemsMs;
+    float    presentMs;
+    uint32_t frameAllocs;
+    // bytes tracked by tag (0 without nG_TRACK_ALLOCATIONS)
+    int64_t  memoryBytes;
+    // managed textures (see n_GetTextureStats())
+    int64_t  textureBytes;
+    uint32_t textures;
+    uint32_t residentTextures;
+    uint32_t evictions;
+    uint32_t reloads;
+    // frame times in 1 ms buckets, the last one gets the slower frames
+    uint32_t histogram[nG_TELEMETRY_BUCKETS];
+    n_TelemetryGauge gauges[nG_TELEMETRY_GAUGES];
+} n_Telemetry;
+
+
+// Creates (or reuses) the POSIX shared memory object <name> (e.g.
+// "/nolib") and publishes the telemetry in it. Returns false where
+// there is no shm_open().
+bool n_StartTelemetry(const char *restrict name);
+
+// Removes the shared memory object.
+void n_StopTelemetry(void);
+
+// Publishes <value> with the next frame, under <name> (at most 27
+// characters). Returns false if all nG_TELEMETRY_GAUGES are taken.
+bool n_SetTelemetryGauge(const char *restrict name, float value);
+
+
+// ========================================================
+//
+// INITIALIZATION AND FINALIZATION
+//
+// ========================================================
+
+
+// Subsystems that n_InitWithOptions() brings up right away. The others
+// are initialized on first use: images by the first n_LoadTexture(),
+// fonts by the first n_LoadFont(), joysticks by the first joystick
+// query and audio by the first n_PlaySound(). Video and events are
+// always initialized.
+typedef enum {
+    n_Subsystem_Audio    = 1,
+    n_Subsystem_Joystick = 1 << 1,
+    n_Subsystem_Haptic   = 1 << 2,
+    n_Subsystem_Images   = 1 << 3,
+    n_Subsystem_Fonts    = 1 << 4,
+    n_Subsystem_All      = 0x1F
+} n_Subsystem;
+
+typedef struct {
+    const char*     gameName;
+    int             width;
+    int             height;
+    float           ppm;
+    // n_Subsystem flags
+    uint32_t        subsystems;
+    // logs n_LogStartupReport() once the window is up
+    bool            reportStartup;
+    // nG_RENDER_BACKEND by default
+    n_RenderBackend backend;
+} n_InitOptions;
+
+typedef struct {
+    const char* step;
+    float       ms;
+    // done on first use, after n_Init()
+    bool        lazy;
+} n_StartupStep;
+
+
+#define n_InitOptions(...) ((n_InitOptions) { \
+    .gameName      = "",                    \
+    .width         = 0,                     \
+    .height        = 0,                     \
+    .ppm           = 1.0f,                  \
+    .subsystems    = 0,                     \
+    .reportStartup = false,                 \
+    .backend       = nG_RENDER_BACKEND,     \
+    __VA_ARGS__                             \
+})
+
+
+// Same as n_InitWithOptions() with every subsystem left for first use
+// and the backend picked by n_SetRenderBackend().
+bool n_Init(const char* gameName, int windowWidth, int windowHeight, float ppm);
+bool n_InitWithOptions(n_InitOptions opts);
+void n_Finalize(void);
+
+// Everything that draws, loads or runs a game works on the calling
+// thread's current context: the one n_Init() creates (the window)
+// unless n_SetContext() says otherwise. Headless contexts render with
+// SDL's software renderer into a surface, so several of them can
+// step in parallel, one per thread. Textures belong to the context
+// they were loaded in; the decoded images are shared between contexts
+// while a headless one is alive. The draw color and the dirty-rect
+// mode are per context. Timers, input, audio and the render backends
+// other than SDL stay with the main context.
+typedef struct n_Context n_Context;
+
+
+n_Context* n_NewHeadlessContext(int width, int height, float ppm);
+
+// Delete the context's textures first. Its managed textures are
+// unloaded, and n_GetTexture() returns NULL for them from then on.
+void n_DeleteContext(n_Context** ctx);
+
+// NULL goes back to the main context.
+void       n_SetContext(n_Context* ctx);
+n_Context* n_GetContext(void);
+
+// Pixels of a headless context (NULL for the main one).
+SDL_Surface* n_GetContextSurface(n_Context* ctx);
+
+// Initializes the n_Subsystem flags that are still down (e.g. before
+// using SDL's joystick or haptic API directly). Returns false if any
+// of them failed.
+bool n_RequireSubsystems(uint32_t subsystems);
+
+// Time spent in each init step, lazy ones included. Returns the
+// number of steps.
+int  n_GetStartupReport(const n_StartupStep** steps);
+void n_LogStartupReport(void);
+
+
+#endif // !_NOLIB_H_
+
+
+
+
+// ========================================================
+// ****                                                ****
+// ****                                                ****
+// ****               IMPLEMENTATION                   ****
+// ****                                                ****
+// ****                                                ****
+// ========================================================
 
 
 
@@ -392,449 +1856,9594 @@ void n_Finalize(void);
 #ifdef _NOLIB_INCLUDE_IMPL_
 
 
-// ========================================================
-//
-// SDL
-//
-// ========================================================
+// ========================================================
+//
+// SDL
+//
+// ========================================================
+
+
+#define nG_BaseLoaderPathMaxLen 255
+
+#if defined(_MSC_VER)
+    #define nG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+    #define nG_THREAD_LOCAL __thread
+#else
+    #define nG_THREAD_LOCAL _Thread_local
+#endif
+
+
+// see DIRTY RECTANGLES and DEBUG DRAW
+typedef struct nG_DirtyState nG_DirtyState;
+typedef struct nG_DebugQueue nG_DebugQueue;
+
+// The state behind a window (or a headless surface) and the game
+// running on it.
+struct n_Context {
+    SDL_Window*     window;
+    SDL_Renderer*   renderer;
+    // target of a headless context's software renderer
+    SDL_Surface*    surface;
+    float           ppm;
+    char            loaderPath[nG_BaseLoaderPathMaxLen + 1];
+    SDL_Color       bgColor;
+    bool            shouldQuit;
+    // Height of the render target being drawn to, when it isn't the
+    // window (0 otherwise). n_Unproject() flips the y axis with it.
+    int             targetHeight;
+    // Size of the render scaling target (0 when drawing straight to
+    // the window) and the ppm's scale, see n_SetRenderScale().
+    int             scaledWidth;
+    int             scaledHeight;
+    float           ppmScale;
+    n_RenderBackend backend;
+    // draw color as 0xAARRGGBB, for the raster backend and dirty rects
+    uint32_t        drawColor;
+    // the damage lists, when in dirty-rect mode
+    nG_DirtyState*  dirty;
+    // the shapes drawn by n_DebugXxx() until n_FlushDebugDraw()
+    nG_DebugQueue*  debug;
+    // The scene being recorded (see n_BeginScene()) and the viewport
+    // n_DrawScene() is drawing into (none when empty).
+    n_Scene*        scene;
+    SDL_Rect        viewClip;
+};
+
+
+static n_Context nG_DefaultContext = {
+    .bgColor   = { .r = 0x00, .g = 0x00, .b = 0x00, .a = 0xFF },
+    .ppmScale  = 1.0f,
+    .backend   = n_RenderBackend_SDL,
+    .drawColor = 0xFF000000
+};
+
+// Each thread draws on its own current context.
+static nG_THREAD_LOCAL n_Context* nG_Ctx = &nG_DefaultContext;
+
+// Headless contexts alive.
+static SDL_atomic_t nG_ContextCount;
+
+
+#define nG_Renderer       (nG_Ctx->renderer)
+#define nG_Window         (nG_Ctx->window)
+#define nG_TargetHeight   (nG_Ctx->targetHeight)
+#define nG_PPM            (nG_Ctx->ppm * nG_Ctx->ppmScale)
+#define nG_BaseLoaderPath (nG_Ctx->loaderPath)
+#define nG_Backend        (nG_Ctx->backend)
+#define nG_DirtyEnabled   (nG_Ctx->dirty != NULL)
+#define nG_RasterColor    (nG_Ctx->drawColor)
+#define nG_Scene          (nG_Ctx->scene)
+#define nG_ViewClip       (nG_Ctx->viewClip)
+#define n_ShouldQuit      (nG_Ctx->shouldQuit)
+#define n_DefaultBGColor  (nG_Ctx->bgColor)
+
+
+// Size of the current context's window, surface, or render scaling
+// target.
+static void nG_GetScreenSize(int* w, int* h)
+{
+    if (nG_Ctx->scaledWidth > 0) {
+        if (w) {
+            *w = nG_Ctx->scaledWidth;
+        }
+        if (h) {
+            *h = nG_Ctx->scaledHeight;
+        }
+        return;
+    }
+    if (nG_Window) {
+        SDL_GetWindowSize(nG_Window, w, h);
+        return;
+    }
+    if (w) {
+        *w = nG_Ctx->surface ? nG_Ctx->surface->w : 0;
+    }
+    if (h) {
+        *h = nG_Ctx->surface ? nG_Ctx->surface->h : 0;
+    }
+}
+
+// n_Subsystem flags already brought up, and the ones that failed (they
+// aren't retried). A mutex, not a spinlock: bringing a subsystem up
+// takes long, and the other threads sleep on it meanwhile.
+static SDL_atomic_t nG_Subsystems;
+static uint32_t     nG_SubsystemsFailed = 0;
+static SDL_mutex*   nG_SubsystemLock    = NULL;
+
+
+static inline bool nG_HasSubsystems(uint32_t subsystems)
+{
+    return (UInt32(SDL_AtomicGet(&nG_Subsystems)) & subsystems) == subsystems;
+}
+
+
+// ========================================================
+//
+// MATH
+//
+// ========================================================
+
+
+bool n_IsValidRect(const n_Rect *restrict r)
+{
+    return !r ? false : (r->w > 0.0f && r->h > 0.0f);
+}
+
+bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b)
+{
+    if (a && b) {
+        return a->x < (b->x + b->w)
+            && b->x < (a->x + a->w)
+            && a->y < (b->y + b->h)
+            && b->y < (a->y + a->h);
+    }
+    return false;
+}
+
+// Normal of the axis along which <a> is the least inside <b>.
+static n_Vec2 nG_PenetrationNormal(const n_Rect *restrict a, const n_Rect *restrict b)
+{
+    float left  = (a->x + a->w) - b->x;
+    float right = (b->x + b->w) - a->x;
+    float down  = (a->y + a->h) - b->y;
+    float up    = (b->y + b->h) - a->y;
+    float dx    = fminf(left, right);
+    float dy    = fminf(down, up);
+
+    if (dx < dy) {
+        return n_Vec2(.x = (left < right) ? -1.0f : 1.0f);
+    }
+    return n_Vec2(.y = (down < up) ? -1.0f : 1.0f);
+}
+
+bool n_SweepRect(const n_Rect *restrict a, n_Vec2 delta, const n_Rect *restrict b, n_Sweep* hit)
+{
+    // a point (a's corner) against b grown by a's size
+    float minX = b->x - a->w;
+    float maxX = b->x + b->w;
+    float minY = b->y - a->h;
+    float maxY = b->y + b->h;
+    float enterX, exitX, enterY, exitY;
+
+    if (delta.x == 0.0f) {
+        if (a->x <= minX || a->x >= maxX) {
+            return false;
+        }
+        enterX = -INFINITY;
+        exitX  = INFINITY;
+    } else {
+        float inv = 1.0f / delta.x;
+        float t0  = (minX - a->x) * inv;
+        float t1  = (maxX - a->x) * inv;
+        enterX = fminf(t0, t1);
+        exitX  = fmaxf(t0, t1);
+    }
+
+    if (delta.y == 0.0f) {
+        if (a->y <= minY || a->y >= maxY) {
+            return false;
+        }
+        enterY = -INFINITY;
+        exitY  = INFINITY;
+    } else {
+        float inv = 1.0f / delta.y;
+        float t0  = (minY - a->y) * inv;
+        float t1  = (maxY - a->y) * inv;
+        enterY = fminf(t0, t1);
+        exitY  = fmaxf(t0, t1);
+    }
+
+    float enter = fmaxf(enterX, enterY);
+    float exit  = fminf(exitX, exitY);
+
+    // touching faces (enter == exit) isn't an overlap
+    if (enter >= exit || enter > 1.0f || exit <= 0.0f) {
+        return false;
+    }
+
+    if (hit) {
+        if (enter <= 0.0f) {
+            hit->time   = 0.0f;
+            hit->normal = nG_PenetrationNormal(a, b);
+        } else if (enterX > enterY) {
+            hit->time   = enter;
+            hit->normal = n_Vec2(.x = (delta.x > 0.0f) ? -1.0f : 1.0f);
+        } else {
+            hit->time   = enter;
+            hit->normal = n_Vec2(.y = (delta.y > 0.0f) ? -1.0f : 1.0f);
+        }
+        hit->index = 0;
+    }
+    return true;
+}
+
+bool n_SweepRects(const n_Rect *restrict a, n_Vec2 delta, const n_Rect *restrict set, int count, n_Sweep* hit)
+{
+    // bounds of the whole move, to skip most of the set cheaply
+    n_Rect  swept = n_Rect(
+        .x = a->x + fminf(delta.x, 0.0f),
+        .y = a->y + fminf(delta.y, 0.0f),
+        .w = a->w + fabsf(delta.x),
+        .h = a->h + fabsf(delta.y)
+    );
+    n_Sweep best = {.time = INFINITY, .index = -1};
+    n_Sweep s;
+
+    for (int i = 0; i < count; i++) {
+        const n_Rect* b = &set[i];
+
+        if (swept.x > (b->x + b->w) || b->x > (swept.x + swept.w)
+            || swept.y > (b->y + b->h) || b->y > (swept.y + swept.h)) {
+            continue;
+        }
+
+        if (n_SweepRect(a, delta, b, &s) && s.time < best.time) {
+            best       = s;
+            best.index = i;
+        }
+    }
+
+    if (hit) {
+        *hit = best;
+    }
+    return best.index >= 0;
+}
+
+bool n_MoveRect(n_Rect* r, n_Vec2 delta, bool bullet, const n_Rect *restrict set, int count, n_Sweep* hit)
+{
+    n_Sweep s = {.time = 1.0f, .index = -1};
+
+    if (bullet) {
+        if (n_SweepRects(r, delta, set, count, &s)) {
+            r->x += delta.x * s.time;
+            r->y += delta.y * s.time;
+        } else {
+            r->x += delta.x;
+            r->y += delta.y;
+        }
+    } else {
+        n_Rect moved = n_Rect(.x = r->x + delta.x, .y = r->y + delta.y, .w = r->w, .h = r->h);
+
+        for (int i = 0; i < count; i++) {
+            if (n_RectsOverlap(&moved, (n_Rect *) &set[i])) {
+                s.index  = i;
+                s.time   = 0.0f;
+                s.normal = nG_PenetrationNormal(&moved, &set[i]);
+                break;
+            }
+        }
+        if (s.index < 0) {
+            *r = moved;
+        }
+    }
+
+    if (hit) {
+        *hit = s;
+    }
+    return s.index >= 0;
+}
+
+
+// ========================================================
+//
+// UTIL
+//
+// ========================================================
+
+
+// A message in the log queue: the format string followed by the
+// arguments, in the order they're consumed. Preformatted slots hold
+// the final text (used when the arguments don't fit).
+typedef struct {
+    SDL_atomic_t seq;
+    uint8_t      level;
+    uint8_t      preformatted;
+    uint16_t     size;
+    char         data[nG_LOG_SLOT_SIZE];
+} nG_LogSlot;
+
+typedef struct {
+    int  stars;
+    int  prec;   // -1 when not given, -2 when given by a '*'
+    char length; // 0, 'H' (hh), 'h', 'l', 'q' (ll), 'j', 'z', 't' or 'L'
+    char conv;
+    int  size;   // the spec's length, '%' included
+} nG_LogSpec;
+
+// Per format string counter for the rate limit.
+typedef struct {
+    uint32_t hash;
+    uint32_t second;
+    uint32_t count;
+    uint32_t suppressed;
+    uint8_t  level;
+    char     sample[40];
+} nG_LogRate;
+
+
+#define nG_LogRates 64
+
+
+static nG_LogSlot   nG_LogQueue[nG_LOG_SLOTS];
+static nG_LogRate   nG_LogRateTable[nG_LogRates];
+static SDL_SpinLock nG_LogRateLock;
+static SDL_atomic_t nG_LogHead;
+static SDL_atomic_t nG_LogDone;
+static SDL_atomic_t nG_LogDropped;
+static SDL_atomic_t nG_LogRunning;
+static SDL_atomic_t nG_LogBusy;
+static SDL_atomic_t nG_LogMinLevel;
+static int          nG_LogTail;
+static SDL_Thread*  nG_LogThread;
+static SDL_sem*     nG_LogSem;
+
+static const char* nG_LogPrefix[] = { "debug: ", "", "warning: ", "error: " };
+
+
+// FNV-1a
+static uint32_t nG_Hash(uint32_t h, const void* data, size_t len)
+{
+    const uint8_t* p = data;
+
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+
+    return h;
+}
+
+// <s> points at a '%'. Returns false if the spec is malformed.
+static bool nG_ParseLogSpec(const char* s, nG_LogSpec* spec)
+{
+    const char* p = s + 1;
+
+    spec->stars = 0;
+    spec->prec = -1;
+    spec->length = 0;
+
+    while (*p && strchr("-+ #0'", *p)) {
+        p++;
+    }
+    if (*p == '*') {
+        spec->stars++;
+        p++;
+    }
+    while (*p >= '0' && *p <= '9') {
+        p++;
+    }
+    if (*p == '.') {
+        p++;
+        spec->prec = 0;
+        if (*p == '*') {
+            spec->stars++;
+            spec->prec = -2;
+            p++;
+        }
+        while (*p >= '0' && *p <= '9') {
+            if (spec->prec >= 0 && spec->prec < 100000000) {
+                spec->prec = spec->prec * 10 + (*p - '0');
+            }
+            p++;
+        }
+    }
+
+    switch (*p) {
+    case 'h':
+        spec->length = (p[1] == 'h') ? 'H' : 'h';
+        p += (p[1] == 'h') ? 2 : 1;
+        break;
+    case 'l':
+        spec->length = (p[1] == 'l') ? 'q' : 'l';
+        p += (p[1] == 'l') ? 2 : 1;
+        break;
+    case 'j': case 'z': case 't': case 'L':
+        spec->length = *p++;
+        break;
+    }
+
+    if (!*p || !strchr("diouxXcfFeEgGaAspn%", *p) || p - s > 30) {
+        return false;
+    }
+    spec->conv = *p;
+    spec->size = Int(p - s + 1);
+    return true;
+}
+
+static bool nG_LogPut(nG_LogSlot* slot, const void* v, size_t size)
+{
+    if (slot->size + size > nG_LOG_SLOT_SIZE) {
+        return false;
+    }
+    memcpy(slot->data + slot->size, v, size);
+    slot->size += UInt16(size);
+    return true;
+}
+
+// Copies <fmt> and the arguments it consumes into <slot>. Only the
+// values are copied; nothing is formatted here.
+static bool nG_PackLog(nG_LogSlot* slot, const char* fmt, va_list args)
+{
+    nG_LogSpec spec;
+
+    slot->size = 0;
+    if (!nG_LogPut(slot, fmt, strlen(fmt) + 1)) {
+        return false;
+    }
+
+    for (const char* p = fmt; *p; p++) {
+        if (*p != '%') {
+            continue;
+        }
+        if (!nG_ParseLogSpec(p, &spec)) {
+            continue;
+        }
+        p += spec.size - 1;
+
+        int star[2] = { 0, 0 };
+        for (int i = 0; i < spec.stars; i++) {
+            star[i] = va_arg(args, int);
+            if (!nG_LogPut(slot, &star[i], sizeof(star[i]))) {
+                return false;
+            }
+        }
+
+        bool ok = true;
+        switch (spec.conv) {
+        case '%':
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            if (spec.length == 'L') {
+                long double v = va_arg(args, long double);
+                ok = nG_LogPut(slot, &v, sizeof(v));
+            } else {
+                double v = va_arg(args, double);
+                ok = nG_LogPut(slot, &v, sizeof(v));
+            }
+            break;
+        case 's': {
+            // wide strings aren't supported
+            const char* v    = va_arg(args, const char*);
+            int         prec = (spec.prec == -2) ? star[spec.stars - 1] : spec.prec;
+            v = (spec.length == 'l') ? "(?)" : (v ? v : "(null)");
+
+            // with a precision, <v> needn't be terminated: only the bytes
+            // printf() would read are copied
+            const char* end = (prec >= 0) ? memchr(v, '\0', (size_t) prec) : NULL;
+            size_t      n   = (prec < 0) ? strlen(v) : end ? (size_t) (end - v) : (size_t) prec;
+
+            ok = nG_LogPut(slot, v, n) && nG_LogPut(slot, "", 1);
+            break;
+        }
+        case 'p': {
+            void* v = va_arg(args, void*);
+            ok = nG_LogPut(slot, &v, sizeof(v));
+            break;
+        }
+        case 'n':
+            va_arg(args, void*);
+            break;
+        default: {
+            long long v;
+            switch (spec.length) {
+            case 'l': v = va_arg(args, long);      break;
+            case 'q': v = va_arg(args, long long); break;
+            case 'j': v = va_arg(args, intmax_t);  break;
+            case 'z': v = Int64(va_arg(args, size_t));    break;
+            case 't': v = va_arg(args, ptrdiff_t); break;
+            default:  v = va_arg(args, int);       break;
+            }
+            ok = nG_LogPut(slot, &v, sizeof(v));
+            break;
+        }
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#define nG_LogPrint(T, v) (                                                       \
+    (spec.stars == 0) ? snprintf(out + len, cap - len, piece, (T) (v)) :          \
+    (spec.stars == 1) ? snprintf(out + len, cap - len, piece, star[0], (T) (v)) : \
+                        snprintf(out + len, cap - len, piece, star[0], star[1], (T) (v)))
+
+// The writer's side of nG_PackLog(): formats the slot into <out>,
+// one conversion at a time.
+static int nG_UnpackLog(const nG_LogSlot* slot, char* out, int cap)
+{
+    const char* fmt = slot->data;
+    const char* arg = fmt + strlen(fmt) + 1;
+    nG_LogSpec  spec;
+    char        piece[32];
+    int         len = 0;
+
+    for (const char* p = fmt; *p && len < cap - 1; p++) {
+        if (*p != '%' || !nG_ParseLogSpec(p, &spec)) {
+            out[len++] = *p;
+            continue;
+        }
+        memcpy(piece, p, spec.size);
+        piece[spec.size] = '\0';
+        p += spec.size - 1;
+
+        int star[2] = { 0, 0 };
+        for (int i = 0; i < spec.stars; i++) {
+            memcpy(&star[i], arg, sizeof(int));
+            arg += sizeof(int);
+        }
+
+        int n = 0;
+        switch (spec.conv) {
+        case '%':
+            n = snprintf(out + len, cap - len, "%%");
+            break;
+        case 'n':
+            break;
+        case 'f': case 'F': case 'e': case 'E':
+        case 'g': case 'G': case 'a': case 'A':
+            if (spec.length == 'L') {
+                long double v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                n = nG_LogPrint(long double, v);
+            } else {
+                double v;
+                memcpy(&v, arg, sizeof(v));
+                arg += sizeof(v);
+                n = nG_LogPrint(double, v);
+            }
+            break;
+        case 's':
+            if (spec.length == 'l') {
+                strcpy(piece, "%s");
+                spec.stars = 0;
+            }
+            n = nG_LogPrint(const char*, arg);
+            arg += strlen(arg) + 1;
+            break;
+        case 'p': {
+            void* v;
+            memcpy(&v, arg, sizeof(v));
+            arg += sizeof(v);
+            n = nG_LogPrint(void*, v);
+            break;
+        }
+        default: {
+            long long v;
+            memcpy(&v, arg, sizeof(v));
+            arg += sizeof(v);
+            switch (spec.length) {
+            case 'l': n = nG_LogPrint(long, v);      break;
+            case 'q': n = nG_LogPrint(long long, v); break;
+            case 'j': n = nG_LogPrint(intmax_t, v);  break;
+            case 'z': n = nG_LogPrint(size_t, v);    break;
+            case 't': n = nG_LogPrint(ptrdiff_t, v); break;
+            default:  n = nG_LogPrint(int, v);       break;
+            }
+            break;
+        }
+        }
+        len += (n < 0) ? 0 : n;
+        len = (len > cap - 1) ? cap - 1 : len;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+#undef nG_LogPrint
+
+// Called by the writer for the counters whose second is over (all of
+// them when stopping) and that no new message has reported.
+static void nG_ReportSuppressed(bool all)
+{
+    uint32_t now = SDL_GetTicks() / 1000;
+
+    for (int i = 0; i < nG_LogRates; i++) {
+        nG_LogRate r;
+
+        SDL_AtomicLock(&nG_LogRateLock);
+        r = nG_LogRateTable[i];
+        if (r.suppressed > 0 && (all || r.second != now)) {
+            nG_LogRateTable[i].suppressed = 0;
+        } else {
+            r.suppressed = 0;
+        }
+        SDL_AtomicUnlock(&nG_LogRateLock);
+
+        if (r.suppressed > 0) {
+            fprintf(
+                nG_LOG_BUFFER,
+                "%s(%u more messages like \"%s\" suppressed)\n",
+                nG_LogPrefix[r.level],
+                r.suppressed,
+                r.sample
+            );
+        }
+    }
+}
+
+// Counts the message against its format string's budget for the
+// current second. Called by n_Log() before the message is queued, so
+// that a storm of repeats doesn't fill the queue. When the counter is
+// taken over, its previous owner is copied into <prev> (with
+// prev->suppressed > 0 if it has repeats to report).
+static bool nG_LogAllowed(n_LogLevel level, const char* fmt, nG_LogRate* prev)
+{
+    bool allowed = true;
+
+    prev->suppressed = 0;
+
+#if nG_LOG_RATE_LIMIT > 0
+    uint32_t    hash = nG_Hash(2166136261u, fmt, strlen(fmt));
+    uint32_t    now = SDL_GetTicks() / 1000;
+    nG_LogRate* r = &nG_LogRateTable[hash % nG_LogRates];
+
+    SDL_AtomicLock(&nG_LogRateLock);
+    if (r->hash != hash || r->second != now) {
+        *prev = *r;
+        r->hash = hash;
+        r->second = now;
+        r->count = 0;
+        r->suppressed = 0;
+        r->level = UInt8(level);
+        snprintf(r->sample, sizeof(r->sample), "%.*s", Int(strcspn(fmt, "\n")), fmt);
+    }
+    if (++r->count > nG_LOG_RATE_LIMIT) {
+        r->suppressed++;
+        allowed = false;
+    }
+    SDL_AtomicUnlock(&nG_LogRateLock);
+#else
+    (void) level;
+    (void) fmt;
+#endif // nG_LOG_RATE_LIMIT > 0
+
+    return allowed;
+}
+
+// Writes every published message. Returns how many were taken.
+static int nG_DrainLog(void)
+{
+    char text[1024];
+    int  taken = 0;
+
+    while (true) {
+        nG_LogSlot* slot = &nG_LogQueue[nG_LogTail & (nG_LOG_SLOTS - 1)];
+        if (SDL_AtomicGet(&slot->seq) != nG_LogTail + 1) {
+            break;
+        }
+
+        const char* s = slot->data;
+        if (!slot->preformatted) {
+            nG_UnpackLog(slot, text, sizeof(text));
+            s = text;
+        }
+        fprintf(nG_LOG_BUFFER, "%s%s", nG_LogPrefix[slot->level], s);
+
+        SDL_AtomicSet(&slot->seq, nG_LogTail + nG_LOG_SLOTS);
+        nG_LogTail++;
+        SDL_AtomicSet(&nG_LogDone, nG_LogTail);
+        taken++;
+    }
+
+    int dropped = SDL_AtomicSet(&nG_LogDropped, 0);
+    if (dropped > 0) {
+        fprintf(nG_LOG_BUFFER, "(%d log messages dropped, queue full)\n", dropped);
+    }
+    if (taken > 0 || dropped > 0) {
+        fflush(nG_LOG_BUFFER);
+    }
+    return taken;
+}
+
+static int nG_LogWriter(void* data)
+{
+    while (true) {
+        bool running = SDL_AtomicGet(&nG_LogRunning);
+        int  taken = nG_DrainLog();
+
+        nG_ReportSuppressed(false);
+        if (!running && taken == 0) {
+            break;
+        }
+        if (taken == 0) {
+            SDL_SemWaitTimeout(nG_LogSem, 100);
+        }
+    }
+    nG_ReportSuppressed(true);
+    fflush(nG_LOG_BUFFER);
+    return 0;
+}
+
+static void nG_StartLog(void)
+{
+    if (SDL_AtomicGet(&nG_LogRunning)) {
+        return;
+    }
+
+    for (int i = 0; i < nG_LOG_SLOTS; i++) {
+        SDL_AtomicSet(&nG_LogQueue[i].seq, nG_LogTail + i);
+    }
+    SDL_AtomicSet(&nG_LogHead, nG_LogTail);
+    SDL_AtomicSet(&nG_LogDone, nG_LogTail);
+
+    nG_LogSem = SDL_CreateSemaphore(0);
+    if (!nG_LogSem) {
+        return;
+    }
+    SDL_AtomicSet(&nG_LogRunning, 1);
+    nG_LogThread = SDL_CreateThread(nG_LogWriter, "nolib log", NULL);
+    if (!nG_LogThread) {
+        SDL_AtomicSet(&nG_LogRunning, 0);
+        SDL_DestroySemaphore(nG_LogSem);
+        nG_LogSem = NULL;
+    }
+}
+
+static void nG_StopLog(void)
+{
+    if (!SDL_AtomicGet(&nG_LogRunning)) {
+        return;
+    }
+
+    // from here on new messages are printed directly; wait for the
+    // ones being queued
+    SDL_AtomicSet(&nG_LogRunning, 0);
+    while (SDL_AtomicGet(&nG_LogBusy) > 0) {
+        SDL_Delay(0);
+    }
+
+    SDL_SemPost(nG_LogSem);
+    SDL_WaitThread(nG_LogThread, NULL);
+    SDL_DestroySemaphore(nG_LogSem);
+    nG_LogThread = NULL;
+    nG_LogSem = NULL;
+}
+
+// Queues the message (or prints it, when the writer isn't running).
+static void nG_LogV(n_LogLevel level, const char *restrict fmt, va_list args)
+{
+    va_list copy;
+
+    SDL_AtomicAdd(&nG_LogBusy, 1);
+    if (!SDL_AtomicGet(&nG_LogRunning)) {
+        SDL_AtomicAdd(&nG_LogBusy, -1);
+        fputs(nG_LogPrefix[level], nG_LOG_BUFFER);
+        vfprintf(nG_LOG_BUFFER, fmt, args);
+        return;
+    }
+
+    // bounded MPMC queue (Vyukov) with a single consumer: a slot is
+    // free for position pos when its seq is pos, and readable when
+    // it's pos + 1
+    nG_LogSlot* slot = NULL;
+    int         pos = SDL_AtomicGet(&nG_LogHead);
+    while (true) {
+        slot = &nG_LogQueue[pos & (nG_LOG_SLOTS - 1)];
+        int diff = Int(UInt32(SDL_AtomicGet(&slot->seq)) - UInt32(pos));
+        if (diff == 0) {
+            if (SDL_AtomicCAS(&nG_LogHead, pos, pos + 1)) {
+                break;
+            }
+            pos = SDL_AtomicGet(&nG_LogHead);
+        } else if (diff < 0) {
+            SDL_AtomicIncRef(&nG_LogDropped);
+            SDL_AtomicAdd(&nG_LogBusy, -1);
+            return;
+        } else {
+            pos = SDL_AtomicGet(&nG_LogHead);
+        }
+    }
+
+    slot->level = UInt8(level);
+    slot->preformatted = 0;
+
+    va_copy(copy, args);
+    if (!nG_PackLog(slot, fmt, copy)) {
+        vsnprintf(slot->data, sizeof(slot->data), fmt, args);
+        slot->preformatted = 1;
+    }
+    va_end(copy);
+
+    SDL_AtomicSet(&slot->seq, pos + 1);
+    SDL_AtomicAdd(&nG_LogBusy, -1);
+
+    if (SDL_SemValue(nG_LogSem) == 0) {
+        SDL_SemPost(nG_LogSem);
+    }
+}
+
+static void nG_LogRaw(n_LogLevel level, const char *restrict fmt, ...)
+{
+    va_list args;
+
+    va_start(args, fmt);
+    nG_LogV(level, fmt, args);
+    va_end(args);
+}
+
+void n_Log(n_LogLevel level, const char *restrict fmt, ...)
+{
+    va_list    args;
+    nG_LogRate prev;
+
+    if (Int(level) < SDL_AtomicGet(&nG_LogMinLevel) || level >= n_LogLevel_Off) {
+        return;
+    }
+
+    bool allowed = nG_LogAllowed(level, fmt, &prev);
+
+    if (prev.suppressed > 0) {
+        nG_LogRaw(
+            (n_LogLevel) prev.level,
+            "(%u more messages like \"%s\" suppressed)\n",
+            prev.suppressed,
+            prev.sample
+        );
+    }
+
+    if (!allowed) {
+        return;
+    }
+
+    va_start(args, fmt);
+    nG_LogV(level, fmt, args);
+    va_end(args);
+}
+
+void n_FlushLog(void)
+{
+    if (!SDL_AtomicGet(&nG_LogRunning)) {
+        fflush(nG_LOG_BUFFER);
+        return;
+    }
+
+    int target = SDL_AtomicGet(&nG_LogHead);
+    SDL_SemPost(nG_LogSem);
+    while (Int(UInt32(SDL_AtomicGet(&nG_LogDone)) - UInt32(target)) < 0 && SDL_AtomicGet(&nG_LogRunning)) {
+        SDL_Delay(1);
+    }
+}
+
+void n_SetLogLevel(n_LogLevel level)
+{
+    SDL_AtomicSet(&nG_LogMinLevel, Int(level));
+}
+
+
+typedef struct {
+    long     bytes;
+    long     peakBytes;
+    long     count;
+    long     peakCount;
+    uint64_t total;
+} nG_AllocStats;
+
+typedef struct {
+    const char* file;
+    int         line;
+    int         tag;
+    long        bytes;
+    long        count;
+    uint64_t    total;
+} nG_AllocSite;
+
+// Tracked blocks (and counted textures) are kept in a table by
+// address, so that the blocks are plain malloc() blocks: n_Delete()
+// may be handed memory n_New() didn't allocate, and is then free().
+typedef struct {
+    const void* ptr;
+    size_t      size;
+    uint32_t    site;
+    uint16_t    tag;
+} nG_AllocEntry;
+
+
+static nG_AllocStats nG_AllocTags[nG_ALLOC_TAGS];
+static nG_AllocSite  nG_AllocSites[nG_ALLOC_SITES];
+static const char*   nG_AllocTagNames[nG_ALLOC_TAGS] = {
+    "general",
+    "engine",
+    "textures",
+    "animations",
+    "frames",
+    "particles",
+    "sounds"
+};
+static SDL_SpinLock  nG_AllocLock        = 0;
+static uint32_t      nG_FrameAllocs      = 0;
+static uint32_t      nG_LastFrameAllocs  = 0;
+static uint32_t      nG_PeakFrameAllocs  = 0;
+
+// by address, see nG_AllocEntry
+static nG_AllocEntry* nG_AllocTable    = NULL;
+static uint32_t       nG_AllocTableCap = 0;
+static uint32_t       nG_AllocTableLen = 0;
+
+
+static inline int nG_ClampTag(int tag)
+{
+    return (tag >= 0 && tag < nG_ALLOC_TAGS) ? tag : n_AllocTag_General;
+}
+
+// Call with nG_AllocLock held. Site 0 collects the call sites that
+// don't fit in the table.
+static uint32_t nG_FindAllocSite(const char* file, int line, int tag)
+{
+    uintptr_t h = (uintptr_t) file * 31u + UInt32(line) * 2654435761u;
+    uint32_t  i = UInt32(h % (nG_ALLOC_SITES - 1)) + 1;
+
+    for (int probes = 0; probes < nG_ALLOC_SITES - 1; probes++) {
+        nG_AllocSite* site = &nG_AllocSites[i];
+
+        if (!site->file) {
+            site->file = file;
+            site->line = line;
+            site->tag  = tag;
+            return i;
+        }
+
+        if (site->file == file && site->line == line) {
+            return i;
+        }
+
+        i = i + 1 < nG_ALLOC_SITES ? i + 1 : 1;
+    }
+
+    return 0;
+}
+
+static inline uint32_t nG_AllocHome(const void* ptr)
+{
+    return UInt32(((uintptr_t) ptr >> 4) * 2654435761u) & (nG_AllocTableCap - 1);
+}
+
+// Call with nG_AllocLock held. The slot of <ptr>, or the empty one it
+// would go in.
+static uint32_t nG_FindAllocEntry(const void* ptr)
+{
+    uint32_t i = nG_AllocHome(ptr);
+
+    while (nG_AllocTable[i].ptr && nG_AllocTable[i].ptr != ptr) {
+        i = (i + 1) & (nG_AllocTableCap - 1);
+    }
+
+    return i;
+}
+
+// Call with nG_AllocLock held.
+static bool nG_AddAllocEntry(const nG_AllocEntry* e)
+{
+    if ((nG_AllocTableLen + 1) * 2 > nG_AllocTableCap) {
+        nG_AllocEntry* old    = nG_AllocTable;
+        uint32_t       oldCap = nG_AllocTableCap;
+        uint32_t       cap    = oldCap ? oldCap * 2 : 1024;
+
+        // not n_New(): the table doesn't track itself
+        nG_AllocEntry* table = calloc(cap, sizeof(nG_AllocEntry));
+
+        if (!table) {
+            return false;
+        }
+
+        nG_AllocTable    = table;
+        nG_AllocTableCap = cap;
+        for (uint32_t i = 0; i < oldCap; i++) {
+            if (old[i].ptr) {
+                nG_AllocTable[nG_FindAllocEntry(old[i].ptr)] = old[i];
+            }
+        }
+        free(old);
+    }
+
+    uint32_t i = nG_FindAllocEntry(e->ptr);
+
+    nG_AllocTableLen += !nG_AllocTable[i].ptr;
+    nG_AllocTable[i]  = *e;
+    return true;
+}
+
+// Call with nG_AllocLock held. Removes <ptr> from the table into <e>;
+// false if it isn't tracked.
+static bool nG_TakeAllocEntry(const void* ptr, nG_AllocEntry* e)
+{
+    if (!ptr || nG_AllocTableLen == 0) {
+        return false;
+    }
+
+    uint32_t mask = nG_AllocTableCap - 1;
+    uint32_t i    = nG_FindAllocEntry(ptr);
+
+    if (!nG_AllocTable[i].ptr) {
+        return false;
+    }
+
+    *e = nG_AllocTable[i];
+
+    // shift the rest of the cluster back so that no probe breaks
+    for (uint32_t j = (i + 1) & mask; nG_AllocTable[j].ptr; j = (j + 1) & mask) {
+        uint32_t home = nG_AllocHome(nG_AllocTable[j].ptr);
+
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            nG_AllocTable[i] = nG_AllocTable[j];
+            i = j;
+        }
+    }
+
+    nG_AllocTable[i] = (nG_AllocEntry) { 0 };
+    nG_AllocTableLen--;
+    return true;
+}
+
+static void nG_CountAlloc(int tag, uint32_t site, long bytes, long count)
+{
+    nG_AllocStats* t = &nG_AllocTags[tag];
+    nG_AllocSite*  s = &nG_AllocSites[site];
+
+    t->bytes += bytes;
+    t->count += count;
+    s->bytes += bytes;
+    s->count += count;
+
+    if (count > 0) {
+        t->total += UInt64(count);
+        s->total += UInt64(count);
+        nG_FrameAllocs += UInt32(count);
+    }
+
+    t->peakBytes = t->bytes > t->peakBytes ? t->bytes : t->peakBytes;
+    t->peakCount = t->count > t->peakCount ? t->count : t->peakCount;
+}
+
+// Called by n_Run() at the end of every frame.
+static void nG_EndAllocFrame(void)
+{
+    SDL_AtomicLock(&nG_AllocLock);
+    nG_LastFrameAllocs = nG_FrameAllocs;
+    nG_PeakFrameAllocs = nG_FrameAllocs > nG_PeakFrameAllocs ? nG_FrameAllocs : nG_PeakFrameAllocs;
+    nG_FrameAllocs     = 0;
+    SDL_AtomicUnlock(&nG_AllocLock);
+}
+
+static void nG_ReportLeaks(void)
+{
+#ifdef nG_TRACK_ALLOCATIONS
+    bool leaked = false;
+
+    for (int i = 0; i < nG_ALLOC_SITES; i++) {
+        const nG_AllocSite* s = &nG_AllocSites[i];
+
+        if (s->count > 0) {
+            if (!leaked) {
+                n_LogWarnf("Leaked allocations:\n");
+                leaked = true;
+            }
+            n_LogWarnf(
+                "  %s:%d [%s] %ld bytes in %ld blocks\n",
+                s->file ? s->file : "(other)",
+                s->line,
+                nG_AllocTagNames[s->tag] ? nG_AllocTagNames[s->tag] : "user",
+                s->bytes,
+                s->count
+            );
+        }
+    }
+#endif // nG_TRACK_ALLOCATIONS
+}
+
+
+// Size of a texture (assuming 4 bytes per pixel), for n_TrackMemory().
+static long nG_TextureBytes(SDL_Texture* tex)
+{
+    int w, h;
+
+    if (!tex || SDL_QueryTexture(tex, NULL, NULL, &w, &h) < 0) {
+        return 0;
+    }
+
+    return 4L * w * h;
+}
+
+// Counts a texture the library created in n_AllocTag_Textures, until
+// n_DeleteTexture() uncounts it. Textures that weren't counted (the
+// game's own) are left alone by n_DeleteTexture().
+static void nG_TrackTexture(SDL_Texture* tex)
+{
+#ifdef nG_TRACK_ALLOCATIONS
+    nG_AllocEntry e = {
+        .ptr  = tex,
+        .size = (size_t) nG_TextureBytes(tex),
+        .tag  = n_AllocTag_Textures
+    };
+
+    SDL_AtomicLock(&nG_AllocLock);
+    if (tex && nG_AddAllocEntry(&e)) {
+        nG_CountAlloc(e.tag, 0, Long(e.size), 1);
+    }
+    SDL_AtomicUnlock(&nG_AllocLock);
+#else
+    (void) tex;
+#endif // nG_TRACK_ALLOCATIONS
+}
+
+static void nG_UntrackTexture(SDL_Texture* tex)
+{
+#ifdef nG_TRACK_ALLOCATIONS
+    nG_AllocEntry e;
+
+    SDL_AtomicLock(&nG_AllocLock);
+    if (nG_TakeAllocEntry(tex, &e)) {
+        nG_CountAlloc(e.tag, e.site, -Long(e.size), -1);
+    }
+    SDL_AtomicUnlock(&nG_AllocLock);
+#else
+    (void) tex;
+#endif // nG_TRACK_ALLOCATIONS
+}
+
+// Marks a managed texture as used this frame (see n_GetTexture()).
+static void nG_TouchTexture(SDL_Texture* tex);
+// Counts one more (<delta> 1) or one less (-1) scene keeping a
+// managed texture resident.
+static void nG_PinTexture(SDL_Texture* tex, int delta);
+static void nG_EndTextureFrame(void);
+
+// Reads the frame back if n_StartCapture() asked for it.
+static void nG_CaptureFrame(void);
+
+// When the last frame was submitted, for n_GetLatencyStats().
+static uint64_t nG_PresentStart = 0;
+
+// Runs the frame's systems (see n_AddSystem()).
+static void nG_RunSystems(n_GameTime gt);
+static void nG_QuitSystems(void);
+
+// Publishes the frame's telemetry (see n_StartTelemetry()), with the
+// times n_Run() started the frame, sampled the input and stepped.
+static void nG_EndTelemetryFrame(uint64_t start, uint64_t sampled, uint64_t stepped);
+
+
+uint32_t n_GetFrameAllocations(void)
+{
+    return nG_LastFrameAllocs;
+}
+
+void n_ReportAllocations(void)
+{
+    SDL_AtomicLock(&nG_AllocLock);
+
+    n_Logf("%-12s %12s %12s %10s %10s %12s\n", "tag", "bytes", "peak bytes", "count", "peak", "total");
+    for (int i = 0; i < nG_ALLOC_TAGS; i++) {
+        const nG_AllocStats* t = &nG_AllocTags[i];
+
+        if (t->total == 0 && t->count == 0) {
+            continue;
+        }
+
+        if (nG_AllocTagNames[i]) {
+            n_Logf("%-12s ", nG_AllocTagNames[i]);
+        } else {
+            n_Logf("user %-7d ", i);
+        }
+
+        n_Logf(
+            "%12ld %12ld %10ld %10ld %12llu\n",
+            t->bytes,
+            t->peakBytes,
+            t->count,
+            t->peakCount,
+            (unsigned long long) t->total
+        );
+    }
+
+    n_Logf(
+        "allocations per frame: %u (last), %u (peak)\n",
+        nG_LastFrameAllocs,
+        nG_PeakFrameAllocs
+    );
+
+    for (int i = 0; i < nG_ALLOC_SITES; i++) {
+        const nG_AllocSite* s = &nG_AllocSites[i];
+
+        if (s->count > 0) {
+            n_Logf(
+                "  %s:%d %ld bytes in %ld blocks (%llu allocations)\n",
+                s->file ? s->file : "(other)",
+                s->line,
+                s->bytes,
+                s->count,
+                (unsigned long long) s->total
+            );
+        }
+    }
+
+    SDL_AtomicUnlock(&nG_AllocLock);
+}
+
+void n_SetAllocTagName(int tag, const char *restrict name)
+{
+    if (tag >= n_AllocTag_User && tag < nG_ALLOC_TAGS) {
+        nG_AllocTagNames[tag] = name;
+    }
+}
+
+void n_TrackMemory(int tag, long bytes, int count)
+{
+#ifdef nG_TRACK_ALLOCATIONS
+    SDL_AtomicLock(&nG_AllocLock);
+    nG_CountAlloc(nG_ClampTag(tag), 0, bytes, count);
+    SDL_AtomicUnlock(&nG_AllocLock);
+#endif // nG_TRACK_ALLOCATIONS
+}
+
+// Call with nG_AllocLock held. Frees <p> if it can't be tracked.
+static void* nG_TrackAlloc(void* p, size_t size, int tag, const char* file, int line)
+{
+    nG_AllocEntry e = {
+        .ptr  = p,
+        .size = size,
+        .tag  = UInt16(tag),
+        .site = nG_FindAllocSite(file, line, tag)
+    };
+
+    if (!nG_AddAllocEntry(&e)) {
+        free(p);
+        return NULL;
+    }
+
+    nG_CountAlloc(tag, e.site, Long(size), 1);
+    return p;
+}
+
+void* n_TrackedCalloc(size_t n, size_t size, int tag, const char* file, int line)
+{
+    void* p = calloc(n, size);
+
+    if (!p) {
+        return NULL;
+    }
+
+    SDL_AtomicLock(&nG_AllocLock);
+    p = nG_TrackAlloc(p, n * size, nG_ClampTag(tag), file, line);
+    SDL_AtomicUnlock(&nG_AllocLock);
+
+    return p;
+}
+
+void n_TrackedFree(void* p)
+{
+    nG_AllocEntry e;
+
+    if (!p) {
+        return;
+    }
+
+    SDL_AtomicLock(&nG_AllocLock);
+    if (nG_TakeAllocEntry(p, &e)) {
+        nG_CountAlloc(e.tag, e.site, -Long(e.size), -1);
+    }
+    SDL_AtomicUnlock(&nG_AllocLock);
+
+    free(p);
+}
+
+void* n_TrackedRealloc(void* p, size_t size, int tag, const char* file, int line)
+{
+    nG_AllocEntry e;
+
+    if (!p) {
+        p = malloc(size);
+
+        if (p) {
+            SDL_AtomicLock(&nG_AllocLock);
+            p = nG_TrackAlloc(p, size, nG_ClampTag(tag), file, line);
+            SDL_AtomicUnlock(&nG_AllocLock);
+        }
+
+        return p;
+    }
+
+    // taken out first: once realloc() frees the old block, another
+    // thread may be given its address
+    SDL_AtomicLock(&nG_AllocLock);
+    bool tracked = nG_TakeAllocEntry(p, &e);
+    SDL_AtomicUnlock(&nG_AllocLock);
+
+    void* np = realloc(p, size);
+
+    if (!tracked) {
+        // not n_New()'s: stays untracked
+        return np;
+    }
+
+    SDL_AtomicLock(&nG_AllocLock);
+    if (!np) {
+        // the old block is still there
+        if (!nG_AddAllocEntry(&e)) {
+            nG_CountAlloc(e.tag, e.site, -Long(e.size), -1);
+        }
+        SDL_AtomicUnlock(&nG_AllocLock);
+        return NULL;
+    }
+
+    long old = Long(e.size);
+
+    e.ptr  = np;
+    e.size = size;
+    if (nG_AddAllocEntry(&e)) {
+        nG_CountAlloc(e.tag, e.site, Long(size) - old, 0);
+        nG_FrameAllocs++;
+    } else {
+        // no room to keep tracking it: uncounted from here on
+        nG_CountAlloc(e.tag, e.site, -old, -1);
+    }
+    SDL_AtomicUnlock(&nG_AllocLock);
+
+    return np;
+}
+
+
+// ========================================================
+//
+// RANDOM
+//
+// ========================================================
+
+
+#if !defined(nG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+    #include <emmintrin.h>
+    #define nG_SIMD_SSE2 1
+#endif // !nG_NO_SIMD && __SSE2__
+
+
+static inline uint64_t nG_Rotl64(uint64_t x, int k)
+{
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint32_t nG_Rotl32(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+static inline uint64_t nG_SplitMix64(uint64_t* x)
+{
+    uint64_t z = (*x += UInt64(0x9E3779B97F4A7C15));
+
+    z = (z ^ (z >> 30)) * UInt64(0xBF58476D1CE4E5B9);
+    z = (z ^ (z >> 27)) * UInt64(0x94D049BB133111EB);
+    return z ^ (z >> 31);
+}
+
+
+void n_SeedRng(n_Rng* rng, uint64_t seed, uint64_t stream)
+{
+    // the stream is hashed on its own first, so that neighbouring
+    // seeds and streams don't start splitmix64 on the same sequence
+    uint64_t h = stream;
+    uint64_t x = seed ^ nG_SplitMix64(&h);
+
+    for (int i = 0; i < 4; i++) {
+        rng->s[i] = nG_SplitMix64(&x);
+    }
+}
+
+void n_JumpRng(n_Rng* rng)
+{
+    static const uint64_t Jump[4] = {
+        UInt64(0x180EC6D33CFD0ABA), UInt64(0xD5A61266F0C9392C),
+        UInt64(0xA9582618E03FC9AA), UInt64(0x39ABDC4529B1661C)
+    };
+
+    uint64_t s[4] = { 0 };
+
+    for (int i = 0; i < 4; i++) {
+        for (int b = 0; b < 64; b++) {
+            if (Jump[i] & (UInt64(1) << b)) {
+                s[0] ^= rng->s[0];
+                s[1] ^= rng->s[1];
+                s[2] ^= rng->s[2];
+                s[3] ^= rng->s[3];
+            }
+            n_RandomU64(rng);
+        }
+    }
+
+    memcpy(rng->s, s, sizeof(s));
+}
+
+uint64_t n_RandomU64(n_Rng* rng)
+{
+    uint64_t* s = rng->s;
+    uint64_t  r = nG_Rotl64(s[1] * 5, 7) * 9;
+    uint64_t  t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3]  = nG_Rotl64(s[3], 45);
+
+    return r;
+}
+
+uint32_t n_RandomU32(n_Rng* rng)
+{
+    return UInt32(n_RandomU64(rng) >> 32);
+}
+
+float n_RandomFloat(n_Rng* rng)
+{
+    // the 24 high bits, as many as a float holds
+    return Float(n_RandomU64(rng) >> 40) * 0x1.0p-24f;
+}
+
+float n_RandomFloatRange(n_Rng* rng, float lo, float hi)
+{
+    return lo + (hi - lo) * n_RandomFloat(rng);
+}
+
+uint32_t n_RandomBelow(n_Rng* rng, uint32_t bound)
+{
+    // Lemire's multiply and shift, retrying the few low products that
+    // would make some results more likely
+    uint64_t m = UInt64(n_RandomU32(rng)) * bound;
+
+    if (UInt32(m) < bound) {
+        uint32_t threshold = -bound % bound;
+
+        while (UInt32(m) < threshold) {
+            m = UInt64(n_RandomU32(rng)) * bound;
+        }
+    }
+
+    return UInt32(m >> 32);
+}
+
+int n_RandomRange(n_Rng* rng, int lo, int hi)
+{
+    if (hi < lo) {
+        int t = lo;
+        lo = hi;
+        hi = t;
+    }
+
+    uint32_t span = UInt32(hi) - UInt32(lo) + 1;
+
+    if (span == 0) {
+        return Int(n_RandomU32(rng));
+    }
+
+    return Int(UInt32(lo) + n_RandomBelow(rng, span));
+}
+
+
+// The bulk fills run 4 xoshiro128** generators side by side, kept as
+// s[word][lane] so that each word is one SSE2 register. Multiplying by
+// 5 and 9 is done with shifts, which SSE2 has for 32 bit lanes.
+static void nG_SeedRngLanes(n_Rng* rng, uint32_t s[4][4])
+{
+    for (int w = 0; w < 4; w++) {
+        uint64_t a = n_RandomU64(rng);
+        uint64_t b = n_RandomU64(rng);
+
+        s[w][0] = UInt32(a);
+        s[w][1] = UInt32(a >> 32);
+        s[w][2] = UInt32(b);
+        s[w][3] = UInt32(b >> 32);
+    }
+}
+
+static inline void nG_NextRngLanes(uint32_t s[4][4], uint32_t out[4])
+{
+    for (int l = 0; l < 4; l++) {
+        uint32_t x = s[1][l] * 5;
+        uint32_t t = s[1][l] << 9;
+
+        out[l] = nG_Rotl32(x, 7) * 9;
+
+        s[2][l] ^= s[0][l];
+        s[3][l] ^= s[1][l];
+        s[1][l] ^= s[2][l];
+        s[0][l] ^= s[3][l];
+        s[2][l] ^= t;
+        s[3][l]  = nG_Rotl32(s[3][l], 11);
+    }
+}
+
+
+#ifdef nG_SIMD_SSE2
+
+typedef struct {
+    __m128i s0, s1, s2, s3;
+} nG_RngLanesx4;
+
+static inline __m128i nG_Rotl32x4(__m128i x, int k)
+{
+    return _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - k));
+}
+
+static inline __m128i nG_NextRngLanesx4(nG_RngLanesx4* g)
+{
+    __m128i x = _mm_add_epi32(_mm_slli_epi32(g->s1, 2), g->s1);
+    __m128i y = nG_Rotl32x4(x, 7);
+    __m128i r = _mm_add_epi32(_mm_slli_epi32(y, 3), y);
+    __m128i t = _mm_slli_epi32(g->s1, 9);
+
+    g->s2 = _mm_xor_si128(g->s2, g->s0);
+    g->s3 = _mm_xor_si128(g->s3, g->s1);
+    g->s1 = _mm_xor_si128(g->s1, g->s2);
+    g->s0 = _mm_xor_si128(g->s0, g->s3);
+    g->s2 = _mm_xor_si128(g->s2, t);
+    g->s3 = nG_Rotl32x4(g->s3, 11);
+
+    return r;
+}
+
+static inline void nG_LoadRngLanes(nG_RngLanesx4* g, uint32_t s[4][4])
+{
+    g->s0 = _mm_loadu_si128((const __m128i*) s[0]);
+    g->s1 = _mm_loadu_si128((const __m128i*) s[1]);
+    g->s2 = _mm_loadu_si128((const __m128i*) s[2]);
+    g->s3 = _mm_loadu_si128((const __m128i*) s[3]);
+}
+
+static inline void nG_StoreRngLanes(const nG_RngLanesx4* g, uint32_t s[4][4])
+{
+    _mm_storeu_si128((__m128i*) s[0], g->s0);
+    _mm_storeu_si128((__m128i*) s[1], g->s1);
+    _mm_storeu_si128((__m128i*) s[2], g->s2);
+    _mm_storeu_si128((__m128i*) s[3], g->s3);
+}
+
+#endif // nG_SIMD_SSE2
+
+
+void n_FillRandomU32(n_Rng* rng, uint32_t* out, uint32_t n)
+{
+    uint32_t s[4][4];
+    uint32_t i = 0;
+
+    nG_SeedRngLanes(rng, s);
+
+#ifdef nG_SIMD_SSE2
+    nG_RngLanesx4 g;
+
+    nG_LoadRngLanes(&g, s);
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_si128((__m128i*) (out + i), nG_NextRngLanesx4(&g));
+    }
+    nG_StoreRngLanes(&g, s);
+#endif // nG_SIMD_SSE2
+
+    for (; i < n; i += 4) {
+        uint32_t r[4];
+
+        nG_NextRngLanes(s, r);
+        for (uint32_t l = 0; l < 4 && i + l < n; l++) {
+            out[i + l] = r[l];
+        }
+    }
+}
+
+void n_FillRandomFloats(n_Rng* rng, float* out, uint32_t n, float lo, float hi)
+{
+    uint32_t s[4][4];
+    uint32_t i     = 0;
+    float    scale = (hi - lo) * 0x1.0p-24f;
+
+    nG_SeedRngLanes(rng, s);
+
+#ifdef nG_SIMD_SSE2
+    nG_RngLanesx4 g;
+    __m128        vlo    = _mm_set1_ps(lo);
+    __m128        vscale = _mm_set1_ps(scale);
+
+    nG_LoadRngLanes(&g, s);
+    for (; i + 4 <= n; i += 4) {
+        // 24 bits convert exactly, and fit the signed conversion
+        __m128 u = _mm_cvtepi32_ps(_mm_srli_epi32(nG_NextRngLanesx4(&g), 8));
+        _mm_storeu_ps(out + i, _mm_add_ps(vlo, _mm_mul_ps(u, vscale)));
+    }
+    nG_StoreRngLanes(&g, s);
+#endif // nG_SIMD_SSE2
+
+    for (; i < n; i += 4) {
+        uint32_t r[4];
+
+        nG_NextRngLanes(s, r);
+        for (uint32_t l = 0; l < 4 && i + l < n; l++) {
+            out[i + l] = lo + Float(r[l] >> 8) * scale;
+        }
+    }
+}
+
+
+// ========================================================
+//
+// RASTER
+//
+// ========================================================
+
+
+// With the raster backend the draw functions record commands (in
+// screen pixels) instead of calling SDL. n_Present() bins them into
+// tiles and the tiles are rasterized in parallel, straight into a
+// streaming texture, which is then copied to the window.
+
+
+#if !defined(nG_NO_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #include <immintrin.h>
+    #define nG_SIMD_AVX2 1
+#endif // !nG_NO_SIMD && __GNUC__ && x86
+
+
+enum {
+    nG_RasterCmd_Fill,
+    nG_RasterCmd_Copy,
+    nG_RasterCmd_CopyRotated
+};
+
+
+typedef struct {
+    SDL_Texture* tex;
+    uint32_t*    pixels;
+    int          w;
+    int          h;
+    bool         blend;
+} nG_RasterImage;
+
+// Copies keep the texture (img.tex) and only look the rest of its
+// image up in n_Present(): the texture may be deleted in between.
+typedef struct {
+    nG_RasterImage img;
+    SDL_Rect       dst;
+    SDL_Rect       src;
+    SDL_Rect       bounds;
+    SDL_Rect       clip;
+    uint32_t       color;
+    float          angle;
+    uint8_t        type;
+    uint8_t        flip;
+    bool           blend;
+} nG_RasterCmd;
+
+typedef struct {
+    uint32_t*     fb;
+    int           pitch;
+    int           w;
+    int           h;
+    int           cols;
+    int           rows;
+    SDL_atomic_t  next;
+} nG_RasterFrame;
+
+
+static SDL_Texture*    nG_RasterTarget  = NULL;
+static nG_RasterCmd*   nG_RasterCmds    = NULL;
+static uint32_t        nG_RasterCount   = 0;
+static uint32_t        nG_RasterCap     = 0;
+static uint32_t*       nG_RasterBins    = NULL;
+static uint32_t        nG_RasterBinCap  = 0;
+static uint32_t*       nG_RasterTileEnd = NULL;
+static uint32_t        nG_RasterTileCap = 0;
+static nG_RasterFrame  nG_RasterJob;
+
+// Shared by the contexts: only the raster context adds images, but
+// n_DeleteTexture() looks every texture up, on whichever thread deletes
+// it. Images are copied out of it under the lock.
+static nG_RasterImage* nG_RasterImages    = NULL;
+static uint32_t        nG_RasterImageCap  = 0;
+static uint32_t        nG_RasterImageLen  = 0;
+static SDL_SpinLock    nG_RasterImageLock = 0;
+
+static SDL_Thread**    nG_RasterThreads  = NULL;
+static int             nG_RasterNThreads = 0;
+static SDL_sem*        nG_RasterStart    = NULL;
+static SDL_sem*        nG_RasterDone     = NULL;
+static bool            nG_RasterExit     = false;
+
+#ifdef nG_SIMD_AVX2
+static bool            nG_RasterHasAVX2  = false;
+#endif // nG_SIMD_AVX2
+
+
+// x * y / 255, rounded
+static inline uint32_t nG_MulDiv255(uint32_t x, uint32_t y)
+{
+    uint32_t t = x * y + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static inline uint32_t nG_ModulatePixel(uint32_t s, uint32_t mod)
+{
+    return (nG_MulDiv255(s >> 24, mod >> 24) << 24)
+        | (nG_MulDiv255((s >> 16) & 0xFF, (mod >> 16) & 0xFF) << 16)
+        | (nG_MulDiv255((s >> 8) & 0xFF, (mod >> 8) & 0xFF) << 8)
+        | nG_MulDiv255(s & 0xFF, mod & 0xFF);
+}
+
+// Source-over, like SDL_BLENDMODE_BLEND:
+// dstRGB = srcRGB * srcA + dstRGB * (1 - srcA)
+// dstA   = srcA + dstA * (1 - srcA)
+static inline uint32_t nG_BlendPixel(uint32_t s, uint32_t d)
+{
+    uint32_t a  = s >> 24;
+    uint32_t ia = 255 - a;
+
+    if (a == 0xFF) {
+        return s;
+    }
+
+    return ((nG_MulDiv255(0xFF, a) + nG_MulDiv255(d >> 24, ia)) << 24)
+        | ((nG_MulDiv255((s >> 16) & 0xFF, a) + nG_MulDiv255((d >> 16) & 0xFF, ia)) << 16)
+        | ((nG_MulDiv255((s >> 8) & 0xFF, a) + nG_MulDiv255((d >> 8) & 0xFF, ia)) << 8)
+        | (nG_MulDiv255(s & 0xFF, a) + nG_MulDiv255(d & 0xFF, ia));
+}
+
+
+// Scales one row: dst[i] = src[(u + i * du) >> 16], modulated by <mod>
+// and blended when <blend> is set.
+static void nG_RasterRow(
+    uint32_t *restrict       dst,
+    const uint32_t *restrict src,
+    int      n,
+    int32_t  u,
+    int32_t  du,
+    uint32_t mod,
+    bool     blend
+) {
+    for (int i = 0; i < n; i++, u += du) {
+        uint32_t s = src[u >> 16];
+
+        if (mod != 0xFFFFFFFF) {
+            s = nG_ModulatePixel(s, mod);
+        }
+
+        dst[i] = blend ? nG_BlendPixel(s, dst[i]) : s;
+    }
+}
+
+static void nG_RasterFillRow(uint32_t *restrict dst, int n, uint32_t color, bool blend)
+{
+    if (!blend || (color >> 24) == 0xFF) {
+        for (int i = 0; i < n; i++) {
+            dst[i] = color;
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            dst[i] = nG_BlendPixel(color, dst[i]);
+        }
+    }
+}
+
+
+#ifdef nG_SIMD_AVX2
+
+// Same arithmetic as nG_MulDiv255(), on 16 bit lanes.
+__attribute__((target("avx2")))
+static inline __m256i nG_MulDiv255x16(__m256i x, __m256i y)
+{
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(x, y), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+// Blends 4 pixels per 128 bit lane, already widened to 16 bits.
+__attribute__((target("avx2")))
+static inline __m256i nG_BlendPixelsx16(__m256i s, __m256i d)
+{
+    __m256i ff = _mm256_set1_epi16(0xFF);
+    __m256i a  = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i ia = _mm256_sub_epi16(ff, a);
+
+    // the alpha channel is scaled by 1 instead of srcA
+    a = _mm256_blend_epi16(a, ff, 0x88);
+
+    return _mm256_add_epi16(nG_MulDiv255x16(s, a), nG_MulDiv255x16(d, ia));
+}
+
+__attribute__((target("avx2")))
+static void nG_RasterRowAVX2(
+    uint32_t *restrict       dst,
+    const uint32_t *restrict src,
+    int      n,
+    int32_t  u,
+    int32_t  du,
+    uint32_t mod,
+    bool     blend
+) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i vmod = _mm256_unpacklo_epi8(_mm256_set1_epi32(Int32(mod)), zero);
+    const __m256i step = _mm256_set1_epi32(du * 8);
+    __m256i       vu   = _mm256_add_epi32(
+        _mm256_set1_epi32(u),
+        _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(du))
+    );
+    int i = 0;
+
+    for (; i + 8 <= n; i += 8) {
+        __m256i idx = _mm256_srai_epi32(vu, 16);
+        __m256i s   = _mm256_i32gather_epi32((const int*) src, idx, 4);
+        __m256i slo = _mm256_unpacklo_epi8(s, zero);
+        __m256i shi = _mm256_unpackhi_epi8(s, zero);
+
+        if (mod != 0xFFFFFFFF) {
+            slo = nG_MulDiv255x16(slo, vmod);
+            shi = nG_MulDiv255x16(shi, vmod);
+        }
+
+        if (blend) {
+            __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+
+            slo = nG_BlendPixelsx16(slo, _mm256_unpacklo_epi8(d, zero));
+            shi = nG_BlendPixelsx16(shi, _mm256_unpackhi_epi8(d, zero));
+        }
+
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_packus_epi16(slo, shi));
+        vu = _mm256_add_epi32(vu, step);
+    }
+
+    nG_RasterRow(dst + i, src, n - i, u + i * du, du, mod, blend);
+}
+
+#endif // nG_SIMD_AVX2
+
+
+static void nG_RasterCopy(
+    const nG_RasterCmd *restrict cmd,
+    const SDL_Rect *restrict     clip,
+    uint32_t* fb,
+    int       pitch
+) {
+    const nG_RasterImage* img = &cmd->img;
+    SDL_Rect              r;
+
+    if (!SDL_IntersectRect(&cmd->dst, clip, &r)) {
+        return;
+    }
+
+    // 16.16 fixed point steps, sampling at pixel centers
+    int32_t du = Int32((Int64(cmd->src.w) << 16) / cmd->dst.w);
+    int32_t dv = Int32((Int64(cmd->src.h) << 16) / cmd->dst.h);
+    int32_t u0 = Int32((r.x - cmd->dst.x) * Int64(du) + du / 2);
+    bool    fx = cmd->flip & SDL_FLIP_HORIZONTAL;
+    bool    fy = cmd->flip & SDL_FLIP_VERTICAL;
+
+    if (fx) {
+        u0 = (cmd->src.w << 16) - 1 - u0;
+        du = -du;
+    }
+
+    for (int y = r.y; y < r.y + r.h; y++) {
+        int32_t v  = Int32((y - cmd->dst.y) * Int64(dv) + dv / 2) >> 16;
+        int     sy = cmd->src.y + (fy ? cmd->src.h - 1 - v : v);
+
+        const uint32_t* row = img->pixels + sy * img->w + cmd->src.x;
+        uint32_t*       out = fb + y * pitch + r.x;
+
+#ifdef nG_SIMD_AVX2
+        if (nG_RasterHasAVX2) {
+            nG_RasterRowAVX2(out, row, r.w, u0, du, cmd->color, cmd->blend);
+            continue;
+        }
+#endif // nG_SIMD_AVX2
+
+        nG_RasterRow(out, row, r.w, u0, du, cmd->color, cmd->blend);
+    }
+}
+
+// Rotations are done like SDL_RenderCopyEx(): clockwise, around the
+// center of the destination, mapping every covered pixel back to the
+// source.
+static void nG_RasterCopyRotated(
+    const nG_RasterCmd *restrict cmd,
+    const SDL_Rect *restrict     clip,
+    uint32_t* fb,
+    int       pitch
+) {
+    const nG_RasterImage* img = &cmd->img;
+    SDL_Rect              r;
+
+    if (!SDL_IntersectRect(&cmd->bounds, clip, &r)) {
+        return;
+    }
+
+    float rad = cmd->angle * Float(M_PI) / 180.0f;
+    float c   = cosf(rad);
+    float s   = sinf(rad);
+    float hw  = 0.5f * cmd->dst.w;
+    float hh  = 0.5f * cmd->dst.h;
+    float cx  = cmd->dst.x + hw;
+    float cy  = cmd->dst.y + hh;
+    float kx  = Float(cmd->src.w) / cmd->dst.w;
+    float ky  = Float(cmd->src.h) / cmd->dst.h;
+
+    for (int y = r.y; y < r.y + r.h; y++) {
+        uint32_t* out = fb + y * pitch;
+        float     vy  = y + 0.5f - cy;
+
+        for (int x = r.x; x < r.x + r.w; x++) {
+            float vx = x + 0.5f - cx;
+            float lx =  c * vx + s * vy + hw;
+            float ly = -s * vx + c * vy + hh;
+
+            if (lx < 0.0f || ly < 0.0f || lx >= cmd->dst.w || ly >= cmd->dst.h) {
+                continue;
+            }
+
+            int u = Int(lx * kx);
+            int v = Int(ly * ky);
+
+            if (cmd->flip & SDL_FLIP_HORIZONTAL) {
+                u = cmd->src.w - 1 - u;
+            }
+            if (cmd->flip & SDL_FLIP_VERTICAL) {
+                v = cmd->src.h - 1 - v;
+            }
+
+            uint32_t p = img->pixels[(cmd->src.y + v) * img->w + cmd->src.x + u];
+
+            if (cmd->color != 0xFFFFFFFF) {
+                p = nG_ModulatePixel(p, cmd->color);
+            }
+
+            out[x] = cmd->blend ? nG_BlendPixel(p, out[x]) : p;
+        }
+    }
+}
+
+static void nG_RasterTile(int tile)
+{
+    nG_RasterFrame* job    = &nG_RasterJob;
+    int             tx     = tile % job->cols;
+    int             ty     = tile / job->cols;
+    SDL_Rect        screen = SDL_Rect(.w = job->w, .h = job->h);
+    uint32_t        begin  = tile > 0 ? nG_RasterTileEnd[tile - 1] : 0;
+    uint32_t        end    = nG_RasterTileEnd[tile];
+    SDL_Rect        clip   = SDL_Rect(
+        .x = tx * nG_RASTER_TILE,
+        .y = ty * nG_RASTER_TILE,
+        .w = nG_RASTER_TILE,
+        .h = nG_RASTER_TILE
+    );
+
+    SDL_IntersectRect(&clip, &screen, &clip);
+
+    for (uint32_t b = begin; b < end; b++) {
+        const nG_RasterCmd* cmd = &nG_RasterCmds[nG_RasterBins[b]];
+        SDL_Rect            c   = clip;
+        SDL_Rect            r;
+
+        if (cmd->clip.w > 0 && !SDL_IntersectRect(&clip, &cmd->clip, &c)) {
+            continue;
+        }
+
+        switch (cmd->type) {
+        case nG_RasterCmd_Fill:
+            if (SDL_IntersectRect(&cmd->dst, &c, &r)) {
+                for (int y = r.y; y < r.y + r.h; y++) {
+                    nG_RasterFillRow(job->fb + y * job->pitch + r.x, r.w, cmd->color, cmd->blend);
+                }
+            }
+            break;
+        case nG_RasterCmd_Copy:
+            nG_RasterCopy(cmd, &c, job->fb, job->pitch);
+            break;
+        case nG_RasterCmd_CopyRotated:
+            nG_RasterCopyRotated(cmd, &c, job->fb, job->pitch);
+            break;
+        }
+    }
+}
+
+static void nG_RasterTiles(void)
+{
+    int n = nG_RasterJob.cols * nG_RasterJob.rows;
+    int t;
+
+    while ((t = SDL_AtomicAdd(&nG_RasterJob.next, 1)) < n) {
+        nG_RasterTile(t);
+    }
+}
+
+static int nG_RasterWorker(void* data)
+{
+    for (;;) {
+        SDL_SemWait(nG_RasterStart);
+
+        if (nG_RasterExit) {
+            break;
+        }
+
+        nG_RasterTiles();
+        SDL_SemPost(nG_RasterDone);
+    }
+
+    return 0;
+}
+
+static nG_RasterCmd* nG_PushRasterCmd(void)
+{
+    if (nG_RasterCount == nG_RasterCap) {
+        uint32_t      cap  = nG_RasterCap ? 2 * nG_RasterCap : 1024;
+        nG_RasterCmd* cmds = n_ResizeTagged(nG_RasterCmds, nG_RasterCmd, cap, n_AllocTag_Engine);
+
+        if (!cmds) {
+            n_LogErrorf("Unable to grow the raster command list.\n");
+            return NULL;
+        }
+
+        nG_RasterCmds = cmds;
+        nG_RasterCap  = cap;
+    }
+
+    nG_RasterCmds[nG_RasterCount].clip = nG_ViewClip;
+    return &nG_RasterCmds[nG_RasterCount++];
+}
+
+static inline uint32_t nG_HashPtr(const void* p, uint32_t cap)
+{
+    uint64_t h = UInt64((uintptr_t) p) * UINT64_C(0x9E3779B97F4A7C15);
+    return UInt32(h >> 32) & (cap - 1);
+}
+
+// Call with nG_RasterImageLock held.
+static const nG_RasterImage* nG_FindRasterImage(const SDL_Texture* tex)
+{
+    if (!nG_RasterImages || !tex) {
+        return NULL;
+    }
+
+    for (uint32_t i = nG_HashPtr(tex, nG_RasterImageCap);; i = (i + 1) & (nG_RasterImageCap - 1)) {
+        if (nG_RasterImages[i].tex == tex) {
+            return &nG_RasterImages[i];
+        }
+        if (!nG_RasterImages[i].tex) {
+            return NULL;
+        }
+    }
+}
+
+// Copies the image of <tex> into <img>.
+static bool nG_GetRasterImage(const SDL_Texture* tex, nG_RasterImage* img)
+{
+    SDL_AtomicLock(&nG_RasterImageLock);
+
+    const nG_RasterImage* found = nG_FindRasterImage(tex);
+
+    if (found) {
+        *img = *found;
+    }
+
+    SDL_AtomicUnlock(&nG_RasterImageLock);
+    return found != NULL;
+}
+
+// Call with nG_RasterImageLock held.
+static bool nG_InsertRasterImage(nG_RasterImage img)
+{
+    if (2 * (nG_RasterImageLen + 1) > nG_RasterImageCap) {
+        uint32_t        cap  = nG_RasterImageCap ? 2 * nG_RasterImageCap : 64;
+        nG_RasterImage* imgs = n_NewTagged(nG_RasterImage, cap, n_AllocTag_Engine);
+
+        if (!imgs) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < nG_RasterImageCap; i++) {
+            if (nG_RasterImages[i].tex) {
+                uint32_t j = nG_HashPtr(nG_RasterImages[i].tex, cap);
+
+                while (imgs[j].tex) {
+                    j = (j + 1) & (cap - 1);
+                }
+                imgs[j] = nG_RasterImages[i];
+            }
+        }
+
+        n_Delete(nG_RasterImages);
+        nG_RasterImages   = imgs;
+        nG_RasterImageCap = cap;
+    }
+
+    uint32_t i = nG_HashPtr(img.tex, nG_RasterImageCap);
+
+    while (nG_RasterImages[i].tex) {
+        i = (i + 1) & (nG_RasterImageCap - 1);
+    }
+
+    nG_RasterImages[i] = img;
+    nG_RasterImageLen++;
+    return true;
+}
+
+// Keeps a copy of the surface's pixels (as ARGB8888) for <tex>.
+static void nG_AddRasterImage(SDL_Texture* tex, SDL_Surface* s)
+{
+    if (nG_Backend != n_RenderBackend_Raster || !tex || !s) {
+        return;
+    }
+
+    SDL_Surface* argb = SDL_ConvertSurfaceFormat(s, SDL_PIXELFORMAT_ARGB8888, 0);
+
+    if (!argb) {
+        n_LogErrorf("Unable to convert the surface for the raster backend: %s\n", SDL_GetError());
+        return;
+    }
+
+    nG_RasterImage img = {
+        .tex    = tex,
+        .pixels = n_NewTagged(uint32_t, argb->w * argb->h, n_AllocTag_Textures),
+        .w      = argb->w,
+        .h      = argb->h,
+        .blend  = true
+    };
+
+    if (img.pixels) {
+        SDL_BlendMode mode;
+
+        SDL_LockSurface(argb);
+        for (int y = 0; y < argb->h; y++) {
+            memcpy(
+                img.pixels + y * argb->w,
+                (uint8_t*) argb->pixels + y * argb->pitch,
+                argb->w * sizeof(uint32_t)
+            );
+        }
+        SDL_UnlockSurface(argb);
+
+        if (SDL_GetTextureBlendMode(tex, &mode) == 0) {
+            img.blend = mode == SDL_BLENDMODE_BLEND;
+        }
+
+        SDL_AtomicLock(&nG_RasterImageLock);
+        bool inserted = nG_InsertRasterImage(img);
+        SDL_AtomicUnlock(&nG_RasterImageLock);
+
+        if (!inserted) {
+            n_Delete(img.pixels);
+        }
+    }
+
+    SDL_FreeSurface(argb);
+}
+
+static void nG_RemoveRasterImage(const SDL_Texture* tex)
+{
+    SDL_AtomicLock(&nG_RasterImageLock);
+
+    nG_RasterImage* img = Ptr(nG_FindRasterImage(tex));
+
+    if (!img) {
+        SDL_AtomicUnlock(&nG_RasterImageLock);
+        return;
+    }
+
+    uint32_t* pixels = img->pixels;
+
+    img->tex = NULL;
+    nG_RasterImageLen--;
+
+    // re-insert the rest of the cluster (linear probing)
+    uint32_t mask = nG_RasterImageCap - 1;
+    uint32_t i    = Int(img - nG_RasterImages);
+
+    for (i = (i + 1) & mask; nG_RasterImages[i].tex; i = (i + 1) & mask) {
+        nG_RasterImage moved = nG_RasterImages[i];
+
+        nG_RasterImages[i].tex = NULL;
+        nG_RasterImageLen--;
+        nG_InsertRasterImage(moved);
+    }
+
+    SDL_AtomicUnlock(&nG_RasterImageLock);
+    n_Delete(pixels);
+}
+
+static void nG_RasterFill(const SDL_Rect *restrict r, uint32_t color, bool blend)
+{
+    nG_RasterCmd* cmd = nG_PushRasterCmd();
+
+    if (cmd) {
+        cmd->type   = nG_RasterCmd_Fill;
+        cmd->dst    = *r;
+        cmd->bounds = *r;
+        cmd->color  = color;
+        cmd->blend  = blend;
+    }
+}
+
+static void nG_RasterTexture(
+    SDL_Texture*             tex,
+    const SDL_Rect *restrict src,
+    const SDL_Rect *restrict dst,
+    float            angle,
+    SDL_RendererFlip flip,
+    uint32_t         mod
+) {
+    static bool warned = false;
+
+    nG_RasterImage img;
+
+    if (!nG_GetRasterImage(tex, &img)) {
+        if (!warned) {
+            n_LogWarnf("The raster backend only draws textures from n_LoadTexture().\n");
+            warned = true;
+        }
+        return;
+    }
+
+    SDL_Rect s = src ? *src : SDL_Rect(.w = img.w, .h = img.h);
+    SDL_Rect full = SDL_Rect(.w = img.w, .h = img.h);
+
+    if (!SDL_IntersectRect(&s, &full, &s) || dst->w <= 0 || dst->h <= 0) {
+        return;
+    }
+
+    nG_RasterCmd* cmd = nG_PushRasterCmd();
+
+    if (!cmd) {
+        return;
+    }
+
+    cmd->type    = nG_RasterCmd_Copy;
+    cmd->img.tex = tex;
+    cmd->src     = s;
+    cmd->dst    = *dst;
+    cmd->bounds = *dst;
+    cmd->angle  = angle;
+    cmd->flip   = UInt8(flip);
+    cmd->color  = mod;
+    cmd->blend  = img.blend;
+
+    if (fmodf(angle, 360.0f) != 0.0f) {
+        float rad = angle * Float(M_PI) / 180.0f;
+        float hw  = 0.5f * (fabsf(dst->w * cosf(rad)) + fabsf(dst->h * sinf(rad)));
+        float hh  = 0.5f * (fabsf(dst->w * sinf(rad)) + fabsf(dst->h * cosf(rad)));
+        float cx  = dst->x + 0.5f * dst->w;
+        float cy  = dst->y + 0.5f * dst->h;
+
+        cmd->type   = nG_RasterCmd_CopyRotated;
+        cmd->bounds = SDL_Rect(
+            .x = Int(floorf(cx - hw)),
+            .y = Int(floorf(cy - hh)),
+            .w = Int(ceilf(2.0f * hw)) + 1,
+            .h = Int(ceilf(2.0f * hh)) + 1
+        );
+    }
+}
+
+// Copies the images into the copies, dropping the ones whose texture
+// was deleted (or replaced by a smaller one) since they were drawn.
+static void nG_ResolveRasterImages(void)
+{
+    for (uint32_t c = 0; c < nG_RasterCount; c++) {
+        nG_RasterCmd* cmd = &nG_RasterCmds[c];
+
+        if (cmd->type == nG_RasterCmd_Fill) {
+            continue;
+        }
+
+        if (!nG_GetRasterImage(cmd->img.tex, &cmd->img)
+            || cmd->src.x + cmd->src.w > cmd->img.w
+            || cmd->src.y + cmd->src.h > cmd->img.h) {
+            cmd->bounds = SDL_Rect();
+        }
+    }
+}
+
+static bool nG_RasterBin(int cols, int rows, int w, int h)
+{
+    uint32_t tiles  = UInt32(cols * rows);
+    uint32_t total  = 0;
+    SDL_Rect screen = SDL_Rect(.w = w, .h = h);
+
+    if (tiles > nG_RasterTileCap) {
+        n_Delete(nG_RasterTileEnd);
+        nG_RasterTileEnd = n_NewTagged(uint32_t, tiles, n_AllocTag_Engine);
+        nG_RasterTileCap = nG_RasterTileEnd ? tiles : 0;
+
+        if (!nG_RasterTileEnd) {
+            return false;
+        }
+    }
+    memset(nG_RasterTileEnd, 0, tiles * sizeof(uint32_t));
+
+    // first pass counts the commands touching each tile, the second
+    // one lists them (in order) after each tile's offset.
+    for (int pass = 0; pass < 2; pass++) {
+        for (uint32_t c = 0; c < nG_RasterCount; c++) {
+            SDL_Rect b;
+
+            if (!SDL_IntersectRect(&nG_RasterCmds[c].bounds, &screen, &b)) {
+                continue;
+            }
+
+            int x0 = b.x / nG_RASTER_TILE;
+            int y0 = b.y / nG_RASTER_TILE;
+            int x1 = (b.x + b.w - 1) / nG_RASTER_TILE;
+            int y1 = (b.y + b.h - 1) / nG_RASTER_TILE;
+
+            for (int ty = y0; ty <= y1; ty++) {
+                for (int tx = x0; tx <= x1; tx++) {
+                    uint32_t t = UInt32(ty * cols + tx);
+
+                    if (pass == 0) {
+                        nG_RasterTileEnd[t]++;
+                    } else {
+                        nG_RasterBins[nG_RasterTileEnd[t]++] = c;
+                    }
+                }
+            }
+        }
+
+        if (pass > 0) {
+            break;
+        }
+
+        for (uint32_t t = 0; t < tiles; t++) {
+            uint32_t n = nG_RasterTileEnd[t];
+
+            nG_RasterTileEnd[t] = total;
+            total += n;
+        }
+
+        if (total > nG_RasterBinCap) {
+            n_Delete(nG_RasterBins);
+            nG_RasterBins   = n_NewTagged(uint32_t, total, n_AllocTag_Engine);
+            nG_RasterBinCap = nG_RasterBins ? total : 0;
+
+            if (!nG_RasterBins) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void nG_RasterPresent(void)
+{
+    int   w, h, pitch;
+    void* pixels;
+
+    nG_GetScreenSize(&w, &h);
+
+    if (nG_RasterJob.w != w || nG_RasterJob.h != h || !nG_RasterTarget) {
+        n_DeleteTexture(&nG_RasterTarget);
+        nG_RasterTarget = SDL_CreateTexture(
+            nG_Renderer,
+            SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING,
+            w,
+            h
+        );
+        if (!nG_RasterTarget) {
+            n_LogErrorf("Unable to create the raster target: %s\n", SDL_GetError());
+            nG_RasterCount = 0;
+            return;
+        }
+        nG_TrackTexture(nG_RasterTarget);
+    }
+
+    if (SDL_LockTexture(nG_RasterTarget, NULL, &pixels, &pitch) < 0) {
+        n_LogErrorf("Unable to lock the raster target: %s\n", SDL_GetError());
+        nG_RasterCount = 0;
+        return;
+    }
+
+    nG_RasterJob.fb    = pixels;
+    nG_RasterJob.pitch = pitch / Int(sizeof(uint32_t));
+    nG_RasterJob.w     = w;
+    nG_RasterJob.h     = h;
+    nG_RasterJob.cols  = (w + nG_RASTER_TILE - 1) / nG_RASTER_TILE;
+    nG_RasterJob.rows  = (h + nG_RASTER_TILE - 1) / nG_RASTER_TILE;
+
+    nG_ResolveRasterImages();
+
+    if (nG_RasterBin(nG_RasterJob.cols, nG_RasterJob.rows, w, h)) {
+        SDL_AtomicSet(&nG_RasterJob.next, 0);
+
+        for (int i = 0; i < nG_RasterNThreads; i++) {
+            SDL_SemPost(nG_RasterStart);
+        }
+
+        // the main thread rasterizes tiles as well
+        nG_RasterTiles();
+
+        for (int i = 0; i < nG_RasterNThreads; i++) {
+            SDL_SemWait(nG_RasterDone);
+        }
+    } else {
+        n_LogErrorf("Unable to bin the raster commands.\n");
+    }
+
+    SDL_UnlockTexture(nG_RasterTarget);
+    SDL_RenderCopy(nG_Renderer, nG_RasterTarget, NULL, NULL);
+
+    nG_RasterCount = 0;
+}
+
+static bool nG_InitRaster(void)
+{
+    int threads = nG_RASTER_THREADS > 0 ? nG_RASTER_THREADS : SDL_GetCPUCount();
+
+#ifdef nG_SIMD_AVX2
+    nG_RasterHasAVX2 = SDL_HasAVX2();
+#endif // nG_SIMD_AVX2
+
+    nG_RasterExit  = false;
+    nG_RasterStart = SDL_CreateSemaphore(0);
+    nG_RasterDone  = SDL_CreateSemaphore(0);
+
+    if (!nG_RasterStart || !nG_RasterDone) {
+        n_LogErrorf("Unable to create the raster semaphores: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if (threads > 1) {
+        nG_RasterThreads = n_NewTagged(SDL_Thread*, threads - 1, n_AllocTag_Engine);
+    }
+
+    for (int i = 0; nG_RasterThreads && i < threads - 1; i++) {
+        SDL_Thread* t = SDL_CreateThread(&nG_RasterWorker, "nolib raster", NULL);
+
+        if (!t) {
+            n_LogErrorf("Unable to create a raster thread: %s\n", SDL_GetError());
+            break;
+        }
+
+        nG_RasterThreads[nG_RasterNThreads++] = t;
+    }
+
+    return true;
+}
+
+static void nG_QuitRaster(void)
+{
+    nG_RasterExit = true;
+
+    for (int i = 0; i < nG_RasterNThreads; i++) {
+        SDL_SemPost(nG_RasterStart);
+    }
+    for (int i = 0; i < nG_RasterNThreads; i++) {
+        SDL_WaitThread(nG_RasterThreads[i], NULL);
+    }
+
+    if (nG_RasterStart) {
+        SDL_DestroySemaphore(nG_RasterStart);
+        nG_RasterStart = NULL;
+    }
+    if (nG_RasterDone) {
+        SDL_DestroySemaphore(nG_RasterDone);
+        nG_RasterDone = NULL;
+    }
+
+    for (uint32_t i = 0; i < nG_RasterImageCap; i++) {
+        n_Delete(nG_RasterImages[i].pixels);
+    }
+
+    n_Delete(nG_RasterThreads);
+    n_Delete(nG_RasterImages);
+    n_Delete(nG_RasterCmds);
+    n_Delete(nG_RasterBins);
+    n_Delete(nG_RasterTileEnd);
+    n_DeleteTexture(&nG_RasterTarget);
+
+    nG_RasterNThreads = 0;
+    nG_RasterImageCap = 0;
+    nG_RasterImageLen = 0;
+    nG_RasterCount    = 0;
+    nG_RasterCap      = 0;
+    nG_RasterBinCap   = 0;
+    nG_RasterTileCap  = 0;
+}
+
+
+static n_RenderBackend nG_InitBackend = nG_RENDER_BACKEND;
+
+void n_SetRenderBackend(n_RenderBackend backend)
+{
+    nG_InitBackend = backend;
+}
+
+n_RenderBackend n_GetRenderBackend(void)
+{
+    return nG_Backend;
+}
+
+
+// ========================================================
+//
+// DIRTY RECTANGLES
+//
+// ========================================================
+
+
+// In dirty-rect mode the draw functions are recorded, each one with
+// a key (a hash of what it draws and where). At n_Present() the draws
+// whose keys appear in only one of the last two frames damage the
+// screen; the damage is merged into at most nG_DIRTY_MAX_REGIONS
+// regions and only the draws touching them are replayed, clipped.
+
+
+enum {
+    nG_DirtyDraw_Fill,
+    nG_DirtyDraw_Outline,
+    nG_DirtyDraw_Copy,
+    nG_DirtyDraw_Geometry
+};
+
+
+typedef struct {
+    SDL_Texture*      tex;
+    const SDL_Vertex* vertices;
+    const int*        indices;
+    SDL_Rect          src;
+    SDL_Rect          dst;
+    SDL_Rect          bounds;
+    SDL_Rect          clip;
+    uint32_t          color;
+    uint32_t          key;
+    float             angle;
+    int               nVertices;
+    int               nIndices;
+    uint8_t           type;
+    uint8_t           flip;
+    bool              hasSrc;
+} nG_DirtyDraw;
+
+typedef struct {
+    nG_DirtyDraw* draws;
+    uint32_t      count;
+    uint32_t      cap;
+} nG_DirtyList;
+
+struct nG_DirtyState {
+    bool         full;
+    nG_DirtyList lists[2];
+    int          curr;
+    uint32_t*    keys;
+    uint32_t     keyCap;
+    uint32_t     bg;
+    SDL_Rect     regions[nG_DIRTY_MAX_REGIONS];
+    int          nRegions;
+};
+
+
+// Only valid in dirty-rect mode (see nG_DirtyEnabled).
+#define nG_DirtyFull     (nG_Ctx->dirty->full)
+#define nG_DirtyLists    (nG_Ctx->dirty->lists)
+#define nG_DirtyCurr     (nG_Ctx->dirty->curr)
+#define nG_DirtyKeys     (nG_Ctx->dirty->keys)
+#define nG_DirtyKeyCap   (nG_Ctx->dirty->keyCap)
+#define nG_DirtyBG       (nG_Ctx->dirty->bg)
+#define nG_DirtyRegions  (nG_Ctx->dirty->regions)
+#define nG_DirtyNRegions (nG_Ctx->dirty->nRegions)
+
+
+static inline bool nG_IsRecording(void)
+{
+    // render layers are drawn right away, into their own texture
+    return nG_DirtyEnabled && nG_TargetHeight == 0;
+}
+
+static nG_DirtyDraw* nG_RecordDraw(uint8_t type)
+{
+    nG_DirtyList* l = &nG_DirtyLists[nG_DirtyCurr];
+
+    if (l->count == l->cap) {
+        uint32_t      cap   = l->cap ? 2 * l->cap : 256;
+        nG_DirtyDraw* draws = n_ResizeTagged(l->draws, nG_DirtyDraw, cap, n_AllocTag_Engine);
+
+        if (!draws) {
+            n_LogErrorf("Unable to grow the dirty-rect draw list.\n");
+            nG_DirtyFull = true;
+            return NULL;
+        }
+
+        l->draws = draws;
+        l->cap   = cap;
+    }
+
+    nG_DirtyDraw* d = &l->draws[l->count++];
+
+    memset(d, 0, sizeof(*d));
+    d->type = type;
+    d->clip = nG_ViewClip;
+    return d;
+}
+
+static void nG_SealDraw(nG_DirtyDraw* d, uint32_t salt)
+{
+    uint32_t h = 2166136261u;
+
+    h = nG_Hash(h, &d->type, sizeof(d->type));
+    h = nG_Hash(h, &d->tex, sizeof(d->tex));
+    h = nG_Hash(h, &d->src, sizeof(d->src));
+    h = nG_Hash(h, &d->dst, sizeof(d->dst));
+    h = nG_Hash(h, &d->color, sizeof(d->color));
+    h = nG_Hash(h, &d->angle, sizeof(d->angle));
+    h = nG_Hash(h, &d->flip, sizeof(d->flip));
+    h = nG_Hash(h, &d->clip, sizeof(d->clip));
+    h = nG_Hash(h, &salt, sizeof(salt));
+
+    if (d->clip.w > 0 && !SDL_IntersectRect(&d->bounds, &d->clip, &d->bounds)) {
+        d->bounds = SDL_Rect();
+    }
+
+    if (d->vertices) {
+        h = nG_Hash(h, d->vertices, d->nVertices * sizeof(SDL_Vertex));
+    }
+
+    d->key = h ? h : 1;
+}
+
+static void nG_DirtyFill(const SDL_Rect *restrict r, uint32_t color, bool outline)
+{
+    nG_DirtyDraw* d = nG_RecordDraw(outline ? nG_DirtyDraw_Outline : nG_DirtyDraw_Fill);
+
+    if (d) {
+        d->dst    = *r;
+        d->bounds = *r;
+        d->color  = color;
+        nG_SealDraw(d, 0);
+    }
+}
+
+static void nG_DirtyCopy(
+    SDL_Texture*             tex,
+    const SDL_Rect *restrict src,
+    const SDL_Rect *restrict dst,
+    float            angle,
+    SDL_RendererFlip flip,
+    uint32_t         salt
+) {
+    nG_DirtyDraw* d = nG_RecordDraw(nG_DirtyDraw_Copy);
+
+    if (!d) {
+        return;
+    }
+
+    d->tex    = tex;
+    d->dst    = *dst;
+    d->bounds = *dst;
+    d->angle  = angle;
+    d->flip   = UInt8(flip);
+    d->hasSrc = src != NULL;
+
+    if (src) {
+        d->src = *src;
+    }
+
+    if (fmodf(angle, 360.0f) != 0.0f) {
+        // the bounds of the rotated rect
+        float rad = angle * Float(M_PI) / 180.0f;
+        float hw  = 0.5f * (fabsf(dst->w * cosf(rad)) + fabsf(dst->h * sinf(rad)));
+        float hh  = 0.5f * (fabsf(dst->w * sinf(rad)) + fabsf(dst->h * cosf(rad)));
+        float cx  = dst->x + 0.5f * dst->w;
+        float cy  = dst->y + 0.5f * dst->h;
+
+        d->bounds = SDL_Rect(
+            .x = Int(floorf(cx - hw)) - 1,
+            .y = Int(floorf(cy - hh)) - 1,
+            .w = Int(ceilf(2.0f * hw)) + 3,
+            .h = Int(ceilf(2.0f * hh)) + 3
+        );
+    }
+
+    nG_SealDraw(d, salt);
+}
+
+static void nG_DirtyGeometry(
+    SDL_Texture*      tex,
+    const SDL_Vertex* vertices,
+    int               nVertices,
+    const int*        indices,
+    int               nIndices
+) {
+    if (nVertices <= 0) {
+        return;
+    }
+
+    nG_DirtyDraw* d = nG_RecordDraw(nG_DirtyDraw_Geometry);
+
+    if (!d) {
+        return;
+    }
+
+    float x0 = vertices[0].position.x, x1 = x0;
+    float y0 = vertices[0].position.y, y1 = y0;
+
+    for (int i = 1; i < nVertices; i++) {
+        SDL_FPoint p = vertices[i].position;
+
+        x0 = p.x < x0 ? p.x : x0;
+        x1 = p.x > x1 ? p.x : x1;
+        y0 = p.y < y0 ? p.y : y0;
+        y1 = p.y > y1 ? p.y : y1;
+    }
+
+    d->tex       = tex;
+    d->vertices  = vertices;
+    d->nVertices = nVertices;
+    d->indices   = indices;
+    d->nIndices  = nIndices;
+    d->bounds    = SDL_Rect(
+        .x = Int(floorf(x0)),
+        .y = Int(floorf(y0)),
+        .w = Int(ceilf(x1)) - Int(floorf(x0)) + 1,
+        .h = Int(ceilf(y1)) - Int(floorf(y0)) + 1
+    );
+
+    nG_SealDraw(d, 0);
+}
+
+static inline int nG_RectArea(const SDL_Rect *restrict r)
+{
+    return r->w * r->h;
+}
+
+static void nG_AddDamage(SDL_Rect r, const SDL_Rect *restrict screen)
+{
+    if (!SDL_IntersectRect(&r, screen, &r)) {
+        return;
+    }
+
+    // swallow every region it touches
+    for (int i = 0; i < nG_DirtyNRegions; i++) {
+        if (SDL_HasIntersection(&r, &nG_DirtyRegions[i])) {
+            SDL_UnionRect(&r, &nG_DirtyRegions[i], &r);
+            nG_DirtyRegions[i] = nG_DirtyRegions[--nG_DirtyNRegions];
+            i = -1;
+        }
+    }
+
+    if (nG_DirtyNRegions < nG_DIRTY_MAX_REGIONS) {
+        nG_DirtyRegions[nG_DirtyNRegions++] = r;
+        return;
+    }
+
+    // no room: merge it with the region that grows the least
+    int best     = 0;
+    int bestCost = INT32_MAX;
+
+    for (int i = 0; i < nG_DirtyNRegions; i++) {
+        SDL_Rect u;
+        int      cost;
+
+        SDL_UnionRect(&r, &nG_DirtyRegions[i], &u);
+        cost = nG_RectArea(&u) - nG_RectArea(&nG_DirtyRegions[i]);
+
+        if (cost < bestCost) {
+            best     = i;
+            bestCost = cost;
+        }
+    }
+
+    SDL_UnionRect(&r, &nG_DirtyRegions[best], &r);
+    nG_DirtyRegions[best] = nG_DirtyRegions[--nG_DirtyNRegions];
+    nG_AddDamage(r, screen);
+}
+
+// Fills the key set with the keys of <l>.
+static bool nG_BuildKeySet(const nG_DirtyList *restrict l)
+{
+    uint32_t cap = 64;
+
+    while (cap < 2 * l->count) {
+        cap *= 2;
+    }
+
+    if (cap > nG_DirtyKeyCap) {
+        n_Delete(nG_DirtyKeys);
+        nG_DirtyKeys   = n_NewTagged(uint32_t, cap, n_AllocTag_Engine);
+        nG_DirtyKeyCap = nG_DirtyKeys ? cap : 0;
+
+        if (!nG_DirtyKeys) {
+            return false;
+        }
+    }
+
+    memset(nG_DirtyKeys, 0, nG_DirtyKeyCap * sizeof(uint32_t));
+
+    for (uint32_t i = 0; i < l->count; i++) {
+        uint32_t k = l->draws[i].key;
+        uint32_t j = k & (nG_DirtyKeyCap - 1);
+
+        while (nG_DirtyKeys[j] && nG_DirtyKeys[j] != k) {
+            j = (j + 1) & (nG_DirtyKeyCap - 1);
+        }
+        nG_DirtyKeys[j] = k;
+    }
+
+    return true;
+}
+
+static bool nG_HasKey(uint32_t k)
+{
+    for (uint32_t j = k & (nG_DirtyKeyCap - 1);; j = (j + 1) & (nG_DirtyKeyCap - 1)) {
+        if (nG_DirtyKeys[j] == k) {
+            return true;
+        }
+        if (!nG_DirtyKeys[j]) {
+            return false;
+        }
+    }
+}
+
+// Damage of the draws of <a> that are not in <b>.
+static bool nG_DiffDraws(const nG_DirtyList *restrict a, const nG_DirtyList *restrict b, const SDL_Rect *restrict screen)
+{
+    if (!nG_BuildKeySet(b)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < a->count; i++) {
+        if (!nG_HasKey(a->draws[i].key)) {
+            nG_AddDamage(a->draws[i].bounds, screen);
+        }
+    }
+
+    return true;
+}
+
+static void nG_ReplayDraw(const nG_DirtyDraw *restrict d)
+{
+    uint32_t c = d->color;
+
+    switch (d->type) {
+    case nG_DirtyDraw_Fill:
+    case nG_DirtyDraw_Outline:
+        SDL_SetRenderDrawColor(nG_Renderer, (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF, c >> 24);
+        if (d->type == nG_DirtyDraw_Fill) {
+            SDL_RenderFillRect(nG_Renderer, &d->dst);
+        } else {
+            SDL_RenderDrawRect(nG_Renderer, &d->dst);
+        }
+        break;
+
+    case nG_DirtyDraw_Copy:
+        SDL_RenderCopyEx(
+            nG_Renderer,
+            d->tex,
+            d->hasSrc ? &d->src : NULL,
+            &d->dst,
+            d->angle,
+            NULL,
+            d->flip
+        );
+        break;
+
+    case nG_DirtyDraw_Geometry: {
+        SDL_BlendMode mode;
+
+        SDL_GetRenderDrawBlendMode(nG_Renderer, &mode);
+        SDL_SetRenderDrawBlendMode(nG_Renderer, SDL_BLENDMODE_BLEND);
+        SDL_RenderGeometry(nG_Renderer, d->tex, d->vertices, d->nVertices, d->indices, d->nIndices);
+        SDL_SetRenderDrawBlendMode(nG_Renderer, mode);
+        break;
+    }
+    }
+}
+
+static void nG_DirtyPresent(void)
+{
+    nG_DirtyList* curr   = &nG_DirtyLists[nG_DirtyCurr];
+    nG_DirtyList* prev   = &nG_DirtyLists[!nG_DirtyCurr];
+    SDL_Rect      screen = SDL_Rect();
+    SDL_Rect      clip;
+    uint8_t       r, g, b, a;
+
+    nG_GetScreenSize(&screen.w, &screen.h);
+
+    nG_DirtyNRegions = 0;
+
+    if (!nG_DirtyFull) {
+        nG_DirtyFull = !nG_DiffDraws(curr, prev, &screen)
+            || !nG_DiffDraws(prev, curr, &screen);
+    }
+
+    if (!nG_DirtyFull) {
+        long area = 0;
+
+        for (int i = 0; i < nG_DirtyNRegions; i++) {
+            area += nG_RectArea(&nG_DirtyRegions[i]);
+        }
+
+        nG_DirtyFull = area > nG_DIRTY_THRESHOLD * nG_RectArea(&screen);
+    }
+
+    if (nG_DirtyFull) {
+        nG_DirtyRegions[0] = screen;
+        nG_DirtyNRegions   = 1;
+    }
+
+    // the game's own clip rect is restored afterwards (empty when disabled)
+    SDL_RenderGetClipRect(nG_Renderer, &clip);
+    SDL_GetRenderDrawColor(nG_Renderer, &r, &g, &b, &a);
+
+    for (int i = 0; i < nG_DirtyNRegions; i++) {
+        const SDL_Rect* region = &nG_DirtyRegions[i];
+        uint32_t        bg     = nG_DirtyBG;
+
+        SDL_RenderSetClipRect(nG_Renderer, region);
+
+        // SDL_RenderClear() ignores the clip rect
+        SDL_SetRenderDrawColor(nG_Renderer, (bg >> 16) & 0xFF, (bg >> 8) & 0xFF, bg & 0xFF, bg >> 24);
+        SDL_RenderFillRect(nG_Renderer, region);
+
+        for (uint32_t j = 0; j < curr->count; j++) {
+            const nG_DirtyDraw* d = &curr->draws[j];
+            SDL_Rect            c;
+
+            if (!SDL_HasIntersection(&d->bounds, region)) {
+                continue;
+            }
+
+            if (d->clip.w > 0) {
+                SDL_IntersectRect(region, &d->clip, &c);
+                SDL_RenderSetClipRect(nG_Renderer, &c);
+                nG_ReplayDraw(d);
+                SDL_RenderSetClipRect(nG_Renderer, region);
+            } else {
+                nG_ReplayDraw(d);
+            }
+        }
+    }
+
+    SDL_RenderSetClipRect(nG_Renderer, clip.w > 0 && clip.h > 0 ? &clip : NULL);
+    SDL_SetRenderDrawColor(nG_Renderer, r, g, b, a);
+
+    nG_DirtyFull = false;
+    nG_DirtyCurr = !nG_DirtyCurr;
+
+    nG_DirtyLists[nG_DirtyCurr].count = 0;
+}
+
+
+static void nG_DeleteDirtyState(nG_DirtyState** state)
+{
+    if (state && *state) {
+        n_Delete((*state)->lists[0].draws);
+        n_Delete((*state)->lists[1].draws);
+        n_Delete((*state)->keys);
+        n_Delete(*state);
+    }
+}
+
+
+int n_GetDamageRegions(const SDL_Rect** regions)
+{
+    if (!nG_DirtyEnabled) {
+        return 0;
+    }
+
+    if (regions) {
+        *regions = nG_DirtyRegions;
+    }
+
+    return nG_DirtyNRegions;
+}
+
+void n_InvalidateScreen(void)
+{
+    if (nG_DirtyEnabled) {
+        nG_DirtyFull = true;
+    }
+}
+
+bool n_SetDirtyRectMode(bool enabled)
+{
+    SDL_RendererInfo info;
+
+    if (enabled && nG_Backend != n_RenderBackend_SDL) {
+        n_LogWarnf("Dirty-rect mode needs the SDL render backend.\n");
+        return false;
+    }
+
+    // only the software renderer keeps the back buffer between frames
+    if (enabled
+        && (SDL_GetRendererInfo(nG_Renderer, &info) < 0
+            || !(info.flags & SDL_RENDERER_SOFTWARE))) {
+        n_LogWarnf("Dirty-rect mode needs the software renderer.\n");
+        return false;
+    }
+
+    if (!enabled) {
+        nG_DeleteDirtyState(&nG_Ctx->dirty);
+        return true;
+    }
+
+    if (!nG_Ctx->dirty) {
+        nG_Ctx->dirty = n_NewTagged(nG_DirtyState, 1, n_AllocTag_Engine);
+
+        if (!nG_Ctx->dirty) {
+            n_LogErrorf("Out of memory while enabling the dirty-rect mode.\n");
+            return false;
+        }
+    }
+
+    nG_DirtyFull           = true;
+    nG_DirtyLists[0].count = 0;
+    nG_DirtyLists[1].count = 0;
+    return true;
+}
+
+
+// ========================================================
+//
+// GRAPHICS
+//
+// ========================================================
+
+
+
+
+enum {
+    nG_SceneItem_Fill,
+    nG_SceneItem_Outline,
+    nG_SceneItem_Copy,
+    nG_SceneItem_Screen,    // a copy without destination: fills the view
+    // drawn again through their function, never skipped
+    nG_SceneItem_Particles,
+    nG_SceneItem_Layer,
+    nG_SceneItem_DebugRect, // a debug shape's arguments are in <dest>
+    nG_SceneItem_DebugFill,
+    nG_SceneItem_DebugLine,
+    nG_SceneItem_DebugCircle,
+    nG_SceneItem_DebugArrow
+};
+
+
+typedef struct {
+    SDL_Texture* tex;
+    // the particle emitter or the render layer
+    void*        data;
+    SDL_Rect     src;
+    n_Rect       dest;
+    n_Rect       bounds;
+    uint32_t     color;
+    float        angle;
+    uint8_t      type;
+    uint8_t      flip;
+    bool         hasSrc;
+} nG_SceneItem;
+
+struct n_Scene {
+    nG_SceneItem* items;
+    uint32_t      count;
+    uint32_t      cap;
+};
+
+
+static n_RenderScale      nG_ScaleOpts;
+static SDL_Texture*       nG_ScaleTarget    = NULL;
+// current fraction of the window (dynamic scaling moves it)
+static float              nG_ScaleCurr      = 1.0f;
+static int                nG_ScaleWait      = 0;
+static uint64_t           nG_ScaleFrameStart = 0;
+static n_RenderScaleStats nG_ScaleStats;
+
+
+static inline uint32_t nG_PackColor(SDL_Color c)
+{
+    return (UInt32(c.a) << 24) | (c.r << 16) | (c.g << 8) | c.b;
+}
+
+static inline SDL_Color nG_UnpackColor(uint32_t c)
+{
+    return SDL_Color(.r = (c >> 16) & 0xFF, .g = (c >> 8) & 0xFF, .b = c & 0xFF, .a = c >> 24);
+}
+
+// Adds a draw to the scene being recorded, with its bounds in world
+// space (those of the rotated rect for rotated copies). Returns NULL
+// if the scene can't grow.
+static nG_SceneItem* nG_RecordSceneItem(
+    uint8_t                  type,
+    SDL_Texture*             tex,
+    const SDL_Rect *restrict src,
+    const n_Rect *restrict   dest,
+    float            angle,
+    SDL_RendererFlip flip
+) {
+    n_Scene* scene = nG_Scene;
+
+    if (scene->count == scene->cap) {
+        uint32_t      cap   = scene->cap ? 2 * scene->cap : 256;
+        nG_SceneItem* items = n_ResizeTagged(scene->items, nG_SceneItem, cap, n_AllocTag_Engine);
+
+        if (!items) {
+            n_LogErrorf("Unable to grow the scene.\n");
+            return NULL;
+        }
+
+        scene->items = items;
+        scene->cap   = cap;
+    }
+
+    nG_SceneItem* it = &scene->items[scene->count++];
+
+    memset(it, 0, sizeof(*it));
+    it->type   = (type == nG_SceneItem_Copy && !dest) ? nG_SceneItem_Screen : type;
+    it->tex    = tex;
+    it->color  = nG_RasterColor;
+    it->angle  = angle;
+    it->flip   = UInt8(flip);
+    it->hasSrc = src != NULL;
+
+    if (src) {
+        it->src = *src;
+    }
+
+    if (dest) {
+        it->dest   = *dest;
+        it->bounds = *dest;
+    }
+
+    if (dest && fmodf(angle, 360.0f) != 0.0f) {
+        float r = 0.5f * sqrtf(dest->w * dest->w + dest->h * dest->h);
+
+        it->bounds = n_Rect(
+            .x = dest->x + 0.5f * dest->w - r,
+            .y = dest->y + 0.5f * dest->h - r,
+            .w = 2.0f * r,
+            .h = 2.0f * r
+        );
+    }
+
+    if (tex) {
+        // the scene may be drawn long after this frame
+        nG_PinTexture(tex, 1);
+    }
+
+    return it;
+}
+
+// Releases the managed textures that the scene's items keep.
+static void nG_UnpinScene(const n_Scene *restrict scene)
+{
+    for (uint32_t i = 0; i < scene->count; i++) {
+        if (scene->items[i].tex) {
+            nG_PinTexture(scene->items[i].tex, -1);
+        }
+    }
+}
+
+#ifndef nG_NO_DEBUG_DRAW
+// A debug shape: its arguments packed in <shape>, see nG_SceneItem.
+static void nG_RecordDebugShape(uint8_t type, n_Rect shape, SDL_Color color)
+{
+    nG_SceneItem* it = nG_RecordSceneItem(type, NULL, NULL, NULL, 0.0f, SDL_FLIP_NONE);
+
+    if (it) {
+        it->dest  = shape;
+        it->color = nG_PackColor(color);
+    }
+}
+#endif // !nG_NO_DEBUG_DRAW
+
+static int nG_ScreenHeight(void)
+{
+    int h = nG_TargetHeight;
+
+    if (h <= 0) {
+        nG_GetScreenSize(NULL, &h);
+    }
+
+    return h;
+}
+
+
+void n_Animate(n_Animation *restrict a, float totalTime)
+{
+    if (!a) {
+        return;
+    }
+
+    float frameTime = a->frameDuration;
+    int   animSize  = a->size;
+    float duration  = animSize * frameTime;
+    float dt        = totalTime - a->totalTime;
+
+    if (dt <= duration) {
+        a->index  = UInt16(totalTime / frameTime) % animSize;
+        a->angle += a->angleInc;
+    } else {
+        // if a long time has passed without animating, restart
+        // the animation.
+        a->index = 0;
+    }
+
+    a->totalTime = totalTime;
+}
+
+void n_BeginScene(n_Scene *restrict scene)
+{
+    if (scene) {
+        nG_UnpinScene(scene);
+        scene->count = 0;
+    }
+
+    nG_Scene = scene;
+}
+
+void n_CenterCamera(n_Camera *restrict cam, n_Vec2 center)
+{
+    if (!cam) {
+        return;
+    }
+}
+
+void n_ClearBackground(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    if (nG_Backend == n_RenderBackend_Raster) {
+        SDL_Rect screen = SDL_Rect();
+
+        nG_GetScreenSize(&screen.w, &screen.h);
+        nG_RasterFill(&screen, (UInt32(a) << 24) | (r << 16) | (g << 8) | b, false);
+        return;
+    }
+
+    if (nG_IsRecording()) {
+        uint32_t bg = (UInt32(a) << 24) | (r << 16) | (g << 8) | b;
+
+        nG_DirtyFull = nG_DirtyFull || bg != nG_DirtyBG;
+        nG_DirtyBG   = bg;
+        return;
+    }
+
+    SDL_SetRenderDrawColor(nG_Renderer, r, g, b, a);
+    SDL_RenderClear(nG_Renderer);
+}
+
+void n_DeleteAnimation(n_Animation** a)
+{
+    if (a && *a) {
+        n_Delete((*a)->frames);
+        n_Delete(*a);
+    }
+}
+
+void n_DeleteRenderLayer(n_RenderLayer** layer)
+{
+    if (layer && *layer) {
+        n_DeleteTexture(&(*layer)->tex);
+        n_Delete(*layer);
+    }
+}
+
+void n_DeleteScene(n_Scene** scene)
+{
+    if (scene && *scene) {
+        if (nG_Scene == *scene) {
+            nG_Scene = NULL;
+        }
+        nG_UnpinScene(*scene);
+        n_Delete((*scene)->items);
+        n_Delete(*scene);
+    }
+}
+
+void n_DrawAnimation(const n_Camera *restrict cam, const n_Animation *restrict a) {
+    if (!cam || !a) {
+        return;
+    }
+
+    uint32_t i = a->index;
+
+    n_DrawTexture(cam, a->tex, &a->frames[i], &a->dest, a->angle, a->flip);
+}
+
+// Draws a rect, in screen pixels, with the current draw color.
+static void nG_DrawScreenRect(const SDL_Rect *restrict r, bool outline)
+{
+    if (nG_Backend == n_RenderBackend_Raster) {
+        if (!outline) {
+            nG_RasterFill(r, nG_RasterColor, false);
+            return;
+        }
+
+        SDL_Rect top    = SDL_Rect(.x = r->x, .y = r->y, .w = r->w, .h = 1);
+        SDL_Rect bottom = SDL_Rect(.x = r->x, .y = r->y + r->h - 1, .w = r->w, .h = 1);
+        SDL_Rect left   = SDL_Rect(.x = r->x, .y = r->y, .w = 1, .h = r->h);
+        SDL_Rect right  = SDL_Rect(.x = r->x + r->w - 1, .y = r->y, .w = 1, .h = r->h);
+
+        nG_RasterFill(&top, nG_RasterColor, false);
+        nG_RasterFill(&bottom, nG_RasterColor, false);
+        nG_RasterFill(&left, nG_RasterColor, false);
+        nG_RasterFill(&right, nG_RasterColor, false);
+    } else if (nG_IsRecording()) {
+        nG_DirtyFill(r, nG_RasterColor, outline);
+    } else if (outline) {
+        SDL_RenderDrawRect(nG_Renderer, r);
+    } else {
+        SDL_RenderFillRect(nG_Renderer, r);
+    }
+}
+
+// Copies <tex> to <d>, in screen pixels (the whole target when NULL).
+static void nG_DrawScreenTexture(
+    SDL_Texture*             tex,
+    const SDL_Rect *restrict src,
+    const SDL_Rect *restrict d,
+    float            angle,
+    SDL_RendererFlip flip
+) {
+    SDL_Rect screen = SDL_Rect();
+
+    if (!d && nG_Backend == n_RenderBackend_Raster) {
+        nG_GetScreenSize(&screen.w, &screen.h);
+        d = &screen;
+    }
+
+    if (nG_Backend == n_RenderBackend_Raster) {
+        nG_RasterTexture(tex, src, d, angle, flip, 0xFFFFFFFF);
+        return;
+    }
+
+    if (nG_IsRecording()) {
+        if (!d) {
+            nG_GetScreenSize(&screen.w, &screen.h);
+            d = &screen;
+        }
+        nG_DirtyCopy(tex, src, d, angle, flip, 0);
+        return;
+    }
+
+    SDL_RenderCopyEx(nG_Renderer, tex, src, d, angle, NULL, flip);
+}
+
+void n_DrawFilledRect(const n_Camera *restrict cam, const n_Rect *restrict rect)
+{
+    if (!cam || !n_IsValidRect(rect)) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordSceneItem(nG_SceneItem_Fill, NULL, NULL, rect, 0.0f, SDL_FLIP_NONE);
+        return;
+    }
+
+    SDL_Rect r = n_Unproject(cam, rect);
+
+    nG_DrawScreenRect(&r, false);
+}
+
+void n_DrawRect(const n_Camera *restrict cam, const n_Rect *restrict rect)
+{
+    if (!cam || !n_IsValidRect(rect)) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordSceneItem(nG_SceneItem_Outline, NULL, NULL, rect, 0.0f, SDL_FLIP_NONE);
+        return;
+    }
+
+    SDL_Rect r = n_Unproject(cam, rect);
+
+    nG_DrawScreenRect(&r, true);
+}
+
+static bool nG_BuildRenderLayer(const n_Camera *restrict cam, n_RenderLayer *restrict layer)
+{
+    int   winW, winH;
+    float k      = cam->zoom * nG_PPM;
+    int   margin = Int(ceilf(layer->margin * k));
+
+    nG_GetScreenSize(&winW, &winH);
+
+    int w = winW + 2 * margin;
+    int h = winH + 2 * margin;
+
+    if (!layer->tex || layer->w != w || layer->h != h) {
+        n_DeleteTexture(&layer->tex);
+
+        layer->tex = SDL_CreateTexture(
+            nG_Renderer,
+            SDL_PIXELFORMAT_RGBA8888,
+            SDL_TEXTUREACCESS_TARGET,
+            w,
+            h
+        );
+        if (!layer->tex) {
+            n_LogErrorf("Unable to create the render layer: %s\n", SDL_GetError());
+            return false;
+        }
+        nG_TrackTexture(layer->tex);
+
+        SDL_SetTextureBlendMode(layer->tex, SDL_BLENDMODE_BLEND);
+        layer->w = w;
+        layer->h = h;
+    }
+
+    SDL_Texture* target = SDL_GetRenderTarget(nG_Renderer);
+    int          prevH  = nG_TargetHeight;
+    uint8_t      r, g, b, a;
+
+    if (SDL_SetRenderTarget(nG_Renderer, layer->tex) < 0) {
+        n_LogErrorf("Unable to draw the render layer: %s\n", SDL_GetError());
+        return false;
+    }
+
+    SDL_GetRenderDrawColor(nG_Renderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(nG_Renderer, 0, 0, 0, 0);
+    SDL_RenderClear(nG_Renderer);
+    SDL_SetRenderDrawColor(nG_Renderer, r, g, b, a);
+
+    // the texture's origin is <margin> pixels to the left of (and
+    // below) the window's, so the camera is shifted by the margin.
+    n_Camera c = *cam;
+
+    c.x += margin / k;
+    c.y += margin / k;
+
+    nG_TargetHeight = h;
+    layer->draw(&c, layer->data);
+    nG_TargetHeight = prevH;
+
+    SDL_SetRenderTarget(nG_Renderer, target);
+
+    layer->cam   = *cam;
+    layer->dirty = false;
+    layer->version++;
+    return true;
+}
+
+void n_DrawRenderLayer(const n_Camera *restrict cam, n_RenderLayer *restrict layer)
+{
+    if (!cam || !layer) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_SceneItem* it = nG_RecordSceneItem(nG_SceneItem_Layer, NULL, NULL, NULL, 0.0f, SDL_FLIP_NONE);
+
+        if (it) {
+            it->data = layer;
+        }
+        return;
+    }
+
+    float k      = cam->zoom * nG_PPM;
+    float dx     = cam->x - layer->cam.x;
+    float dy     = cam->y - layer->cam.y;
+    int   margin = Int(ceilf(layer->margin * k));
+    int   winW, winH;
+
+    nG_GetScreenSize(&winW, &winH);
+
+    bool stale = layer->dirty
+        || !layer->tex
+        || cam->zoom != layer->cam.zoom
+        || fabsf(dx) > layer->margin
+        || fabsf(dy) > layer->margin
+        || layer->w != winW + 2 * margin
+        || layer->h != winH + 2 * margin;
+
+    if (nG_Backend == n_RenderBackend_Raster) {
+        // there are no render targets: the raster backend draws the
+        // layer's content every frame.
+        layer->draw(cam, layer->data);
+        return;
+    }
+
+    if (stale) {
+        if (!nG_BuildRenderLayer(cam, layer)) {
+            return;
+        }
+        dx = 0.0f;
+        dy = 0.0f;
+    }
+
+    SDL_Rect d = SDL_Rect(
+        .x = Int(k * dx) - margin,
+        .y = -Int(k * dy) - margin,
+        .w = layer->w,
+        .h = layer->h
+    );
+
+    if (nG_IsRecording()) {
+        // a rebuilt layer is a different draw, even at the same place
+        nG_DirtyCopy(layer->tex, NULL, &d, 0.0f, SDL_FLIP_NONE, layer->version);
+        return;
+    }
+
+    SDL_RenderCopy(nG_Renderer, layer->tex, NULL, &d);
+}
+
+// Draws the items that keep their draw function's arguments, with
+// the camera shifted to the viewport.
+static void nG_ReplaySceneItem(const n_Camera *restrict cam, const nG_SceneItem *restrict it)
+{
+#ifndef nG_NO_DEBUG_DRAW
+    SDL_Color color = nG_UnpackColor(it->color);
+    n_Vec2    from  = n_Vec2(.x = it->dest.x, .y = it->dest.y);
+    n_Vec2    to    = n_Vec2(.x = it->dest.w, .y = it->dest.h);
+#endif // !nG_NO_DEBUG_DRAW
+
+    switch (it->type) {
+    case nG_SceneItem_Particles:
+        n_DrawParticles(cam, it->data);
+        break;
+
+    case nG_SceneItem_Layer:
+        n_DrawRenderLayer(cam, it->data);
+        break;
+
+#ifndef nG_NO_DEBUG_DRAW
+    case nG_SceneItem_DebugRect:
+        n_DebugRect(cam, &it->dest, color);
+        break;
+
+    case nG_SceneItem_DebugFill:
+        n_DebugFilledRect(cam, &it->dest, color);
+        break;
+
+    case nG_SceneItem_DebugLine:
+        n_DebugLine(cam, from, to, color);
+        break;
+
+    case nG_SceneItem_DebugCircle:
+        n_DebugCircle(cam, from, it->dest.w, color);
+        break;
+
+    case nG_SceneItem_DebugArrow:
+        n_DebugArrow(cam, from, to, color);
+        break;
+#endif // !nG_NO_DEBUG_DRAW
+    }
+}
+
+void n_DrawScene(
+    const n_Camera *restrict cam,
+    const n_Scene *restrict  scene,
+    const SDL_Rect *restrict viewport
+) {
+    if (!cam || !scene) {
+        return;
+    }
+
+    SDL_Rect vp = SDL_Rect();
+    float    k  = cam->zoom * nG_PPM;
+
+    if (viewport) {
+        vp = *viewport;
+    } else {
+        nG_GetScreenSize(&vp.w, &vp.h);
+    }
+
+    if (vp.w <= 0 || vp.h <= 0 || k <= 0.0f) {
+        return;
+    }
+
+    // what the camera sees, in meters
+    n_Rect   view   = n_Rect(.x = -cam->x, .y = -cam->y, .w = vp.w / k, .h = vp.h / k);
+    uint32_t color  = nG_RasterColor;
+    uint32_t curr   = color;
+    bool     direct = nG_Backend == n_RenderBackend_SDL && !nG_IsRecording();
+    n_Scene* rec    = nG_Scene;
+    SDL_Rect clip   = SDL_Rect();
+    SDL_Rect outer  = nG_ViewClip;
+
+    // for what draws over the whole screen: the viewport's bottom left
+    // corner ends up where the camera's origin is
+    n_Camera shifted = *cam;
+
+    shifted.x += vp.x / k;
+    shifted.y += (nG_ScreenHeight() - vp.y - vp.h) / k;
+
+    // the items draw through the draw functions, which would record
+    // them into the scene being recorded
+    nG_Scene = NULL;
+
+    // the other backends clip each draw to nG_ViewClip themselves
+    nG_ViewClip = vp;
+    if (direct) {
+        SDL_RenderGetClipRect(nG_Renderer, &clip);
+        SDL_RenderSetClipRect(nG_Renderer, &vp);
+    }
+
+    for (uint32_t i = 0; i < scene->count; i++) {
+        const nG_SceneItem* it = &scene->items[i];
+
+        if (it->tex) {
+            // a scene can be drawn for more frames than it was recorded
+            nG_TouchTexture(it->tex);
+        }
+
+        if (it->type >= nG_SceneItem_Particles) {
+            nG_ReplaySceneItem(&shifted, it);
+            continue;
+        }
+
+        if (it->type == nG_SceneItem_Screen) {
+            nG_DrawScreenTexture(it->tex, it->hasSrc ? &it->src : NULL, &vp, it->angle, it->flip);
+            continue;
+        }
+
+        if (!n_RectsOverlap((n_Rect*) &it->bounds, &view)) {
+            continue;
+        }
+
+        // like n_Unproject(), from the viewport's bottom left corner
+        int      h = Int(k * it->dest.h);
+        SDL_Rect d = SDL_Rect(
+            .x = vp.x + Int(k * (it->dest.x + cam->x)),
+            .y = vp.y + vp.h - Int(k * (it->dest.y + cam->y)) - h,
+            .w = Int(k * it->dest.w),
+            .h = h
+        );
+
+        if (it->type == nG_SceneItem_Copy) {
+            nG_DrawScreenTexture(it->tex, it->hasSrc ? &it->src : NULL, &d, it->angle, it->flip);
+            continue;
+        }
+
+        if (it->color != curr) {
+            curr = it->color;
+            n_SetRendererDrawColor(nG_UnpackColor(curr));
+        }
+
+        nG_DrawScreenRect(&d, it->type == nG_SceneItem_Outline);
+    }
+
+    if (curr != color) {
+        n_SetRendererDrawColor(nG_UnpackColor(color));
+    }
+
+    if (direct) {
+        // an empty clip rect is no clipping
+        SDL_RenderSetClipRect(nG_Renderer, clip.w > 0 && clip.h > 0 ? &clip : NULL);
+    }
+    nG_ViewClip = outer;
+    nG_Scene    = rec;
+}
+
+void n_DrawSprite(const n_Camera *restrict cam, const n_Sprite *restrict sprite)
+{
+    if (cam && sprite) {
+        n_DrawTexture(
+            cam,
+            sprite->tex,
+            &sprite->src,
+            &sprite->dest,
+            sprite->angle,
+            sprite->flip
+        );
+    }
+}
+
+void n_DrawTexture(
+    const n_Camera *restrict cam,
+    SDL_Texture* tex,
+    const SDL_Rect *restrict src,
+    const n_Rect *restrict dest,
+    float angle,
+    SDL_RendererFlip flip
+) {
+    if (!cam || !tex) {
+        return;
+    }
+
+    nG_TouchTexture(tex);
+
+    if (nG_Scene) {
+        nG_RecordSceneItem(nG_SceneItem_Copy, tex, src, dest, angle, flip);
+        return;
+    }
+
+    SDL_Rect d = n_Unproject(cam, dest);
+
+    nG_DrawScreenTexture(tex, src, dest ? &d : NULL, angle, flip);
+}
+
+void n_EndScene(void)
+{
+    nG_Scene = NULL;
+}
+
+n_Animation* n_NewAnimation(
+    SDL_Texture* tex,
+    SDL_Rect*    frames,
+    uint32_t     nOfFrames,
+    float        frameDuration
+) {
+    if (!tex || !frames || nOfFrames < 2) {
+        // TODO error message
+        return NULL;
+    }
+
+    SDL_Rect* fs = n_NewTagged(SDL_Rect, nOfFrames, n_AllocTag_Frames);
+
+    if (!fs) {
+        // TODO error message
+        return NULL;
+    }
+
+    n_Animation* a = n_NewTagged(n_Animation, 1, n_AllocTag_Animations);
+
+    if (!a) {
+        // TODO error message
+        n_Delete(fs);
+        return NULL;
+    }
+
+    memcpy(fs, frames, nOfFrames * sizeof(SDL_Rect));
+
+    *a = n_Animation(
+        .tex           = tex,
+        .frames        = fs,
+        .dest          = n_Rect(.x = 1.0f, .y = 1.0f, .w = 1.0f, .h = 1.0f),
+        .size          = nOfFrames,
+        .index         = 0,
+        .frameDuration = frameDuration,
+        .totalTime     = 0,
+        .angle         = 0,
+        .angleInc      = 0,
+        .flip          = SDL_FLIP_NONE
+    );
+
+    return a;
+}
+
+void n_MarkRenderLayerDirty(n_RenderLayer *restrict layer)
+{
+    if (layer) {
+        layer->dirty = true;
+    }
+}
+
+n_RenderLayer* n_NewRenderLayer(float margin, n_RenderLayerFn draw, void* data)
+{
+    if (!draw) {
+        n_LogErrorf("Render layer with no draw function.\n");
+        return NULL;
+    }
+
+    if (nG_Backend == n_RenderBackend_SDL && !SDL_RenderTargetSupported(nG_Renderer)) {
+        n_LogWarnf("The renderer doesn't support render targets.\n");
+        return NULL;
+    }
+
+    n_RenderLayer* layer = n_New(n_RenderLayer, 1);
+
+    if (layer) {
+        layer->draw   = draw;
+        layer->data   = data;
+        layer->cam    = n_Camera();
+        layer->margin = margin > 0.0f ? margin : 0.0f;
+        layer->dirty  = true;
+    }
+
+    return layer;
+}
+
+n_Scene* n_NewScene(void)
+{
+    n_Scene* scene = n_New(n_Scene, 1);
+
+    if (scene) {
+        *scene = (n_Scene) { 0 };
+    }
+
+    return scene;
+}
+
+// (Re)creates the render scaling target for the window's size and
+// the current scale, and draws to it.
+static bool nG_ResizeScaleTarget(void)
+{
+    int   winW, winH, w, h;
+    float ppmScale = 1.0f;
+
+    SDL_GetWindowSize(nG_Window, &winW, &winH);
+
+    if (nG_ScaleOpts.width > 0) {
+        w = nG_ScaleOpts.width;
+        h = nG_ScaleOpts.height;
+    } else {
+        if (nG_ScaleOpts.integer) {
+            // 1/2, 1/3... so that the target fills the window
+            nG_ScaleCurr = 1.0f / SDL_max(1.0f, roundf(1.0f / nG_ScaleCurr));
+        }
+        ppmScale = nG_ScaleCurr;
+        w        = SDL_max(1, Int(winW * nG_ScaleCurr));
+        h        = SDL_max(1, Int(winH * nG_ScaleCurr));
+    }
+
+    nG_Ctx->ppmScale = ppmScale;
+
+    if (nG_ScaleTarget && nG_Ctx->scaledWidth == w && nG_Ctx->scaledHeight == h) {
+        return true;
+    }
+
+    SDL_Texture* tex = SDL_CreateTexture(
+        nG_Renderer,
+        SDL_PIXELFORMAT_RGBA8888,
+        SDL_TEXTUREACCESS_TARGET,
+        w,
+        h
+    );
+    if (!tex) {
+        n_LogErrorf("Unable to create the render scaling target: %s\n", SDL_GetError());
+        return false;
+    }
+    nG_TrackTexture(tex);
+
+    bool sharp = nG_ScaleOpts.integer || nG_ScaleOpts.width > 0;
+
+    SDL_SetTextureScaleMode(tex, sharp ? SDL_ScaleModeNearest : SDL_ScaleModeLinear);
+
+    if (SDL_SetRenderTarget(nG_Renderer, tex) < 0) {
+        n_LogErrorf("Unable to draw to the render scaling target: %s\n", SDL_GetError());
+        n_DeleteTexture(&tex);
+        return false;
+    }
+
+    n_DeleteTexture(&nG_ScaleTarget);
+    nG_ScaleTarget       = tex;
+    nG_Ctx->scaledWidth  = w;
+    nG_Ctx->scaledHeight = h;
+    n_InvalidateScreen();
+    return true;
+}
+
+// Copies the render scaling target to the window.
+static void nG_PresentScaled(void)
+{
+    int      winW, winH;
+    int      w = nG_Ctx->scaledWidth;
+    int      h = nG_Ctx->scaledHeight;
+    SDL_Rect d = SDL_Rect();
+    uint8_t  r, g, b, a;
+
+    SDL_GetWindowSize(nG_Window, &winW, &winH);
+
+    if (nG_ScaleOpts.width > 0 || nG_ScaleOpts.integer) {
+        float k = SDL_min(Float(winW) / w, Float(winH) / h);
+
+        if (nG_ScaleOpts.integer && k >= 1.0f) {
+            k = floorf(k);
+        }
+        d.w = Int(k * w);
+        d.h = Int(k * h);
+        d.x = (winW - d.w) / 2;
+        d.y = (winH - d.h) / 2;
+    } else {
+        d.w = winW;
+        d.h = winH;
+    }
+
+    SDL_SetRenderTarget(nG_Renderer, NULL);
+    SDL_GetRenderDrawColor(nG_Renderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(nG_Renderer, 0, 0, 0, 0xFF);
+    SDL_RenderClear(nG_Renderer);
+    SDL_SetRenderDrawColor(nG_Renderer, r, g, b, a);
+    SDL_RenderCopy(nG_Renderer, nG_ScaleTarget, NULL, &d);
+
+    if (nG_ScaleOpts.dynamic) {
+        // the frame's batched draws are done by now
+        SDL_RenderFlush(nG_Renderer);
+
+        float ms = 1000.0f * (SDL_GetPerformanceCounter() - nG_ScaleFrameStart)
+            / SDL_GetPerformanceFrequency();
+
+        nG_ScaleStats.frameMs = nG_ScaleStats.frameMs > 0.0f
+            ? nG_ScaleStats.frameMs + (ms - nG_ScaleStats.frameMs) / 8.0f
+            : ms;
+    }
+}
+
+// Adapts the scale to the frame time, follows the window's size and
+// draws the next frame to the target again. n_Run() restarts the
+// frame's clock when it starts the next frame, after waiting.
+static void nG_EndScaleFrame(void)
+{
+    n_RenderScale* o  = &nG_ScaleOpts;
+    float          ms = nG_ScaleStats.frameMs;
+
+    if (o->dynamic && o->width <= 0 && --nG_ScaleWait <= 0) {
+        float n    = roundf(1.0f / nG_ScaleCurr);
+        float prev = nG_ScaleCurr;
+
+        if (ms > o->targetMs && nG_ScaleCurr > o->minScale) {
+            nG_ScaleCurr = o->integer ? 1.0f / (n + 1.0f) : 0.9f * nG_ScaleCurr;
+            nG_ScaleCurr = SDL_max(nG_ScaleCurr, o->minScale);
+        } else if (ms < 0.75f * o->targetMs && nG_ScaleCurr < o->scale) {
+            nG_ScaleCurr = o->integer ? 1.0f / SDL_max(n - 1.0f, 1.0f) : 1.1f * nG_ScaleCurr;
+            nG_ScaleCurr = SDL_min(nG_ScaleCurr, o->scale);
+        }
+
+        if (nG_ScaleCurr != prev) {
+            nG_ScaleWait = nG_SCALE_INTERVAL;
+        }
+    }
+
+    if (!nG_ResizeScaleTarget()) {
+        // keep drawing to the old target, if any
+        SDL_SetRenderTarget(nG_Renderer, nG_ScaleTarget);
+    }
+
+    nG_ScaleFrameStart = SDL_GetPerformanceCounter();
+}
+
+void n_Present(void)
+{
+    if (nG_Backend == n_RenderBackend_Raster) {
+        nG_RasterPresent();
+    } else if (nG_DirtyEnabled) {
+        nG_DirtyPresent();
+    }
+
+    n_FlushDebugDraw();
+
+    bool scaled = nG_ScaleTarget && nG_Ctx == &nG_DefaultContext;
+
+    if (scaled) {
+        nG_PresentScaled();
+    }
+
+    nG_CaptureFrame();
+    nG_PresentStart = SDL_GetPerformanceCounter();
+    SDL_RenderPresent(nG_Renderer);
+
+    if (scaled) {
+        nG_EndScaleFrame();
+    }
+
+    nG_EndTextureFrame();
+}
+
+void n_SetRendererDrawColor(SDL_Color color)
+{
+    // the dirty-rect draw list and the scenes keep the color too
+    nG_RasterColor = (UInt32(color.a) << 24) | (color.r << 16) | (color.g << 8) | color.b;
+    SDL_SetRenderDrawColor(nG_Renderer, color.r, color.g, color.b, color.a);
+}
+
+bool n_SetRenderScale(n_RenderScale opts)
+{
+    if (nG_Ctx != &nG_DefaultContext || !nG_Window) {
+        n_LogWarnf("Render scaling is only available in the main context.\n");
+        return false;
+    }
+
+    bool off = opts.width <= 0 && opts.scale >= 1.0f && !opts.dynamic;
+
+    if (!off && !SDL_RenderTargetSupported(nG_Renderer)) {
+        n_LogWarnf("The renderer doesn't support render targets.\n");
+        return false;
+    }
+
+    if (opts.width > 0 && opts.height <= 0) {
+        n_LogErrorf("Invalid render scaling size: %dx%d.\n", opts.width, opts.height);
+        return false;
+    }
+
+    if (off) {
+        SDL_SetRenderTarget(nG_Renderer, NULL);
+        n_DeleteTexture(&nG_ScaleTarget);
+        nG_Ctx->scaledWidth  = 0;
+        nG_Ctx->scaledHeight = 0;
+        nG_Ctx->ppmScale     = 1.0f;
+        n_InvalidateScreen();
+        return true;
+    }
+
+    opts.scale    = SDL_clamp(opts.scale, 0.05f, 1.0f);
+    opts.minScale = SDL_clamp(opts.minScale, 0.05f, opts.scale);
+
+    nG_ScaleOpts       = opts;
+    nG_ScaleCurr       = opts.scale;
+    nG_ScaleWait       = nG_SCALE_INTERVAL;
+    nG_ScaleStats      = (n_RenderScaleStats) { 0 };
+    nG_ScaleFrameStart = SDL_GetPerformanceCounter();
+
+    return nG_ResizeScaleTarget();
+}
+
+n_RenderScaleStats n_GetRenderScaleStats(void)
+{
+    n_RenderScaleStats st = nG_ScaleStats;
+
+    st.scale  = nG_ScaleTarget && nG_ScaleOpts.width <= 0 ? nG_ScaleCurr : 1.0f;
+    st.width  = nG_ScaleTarget ? nG_Ctx->scaledWidth : 0;
+    st.height = nG_ScaleTarget ? nG_Ctx->scaledHeight : 0;
+    return st;
+}
+
+SDL_Rect n_Unproject(const n_Camera *restrict cam, const n_Rect *restrict r)
+{
+    SDL_Rect out = SDL_Rect();
+
+    if (cam && n_IsValidRect(r)) {
+        float ppm = nG_PPM;
+        float cx  = cam->x;
+        float cy  = cam->y;
+        float z   = cam->zoom;
+        int   h   = Int(z * r->h * ppm);
+        int   maxH = nG_ScreenHeight();
+
+        out.x =        Int(z * ppm * (r->x + cx));
+        out.y = maxH - Int(z * ppm * (r->y + cy)) - h;
+        out.w = Int(cam->zoom * r->w * ppm);
+        out.h = h;
+    }
+
+    return out;
+}
+
+
+// ========================================================
+//
+// DEBUG DRAW
+//
+// ========================================================
+
+
+#ifndef nG_NO_DEBUG_DRAW
+
+
+struct nG_DebugQueue {
+    SDL_Vertex* vertices;
+    int*        indices;
+    int         nVertices;
+    int         nIndices;
+    int         cap;
+};
+
+
+// Only valid once nG_DebugReserve() succeeded.
+#define nG_DebugVertices  (nG_Ctx->debug->vertices)
+#define nG_DebugIndices   (nG_Ctx->debug->indices)
+#define nG_DebugNVertices (nG_Ctx->debug->nVertices)
+#define nG_DebugNIndices  (nG_Ctx->debug->nIndices)
+#define nG_DebugCap       (nG_Ctx->debug->cap)
+
+
+static SDL_FPoint nG_DebugPoint(const n_Camera *restrict cam, n_Vec2 p)
+{
+    float s = cam->zoom * nG_PPM;
+
+    return (SDL_FPoint) {s * (p.x + cam->x), nG_ScreenHeight() - s * (p.y + cam->y)};
+}
+
+// Room for <nv> vertices and 3 / 2 as many indices, or NULL.
+static SDL_Vertex* nG_DebugReserve(int nv)
+{
+    if (!nG_Ctx->debug) {
+        nG_Ctx->debug = n_NewTagged(nG_DebugQueue, 1, n_AllocTag_Engine);
+
+        if (!nG_Ctx->debug) {
+            return NULL;
+        }
+    }
+
+    int need = nG_DebugNVertices + nv;
+
+    if (need > nG_DebugCap) {
+        int         cap = SDL_max(2 * nG_DebugCap, SDL_max(need, 1024));
+        SDL_Vertex* v = n_ResizeTagged(nG_DebugVertices, SDL_Vertex, cap, n_AllocTag_Engine);
+        int*        i = v ? n_ResizeTagged(nG_DebugIndices, int, 3 * cap / 2, n_AllocTag_Engine) : NULL;
+
+        if (v) {
+            nG_DebugVertices = v;
+        }
+        if (!i) {
+            return NULL;
+        }
+        nG_DebugIndices = i;
+        nG_DebugCap = cap;
+    }
+
+    return &nG_DebugVertices[nG_DebugNVertices];
+}
+
+// Two triangles, from <a> to <d> going around the quad.
+static void nG_DebugQuad(SDL_FPoint a, SDL_FPoint b, SDL_FPoint c, SDL_FPoint d, SDL_Color color)
+{
+    SDL_Vertex* v = nG_DebugReserve(4);
+
+    if (!v) {
+        return;
+    }
+
+    int  base = nG_DebugNVertices;
+    int* i    = &nG_DebugIndices[nG_DebugNIndices];
+
+    v[0] = (SDL_Vertex) {a, color, {0.0f, 0.0f}};
+    v[1] = (SDL_Vertex) {b, color, {0.0f, 0.0f}};
+    v[2] = (SDL_Vertex) {c, color, {0.0f, 0.0f}};
+    v[3] = (SDL_Vertex) {d, color, {0.0f, 0.0f}};
+    i[0] = base;
+    i[1] = base + 1;
+    i[2] = base + 2;
+    i[3] = base;
+    i[4] = base + 2;
+    i[5] = base + 3;
+
+    nG_DebugNVertices += 4;
+    nG_DebugNIndices  += 6;
+}
+
+// Top left and bottom right corners, in screen space.
+static void nG_DebugBox(float x0, float y0, float x1, float y1, SDL_Color color)
+{
+    nG_DebugQuad(
+        (SDL_FPoint) {x0, y0},
+        (SDL_FPoint) {x1, y0},
+        (SDL_FPoint) {x1, y1},
+        (SDL_FPoint) {x0, y1},
+        color
+    );
+}
+
+// A 1 pixel wide line, in screen space.
+static void nG_DebugSegment(SDL_FPoint a, SDL_FPoint b, SDL_Color color)
+{
+    float dx  = b.x - a.x;
+    float dy  = b.y - a.y;
+    float len = sqrtf(dx * dx + dy * dy);
+
+    if (len < 1e-3f) {
+        dx  = 1.0f;
+        dy  = 0.0f;
+        len = 1.0f;
+    }
+
+    float nx = -0.5f * dy / len;
+    float ny =  0.5f * dx / len;
+
+    nG_DebugQuad(
+        (SDL_FPoint) {a.x + nx, a.y + ny},
+        (SDL_FPoint) {b.x + nx, b.y + ny},
+        (SDL_FPoint) {b.x - nx, b.y - ny},
+        (SDL_FPoint) {a.x - nx, a.y - ny},
+        color
+    );
+}
+
+void n_DebugRect(const n_Camera *restrict cam, const n_Rect *restrict rect, SDL_Color color)
+{
+    if (!cam || !rect) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordDebugShape(nG_SceneItem_DebugRect, *rect, color);
+        return;
+    }
+
+    SDL_FPoint a = nG_DebugPoint(cam, n_Vec2(.x = rect->x, .y = rect->y + rect->h));
+    SDL_FPoint b = nG_DebugPoint(cam, n_Vec2(.x = rect->x + rect->w, .y = rect->y));
+
+    // inside the rect, like SDL_RenderDrawRect()
+    nG_DebugBox(a.x, a.y, b.x, a.y + 1.0f, color);
+    nG_DebugBox(a.x, b.y - 1.0f, b.x, b.y, color);
+    nG_DebugBox(a.x, a.y + 1.0f, a.x + 1.0f, b.y - 1.0f, color);
+    nG_DebugBox(b.x - 1.0f, a.y + 1.0f, b.x, b.y - 1.0f, color);
+}
+
+void n_DebugFilledRect(const n_Camera *restrict cam, const n_Rect *restrict rect, SDL_Color color)
+{
+    if (!cam || !rect) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordDebugShape(nG_SceneItem_DebugFill, *rect, color);
+        return;
+    }
+
+    SDL_FPoint a = nG_DebugPoint(cam, n_Vec2(.x = rect->x, .y = rect->y + rect->h));
+    SDL_FPoint b = nG_DebugPoint(cam, n_Vec2(.x = rect->x + rect->w, .y = rect->y));
+
+    nG_DebugBox(a.x, a.y, b.x, b.y, color);
+}
+
+void n_DebugLine(const n_Camera *restrict cam, n_Vec2 from, n_Vec2 to, SDL_Color color)
+{
+    if (!cam) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordDebugShape(nG_SceneItem_DebugLine, n_Rect(.x = from.x, .y = from.y, .w = to.x, .h = to.y), color);
+        return;
+    }
+
+    nG_DebugSegment(nG_DebugPoint(cam, from), nG_DebugPoint(cam, to), color);
+}
+
+void n_DebugCircle(const n_Camera *restrict cam, n_Vec2 center, float radius, SDL_Color color)
+{
+    if (!cam || radius <= 0.0f) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordDebugShape(nG_SceneItem_DebugCircle, n_Rect(.x = center.x, .y = center.y, .w = radius), color);
+        return;
+    }
+
+    SDL_FPoint c  = nG_DebugPoint(cam, center);
+    float      r  = radius * cam->zoom * nG_PPM;
+    // about 8 pixels per segment
+    int        n  = SDL_max(12, SDL_min(128, Int(r)));
+    float      da = 2.0f * Float(M_PI) / n;
+    SDL_FPoint p  = {c.x + r, c.y};
+
+    for (int k = 1; k <= n; k++) {
+        SDL_FPoint q = {c.x + r * cosf(k * da), c.y + r * sinf(k * da)};
+
+        nG_DebugSegment(p, q, color);
+        p = q;
+    }
+}
+
+void n_DebugArrow(const n_Camera *restrict cam, n_Vec2 from, n_Vec2 to, SDL_Color color)
+{
+    if (!cam) {
+        return;
+    }
+
+    if (nG_Scene) {
+        nG_RecordDebugShape(nG_SceneItem_DebugArrow, n_Rect(.x = from.x, .y = from.y, .w = to.x, .h = to.y), color);
+        return;
+    }
+
+    SDL_FPoint a   = nG_DebugPoint(cam, from);
+    SDL_FPoint b   = nG_DebugPoint(cam, to);
+    float      dx  = b.x - a.x;
+    float      dy  = b.y - a.y;
+    float      len = sqrtf(dx * dx + dy * dy);
+
+    nG_DebugSegment(a, b, color);
+
+    if (len < 1.0f) {
+        return;
+    }
+
+    // a head a quarter as long as the arrow, up to 12 pixels
+    float head = SDL_min(12.0f, 0.25f * len) / len;
+    float hx   = -dx * head;
+    float hy   = -dy * head;
+
+    nG_DebugSegment(b, (SDL_FPoint) {b.x + hx - 0.5f * hy, b.y + hy + 0.5f * hx}, color);
+    nG_DebugSegment(b, (SDL_FPoint) {b.x + hx + 0.5f * hy, b.y + hy - 0.5f * hx}, color);
+}
+
+void n_FlushDebugDraw(void)
+{
+    if (!nG_Ctx->debug || nG_DebugNVertices == 0) {
+        return;
+    }
+
+    // the shapes aren't tracked by the dirty rects: redraw everything
+    // under them in the next frame
+    n_InvalidateScreen();
+
+    SDL_BlendMode mode;
+
+    SDL_GetRenderDrawBlendMode(nG_Renderer, &mode);
+    SDL_SetRenderDrawBlendMode(nG_Renderer, SDL_BLENDMODE_BLEND);
+    SDL_RenderGeometry(nG_Renderer, NULL, nG_DebugVertices, nG_DebugNVertices, nG_DebugIndices, nG_DebugNIndices);
+    SDL_SetRenderDrawBlendMode(nG_Renderer, mode);
+
+    nG_DebugNVertices = 0;
+    nG_DebugNIndices  = 0;
+}
+
+static void nG_DeleteDebugQueue(nG_DebugQueue** queue)
+{
+    if (queue && *queue) {
+        n_Delete((*queue)->vertices);
+        n_Delete((*queue)->indices);
+        n_Delete(*queue);
+    }
+}
+
+
+#endif // !nG_NO_DEBUG_DRAW
+
+
+// ========================================================
+//
+// TRANSFORMS
+//
+// ========================================================
+
+
+// handles are gen << 20 | (index + 1)
+#define nG_TransformIndexBits 20
+#define nG_TransformIndexMask ((UInt32(1) << nG_TransformIndexBits) - 1)
+#define nG_TransformGenMask   0xFFF
+#define nG_TransformNone      UINT32_MAX
+
+enum {
+    nG_Transform_Dirty   = 1,
+    nG_Transform_Removed = 1 << 1,
+    nG_Transform_Bound   = 1 << 2
+};
+
+
+// Slot of a live node, or nG_TransformNone.
+static uint32_t nG_TransformSlot(const n_TransformTree* tree, n_TransformNode node)
+{
+    uint32_t idx = (node & nG_TransformIndexMask) - 1;
+
+    if (node == 0 || idx >= tree->nIds || tree->gens[idx] != (node >> nG_TransformIndexBits)) {
+        return nG_TransformNone;
+    }
+
+    uint32_t slot = tree->slots[idx];
+    if (slot == nG_TransformNone || (tree->flags[slot] & nG_Transform_Removed)) {
+        return nG_TransformNone;
+    }
+    return slot;
+}
+
+static inline void nG_MarkTransformDirty(n_TransformTree* tree, uint32_t slot)
+{
+    tree->flags[slot] |= nG_Transform_Dirty;
+    if (slot < tree->firstDirty) {
+        tree->firstDirty = slot;
+    }
+}
+
+static n_Transform nG_ComposeTransforms(const n_Transform* parent, const n_Transform* local)
+{
+    float a = parent->angle * Float(M_PI) / 180.0f;
+    float c = cosf(a) * parent->scale;
+    float s = sinf(a) * parent->scale;
+
+    // clockwise, as the y axis points up
+    return n_Transform(
+        .position = n_Vec2(
+            .x = parent->position.x + c * local->position.x + s * local->position.y,
+            .y = parent->position.y - s * local->position.x + c * local->position.y
+        ),
+        .angle = parent->angle + local->angle,
+        .scale = parent->scale * local->scale
+    );
+}
+
+static n_Rect nG_TransformRect(const n_Transform* world, const n_Rect* local)
+{
+    n_Transform center = n_Transform(
+        .position = n_Vec2(.x = local->x + 0.5f * local->w, .y = local->y + 0.5f * local->h)
+    );
+    n_Transform t = nG_ComposeTransforms(world, &center);
+    float       w = local->w * world->scale;
+    float       h = local->h * world->scale;
+
+    return n_Rect(.x = t.position.x - 0.5f * w, .y = t.position.y - 0.5f * h, .w = w, .h = h);
+}
+
+static bool nG_GrowTransformTree(n_TransformTree* tree, uint32_t cap)
+{
+    #define nG_Grow(field, T) {                                                \
+        T* p = n_ResizeTagged(tree->field, T, cap, n_AllocTag_Engine);         \
+        if (!p) {                                                              \
+            return false;                                                      \
+        }                                                                      \
+        tree->field = p;                                                       \
+    }
+
+    nG_Grow(local, n_Transform);
+    nG_Grow(world, n_Transform);
+    nG_Grow(parent, uint32_t);
+    nG_Grow(stamp, uint32_t);
+    nG_Grow(flags, uint8_t);
+    nG_Grow(bindLocal, n_Rect);
+    nG_Grow(bindDest, n_Rect*);
+    nG_Grow(bindAngle, float*);
+    nG_Grow(ids, uint32_t);
+    nG_Grow(slots, uint32_t);
+    nG_Grow(gens, uint16_t);
+    nG_Grow(free, uint32_t);
+
+    #undef nG_Grow
+
+    // big enough to hold any of the slot arrays while they're sorted
+    void* scratch = n_ResizeTagged(tree->scratch, n_Transform, cap, n_AllocTag_Engine);
+    if (!scratch) {
+        return false;
+    }
+    tree->scratch = scratch;
+    tree->capacity = cap;
+    return true;
+}
+
+n_TransformTree* n_NewTransformTree(uint32_t capacity)
+{
+    n_TransformTree* tree = n_NewTagged(n_TransformTree, 1, n_AllocTag_Engine);
+
+    if (!tree) {
+        return NULL;
+    }
+
+    tree->firstDirty = nG_TransformNone;
+    if (!nG_GrowTransformTree(tree, capacity ? capacity : 64)) {
+        n_LogErrorf("Unable to allocate the transform tree.\n");
+        n_DeleteTransformTree(&tree);
+    }
+    return tree;
+}
+
+void n_DeleteTransformTree(n_TransformTree** tree)
+{
+    if (tree && *tree) {
+        n_Delete((*tree)->local);
+        n_Delete((*tree)->world);
+        n_Delete((*tree)->parent);
+        n_Delete((*tree)->stamp);
+        n_Delete((*tree)->flags);
+        n_Delete((*tree)->bindLocal);
+        n_Delete((*tree)->bindDest);
+        n_Delete((*tree)->bindAngle);
+        n_Delete((*tree)->ids);
+        n_Delete((*tree)->slots);
+        n_Delete((*tree)->gens);
+        n_Delete((*tree)->free);
+        n_Delete((*tree)->scratch);
+        n_Delete(*tree);
+    }
+}
+
+n_TransformNode n_AddTransform(n_TransformTree* tree, n_TransformNode parent, n_Transform local)
+{
+    uint32_t p = nG_TransformNone;
+
+    if (parent != 0 && (p = nG_TransformSlot(tree, parent)) == nG_TransformNone) {
+        return 0;
+    }
+
+    if (tree->count == tree->capacity) {
+        if (tree->capacity > nG_TransformIndexMask / 2 || !nG_GrowTransformTree(tree, 2 * tree->capacity)) {
+            n_LogErrorf("Unable to grow the transform tree.\n");
+            return 0;
+        }
+    }
+
+    uint32_t idx;
+    uint32_t slot = tree->count++;
+
+    if (tree->nFree > 0) {
+        idx = tree->free[--tree->nFree];
+    } else {
+        idx = tree->nIds++;
+        tree->gens[idx] = 0;
+    }
+
+    // appending keeps the order: the parent is already in
+    tree->local[slot]     = local;
+    tree->world[slot]     = local;
+    tree->parent[slot]    = p;
+    tree->stamp[slot]     = 0;
+    tree->flags[slot]     = 0;
+    tree->bindDest[slot]  = NULL;
+    tree->bindAngle[slot] = NULL;
+    tree->ids[slot]       = idx;
+    tree->slots[idx]      = slot;
+    nG_MarkTransformDirty(tree, slot);
+
+    return (UInt32(tree->gens[idx]) << nG_TransformIndexBits) | (idx + 1);
+}
+
+void n_RemoveTransform(n_TransformTree* tree, n_TransformNode node)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+
+    // the descendants go when the arrays are compacted
+    if (slot != nG_TransformNone) {
+        tree->flags[slot] |= nG_Transform_Removed;
+        tree->unsorted = true;
+    }
+}
+
+bool n_SetTransformParent(n_TransformTree* tree, n_TransformNode node, n_TransformNode parent)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+    uint32_t p = (parent == 0) ? nG_TransformNone : nG_TransformSlot(tree, parent);
+
+    if (slot == nG_TransformNone || (parent != 0 && p == nG_TransformNone)) {
+        return false;
+    }
+
+    for (uint32_t a = p; a != nG_TransformNone; a = tree->parent[a]) {
+        if (a == slot) {
+            return false;
+        }
+    }
+
+    tree->parent[slot] = p;
+    nG_MarkTransformDirty(tree, slot);
+    if (p != nG_TransformNone && p > slot) {
+        tree->unsorted = true;
+    }
+    return true;
+}
+
+void n_SetTransform(n_TransformTree* tree, n_TransformNode node, n_Transform local)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+
+    if (slot != nG_TransformNone) {
+        tree->local[slot] = local;
+        nG_MarkTransformDirty(tree, slot);
+    }
+}
+
+n_Transform n_GetTransform(const n_TransformTree* tree, n_TransformNode node)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+    return (slot != nG_TransformNone) ? tree->local[slot] : n_Transform();
+}
+
+n_Transform n_GetWorldTransform(const n_TransformTree* tree, n_TransformNode node)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+    return (slot != nG_TransformNone) ? tree->world[slot] : n_Transform();
+}
+
+n_Vec2 n_TransformPoint(const n_TransformTree* tree, n_TransformNode node, n_Vec2 local)
+{
+    n_Transform world = n_GetWorldTransform(tree, node);
+    n_Transform t = n_Transform(.position = local);
+
+    return nG_ComposeTransforms(&world, &t).position;
+}
+
+n_Rect n_TransformRect(const n_TransformTree* tree, n_TransformNode node, n_Rect local, float* angle)
+{
+    n_Transform world = n_GetWorldTransform(tree, node);
+
+    if (angle) {
+        *angle = world.angle;
+    }
+    return nG_TransformRect(&world, &local);
+}
+
+void n_BindTransform(n_TransformTree* tree, n_TransformNode node, n_Rect local, n_Rect* dest, float* angle)
+{
+    uint32_t slot = nG_TransformSlot(tree, node);
+
+    if (slot == nG_TransformNone) {
+        return;
+    }
+
+    tree->bindLocal[slot] = local;
+    tree->bindDest[slot]  = dest;
+    tree->bindAngle[slot] = angle;
+    tree->flags[slot] = dest ? (tree->flags[slot] | nG_Transform_Bound) : (tree->flags[slot] & ~nG_Transform_Bound);
+    nG_MarkTransformDirty(tree, slot);
+}
+
+// Drops the removed nodes (and their descendants) and sorts the rest
+// by depth again, after reparenting broke the order.
+static void nG_RebuildTransforms(n_TransformTree* tree)
+{
+    uint32_t  n = tree->count;
+    uint32_t* depth = tree->stamp;
+    uint32_t* order = tree->free + tree->nFree;
+    uint32_t  maxDepth = 0;
+    uint32_t  kept = 0;
+
+    // depth by walking up (a removed ancestor removes the node); the
+    // stamps are reused as storage and reset below
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t d = 0;
+        bool     removed = false;
+
+        for (uint32_t a = i; a != nG_TransformNone; a = tree->parent[a]) {
+            removed = removed || (tree->flags[a] & nG_Transform_Removed);
+            d++;
+        }
+        if (removed) {
+            tree->flags[i] |= nG_Transform_Removed;
+        }
+        depth[i] = d;
+        maxDepth = (d > maxDepth) ? d : maxDepth;
+    }
+
+    // stable sort of the kept slots by depth, into the spare end of
+    // the free list (there's room: count + nFree <= capacity)
+    for (uint32_t d = 1; d <= maxDepth; d++) {
+        for (uint32_t i = 0; i < n; i++) {
+            if (depth[i] == d && !(tree->flags[i] & nG_Transform_Removed)) {
+                order[kept++] = i;
+            }
+        }
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t idx = tree->ids[i];
+        if (tree->flags[i] & nG_Transform_Removed) {
+            tree->gens[idx] = UInt16((tree->gens[idx] + 1) & nG_TransformGenMask);
+            tree->slots[idx] = nG_TransformNone;
+        }
+    }
+
+    // the new slot of every kept node, through its handle index
+    for (uint32_t k = 0; k < kept; k++) {
+        tree->slots[tree->ids[order[k]]] = k;
+    }
+
+    #define nG_Permute(field, T) {                     \
+        T* tmp = (T *) tree->scratch;                  \
+        for (uint32_t k = 0; k < kept; k++) {          \
+            tmp[k] = tree->field[order[k]];            \
+        }                                              \
+        memcpy(tree->field, tmp, kept * sizeof(T));    \
+    }
+
+    // parents become new slots before they're moved
+    for (uint32_t k = 0; k < kept; k++) {
+        uint32_t p = tree->parent[order[k]];
+        ((uint32_t *) tree->scratch)[k] = (p == nG_TransformNone) ? p : tree->slots[tree->ids[p]];
+    }
+    memcpy(tree->parent, tree->scratch, kept * sizeof(uint32_t));
+
+    nG_Permute(local, n_Transform);
+    nG_Permute(world, n_Transform);
+    nG_Permute(flags, uint8_t);
+    nG_Permute(bindLocal, n_Rect);
+    nG_Permute(bindDest, n_Rect*);
+    nG_Permute(bindAngle, float*);
+
+    // freed handles go after the order buffer is no longer needed
+    uint32_t* ids = (uint32_t *) tree->scratch;
+    for (uint32_t i = 0; i < n; i++) {
+        ids[i] = tree->ids[i];
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (tree->slots[ids[i]] == nG_TransformNone) {
+            tree->free[tree->nFree++] = ids[i];
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        if (tree->slots[ids[i]] != nG_TransformNone) {
+            tree->ids[tree->slots[ids[i]]] = ids[i];
+        }
+    }
+
+    #undef nG_Permute
+
+    tree->count = kept;
+    tree->unsorted = false;
+    tree->firstDirty = nG_TransformNone;
+    for (uint32_t k = 0; k < kept; k++) {
+        tree->stamp[k] = 0;
+        if (tree->flags[k] & nG_Transform_Dirty) {
+            tree->firstDirty = (k < tree->firstDirty) ? k : tree->firstDirty;
+        }
+    }
+}
+
+void n_UpdateTransforms(n_TransformTree* tree)
+{
+    if (tree->unsorted) {
+        nG_RebuildTransforms(tree);
+    }
+    if (tree->firstDirty >= tree->count) {
+        return;
+    }
+
+    uint32_t frame = ++tree->frame;
+
+    for (uint32_t i = tree->firstDirty; i < tree->count; i++) {
+        uint32_t p = tree->parent[i];
+
+        if (!(tree->flags[i] & nG_Transform_Dirty) && (p == nG_TransformNone || tree->stamp[p] != frame)) {
+            continue;
+        }
+
+        tree->world[i] = (p == nG_TransformNone)
+            ? tree->local[i]
+            : nG_ComposeTransforms(&tree->world[p], &tree->local[i]);
+        tree->stamp[i] = frame;
+        tree->flags[i] &= ~nG_Transform_Dirty;
+
+        if (tree->flags[i] & nG_Transform_Bound) {
+            *tree->bindDest[i] = nG_TransformRect(&tree->world[i], &tree->bindLocal[i]);
+            if (tree->bindAngle[i]) {
+                *tree->bindAngle[i] = tree->world[i].angle;
+            }
+        }
+    }
+
+    tree->firstDirty = nG_TransformNone;
+}
+
+
+// ========================================================
+//
+// PARTICLES
+//
+// ========================================================
+
+
+enum {
+    nG_ParticleAttr_X,
+    nG_ParticleAttr_Y,
+    nG_ParticleAttr_VX,
+    nG_ParticleAttr_VY,
+    nG_ParticleAttr_Life,
+    nG_ParticleAttr_Size,
+    nG_ParticleAttr_R,
+    nG_ParticleAttr_G,
+    nG_ParticleAttr_B,
+    nG_ParticleAttr_A,
+    nG_ParticleAttr_DR,
+    nG_ParticleAttr_DG,
+    nG_ParticleAttr_DB,
+    nG_ParticleAttr_DA,
+    nG_ParticleAttr_Count
+};
+
+
+// dst[i] += k * src[i]
+static void nG_AddScaled(float *restrict dst, const float *restrict src, float k, uint32_t n)
+{
+    uint32_t i = 0;
+
+#ifdef nG_SIMD_SSE
+    __m128 vk = _mm_set1_ps(k);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_loadu_ps(dst + i);
+        __m128 s = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, vk)));
+    }
+#endif // nG_SIMD_SSE
+
+    for (; i < n; i++) {
+        dst[i] += k * src[i];
+    }
+}
+
+// dst[i] += k
+static void nG_AddConstant(float *restrict dst, float k, uint32_t n)
+{
+    uint32_t i = 0;
+
+#ifdef nG_SIMD_SSE
+    __m128 vk = _mm_set1_ps(k);
+
+    for (; i + 4 <= n; i += 4) {
+        _mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), vk));
+    }
+#endif // nG_SIMD_SSE
+
+    for (; i < n; i++) {
+        dst[i] += k;
+    }
+}
+
+static inline uint8_t nG_UnitToByte(float v)
+{
+    return v <= 0.0f ? 0 : (v >= 1.0f ? 0xFF : UInt8(v * 255.0f + 0.5f));
+}
+
+
+// The raster backend draws each particle (whose quad is always axis
+// aligned) as a fill or as a scaled copy modulated by its color.
+static void nG_RasterParticles(const n_ParticleEmitter *restrict e)
+{
+    nG_RasterImage img;
+    bool           hasImg = nG_GetRasterImage(e->tex, &img);
+    SDL_Rect       src    = SDL_Rect();
+
+    if (hasImg) {
+        src = SDL_Rect(
+            .x = Int(e->uv0.x * img.w + 0.5f),
+            .y = Int(e->uv0.y * img.h + 0.5f),
+            .w = Int((e->uv1.x - e->uv0.x) * img.w + 0.5f),
+            .h = Int((e->uv1.y - e->uv0.y) * img.h + 0.5f)
+        );
+    }
+
+    for (uint32_t i = 0; i < e->count; i++) {
+        const SDL_Vertex* v     = &e->vertices[4 * i];
+        SDL_Color         c     = v[0].color;
+        uint32_t          color = (UInt32(c.a) << 24) | (c.r << 16) | (c.g << 8) | c.b;
+        SDL_Rect          d     = SDL_Rect(
+            .x = Int(floorf(v[0].position.x)),
+            .y = Int(floorf(v[0].position.y)),
+            .w = Int(v[2].position.x - v[0].position.x + 0.5f),
+            .h = Int(v[2].position.y - v[0].position.y + 0.5f)
+        );
+
+        if (d.w <= 0 || d.h <= 0) {
+            continue;
+        }
+
+        if (e->tex) {
+            nG_RasterTexture(e->tex, &src, &d, 0.0f, SDL_FLIP_NONE, color);
+        } else {
+            nG_RasterFill(&d, color, true);
+        }
+    }
+}
+
+void n_DeleteParticleEmitter(n_ParticleEmitter** e)
+{
+    if (e && *e) {
+        n_Delete((*e)->data);
+        n_Delete((*e)->vertices);
+        n_Delete((*e)->indices);
+        n_Delete(*e);
+    }
+}
+
+void n_DrawParticles(const n_Camera *restrict cam, n_ParticleEmitter *restrict e)
+{
+    if (!cam || !e) {
+        return;
+    }
+
+    if (nG_Scene) {
+        // drawn with the particles alive then
+        nG_SceneItem* it = nG_RecordSceneItem(nG_SceneItem_Particles, NULL, NULL, NULL, 0.0f, SDL_FLIP_NONE);
+
+        if (it) {
+            it->data = e;
+        }
+        return;
+    }
+
+    if (e->count == 0) {
+        return;
+    }
+
+    float       k    = cam->zoom * nG_PPM;
+    float       cx   = cam->x;
+    float       cy   = cam->y;
+    SDL_FPoint  uv0  = e->uv0;
+    SDL_FPoint  uv1  = e->uv1;
+    SDL_Vertex* v    = e->vertices;
+    int         maxH = nG_ScreenHeight();
+
+    for (uint32_t i = 0; i < e->count; i++, v += 4) {
+        float     half = 0.5f * k * e->size[i];
+        float     sx   = k * (e->x[i] + cx);
+        float     sy   = maxH - k * (e->y[i] + cy);
+        SDL_Color c    = {
+            nG_UnitToByte(e->r[i]),
+            nG_UnitToByte(e->g[i]),
+            nG_UnitToByte(e->b[i]),
+            nG_UnitToByte(e->a[i])
+        };
+
+        v[0] = (SDL_Vertex) {{sx - half, sy - half}, c, {uv0.x, uv0.y}};
+        v[1] = (SDL_Vertex) {{sx + half, sy - half}, c, {uv1.x, uv0.y}};
+        v[2] = (SDL_Vertex) {{sx + half, sy + half}, c, {uv1.x, uv1.y}};
+        v[3] = (SDL_Vertex) {{sx - half, sy + half}, c, {uv0.x, uv1.y}};
+    }
+
+    if (nG_Backend == n_RenderBackend_Raster) {
+        nG_RasterParticles(e);
+        return;
+    }
+
+    if (nG_IsRecording()) {
+        nG_DirtyGeometry(e->tex, e->vertices, Int(e->count * 4), e->indices, Int(e->count * 6));
+        return;
+    }
+
+    // untextured particles fade through their alpha, so they're
+    // blended regardless of the draw blend mode.
+    SDL_BlendMode mode;
+
+    SDL_GetRenderDrawBlendMode(nG_Renderer, &mode);
+    SDL_SetRenderDrawBlendMode(nG_Renderer, SDL_BLENDMODE_BLEND);
+
+    SDL_RenderGeometry(
+        nG_Renderer,
+        e->tex,
+        e->vertices,
+        Int(e->count * 4),
+        e->indices,
+        Int(e->count * 6)
+    );
+
+    SDL_SetRenderDrawBlendMode(nG_Renderer, mode);
+}
+
+bool n_EmitParticle(
+    n_ParticleEmitter *restrict e,
+    n_Vec2    position,
+    n_Vec2    velocity,
+    float     life,
+    float     size,
+    SDL_Color start,
+    SDL_Color end
+) {
+    if (!e || e->count >= e->capacity || life <= 0.0f) {
+        return false;
+    }
+
+    uint32_t i   = e->count++;
+    float    inv = 1.0f / (255.0f * life);
+
+    e->x[i]    = position.x;
+    e->y[i]    = position.y;
+    e->vx[i]   = velocity.x;
+    e->vy[i]   = velocity.y;
+    e->life[i] = life;
+    e->size[i] = size;
+    e->r[i]    = start.r / 255.0f;
+    e->g[i]    = start.g / 255.0f;
+    e->b[i]    = start.b / 255.0f;
+    e->a[i]    = start.a / 255.0f;
+    e->dr[i]   = (end.r - start.r) * inv;
+    e->dg[i]   = (end.g - start.g) * inv;
+    e->db[i]   = (end.b - start.b) * inv;
+    e->da[i]   = (end.a - start.a) * inv;
+
+    return true;
+}
+
+n_ParticleEmitter* n_NewParticleEmitter(
+    uint32_t     capacity,
+    SDL_Texture* tex,
+    const SDL_Rect *restrict src
+) {
+    if (capacity == 0) {
+        n_LogErrorf("Particle emitter with no capacity.\n");
+        return NULL;
+    }
+
+    n_ParticleEmitter* e = n_NewTagged(n_ParticleEmitter, 1, n_AllocTag_Particles);
+
+    if (!e) {
+        return NULL;
+    }
+
+    e->data     = n_NewTagged(float, nG_ParticleAttr_Count * capacity, n_AllocTag_Particles);
+    e->vertices = n_NewTagged(SDL_Vertex, 4 * capacity, n_AllocTag_Particles);
+    e->indices  = n_NewTagged(int, 6 * capacity, n_AllocTag_Particles);
+
+    if (!e->data || !e->vertices || !e->indices) {
+        n_LogErrorf("Unable to allocate %u particles.\n", capacity);
+        n_DeleteParticleEmitter(&e);
+        return NULL;
+    }
+
+    e->x    = e->data + nG_ParticleAttr_X    * capacity;
+    e->y    = e->data + nG_ParticleAttr_Y    * capacity;
+    e->vx   = e->data + nG_ParticleAttr_VX   * capacity;
+    e->vy   = e->data + nG_ParticleAttr_VY   * capacity;
+    e->life = e->data + nG_ParticleAttr_Life * capacity;
+    e->size = e->data + nG_ParticleAttr_Size * capacity;
+    e->r    = e->data + nG_ParticleAttr_R    * capacity;
+    e->g    = e->data + nG_ParticleAttr_G    * capacity;
+    e->b    = e->data + nG_ParticleAttr_B    * capacity;
+    e->a    = e->data + nG_ParticleAttr_A    * capacity;
+    e->dr   = e->data + nG_ParticleAttr_DR   * capacity;
+    e->dg   = e->data + nG_ParticleAttr_DG   * capacity;
+    e->db   = e->data + nG_ParticleAttr_DB   * capacity;
+    e->da   = e->data + nG_ParticleAttr_DA   * capacity;
+
+    // the index buffer never changes: two triangles per quad
+    for (uint32_t q = 0; q < capacity; q++) {
+        int* idx = &e->indices[6 * q];
+        int  v   = Int(4 * q);
+
+        idx[0] = v;
+        idx[1] = v + 1;
+        idx[2] = v + 2;
+        idx[3] = v + 2;
+        idx[4] = v + 3;
+        idx[5] = v;
+    }
+
+    e->tex      = tex;
+    e->uv0      = (SDL_FPoint) {0.0f, 0.0f};
+    e->uv1      = (SDL_FPoint) {1.0f, 1.0f};
+    e->gravity  = n_Vec2();
+    e->count    = 0;
+    e->capacity = capacity;
+
+    int w, h;
+
+    if (tex && src && SDL_QueryTexture(tex, NULL, NULL, &w, &h) == 0) {
+        e->uv0 = (SDL_FPoint) {Float(src->x) / w, Float(src->y) / h};
+        e->uv1 = (SDL_FPoint) {Float(src->x + src->w) / w, Float(src->y + src->h) / h};
+    }
+
+    return e;
+}
+
+void n_UpdateParticles(n_ParticleEmitter *restrict e, float dt)
+{
+    if (!e || e->count == 0) {
+        return;
+    }
+
+    uint32_t n = e->count;
+
+    nG_AddConstant(e->vx, e->gravity.x * dt, n);
+    nG_AddConstant(e->vy, e->gravity.y * dt, n);
+    nG_AddScaled(e->x, e->vx, dt, n);
+    nG_AddScaled(e->y, e->vy, dt, n);
+    nG_AddScaled(e->r, e->dr, dt, n);
+    nG_AddScaled(e->g, e->dg, dt, n);
+    nG_AddScaled(e->b, e->db, dt, n);
+    nG_AddScaled(e->a, e->da, dt, n);
+    nG_AddConstant(e->life, -dt, n);
+
+    // swap-remove: the last live particle takes the place of the
+    // dead one, so the arrays stay packed.
+    uint32_t cap = e->capacity;
+
+    for (uint32_t i = 0; i < n;) {
+        if (e->life[i] > 0.0f) {
+            i++;
+            continue;
+        }
+
+        n--;
+        for (int k = 0; k < nG_ParticleAttr_Count; k++) {
+            e->data[k * cap + i] = e->data[k * cap + n];
+        }
+    }
+
+    e->count = n;
+}
+
+
+// ========================================================
+//
+// PATH GRID
+//
+// ========================================================
+
+
+#define nG_PathNone  UINT32_MAX
+#define nG_PathSqrt2 1.41421356f
+
+
+static const int nG_PathDX[8] = { 1, -1, 0, 0, 1, -1, 1, -1 };
+static const int nG_PathDY[8] = { 0, 0, 1, -1, 1, 1, -1, -1 };
+
+
+static inline bool nG_PathFree(const n_PathGrid* grid, int x, int y)
+{
+    return x >= 0 && y >= 0 && x < grid->width && y < grid->height && !grid->blocked[y * grid->width + x];
+}
+
+// Whether the step (dx, dy) from (x, y) is allowed: diagonals need
+// both of the cells they pass by.
+static inline bool nG_PathCanStep(const n_PathGrid* grid, int x, int y, int dx, int dy)
+{
+    return nG_PathFree(grid, x + dx, y + dy)
+        && (dx == 0 || dy == 0 || (nG_PathFree(grid, x + dx, y) && nG_PathFree(grid, x, y + dy)));
+}
+
+// Indexed binary min-heap over cells, keyed by <key>. <pos> maps a
+// cell to its slot (nG_PathNone when out of the heap), so pushing a
+// cell that's already in only moves it up.
+static void nG_PathHeapUp(uint32_t* heap, uint32_t* pos, const float* key, uint32_t i)
+{
+    uint32_t cell = heap[i];
+
+    while (i > 0) {
+        uint32_t up = (i - 1) / 2;
+        if (key[heap[up]] <= key[cell]) {
+            break;
+        }
+        heap[i] = heap[up];
+        pos[heap[i]] = i;
+        i = up;
+    }
+    heap[i] = cell;
+    pos[cell] = i;
+}
+
+static void nG_PathHeapPush(uint32_t* heap, uint32_t* pos, const float* key, uint32_t* size, uint32_t cell)
+{
+    if (pos[cell] == nG_PathNone) {
+        heap[*size] = cell;
+        pos[cell] = (*size)++;
+    }
+    nG_PathHeapUp(heap, pos, key, pos[cell]);
+}
+
+static uint32_t nG_PathHeapPop(uint32_t* heap, uint32_t* pos, const float* key, uint32_t* size)
+{
+    uint32_t top = heap[0];
+    uint32_t last = heap[--(*size)];
+    uint32_t i = 0;
+
+    pos[top] = nG_PathNone;
+    if (*size == 0) {
+        return top;
+    }
+
+    while (true) {
+        uint32_t l = 2 * i + 1;
+        uint32_t r = l + 1;
+        uint32_t m = l;
+
+        if (l >= *size) {
+            break;
+        }
+        if (r < *size && key[heap[r]] < key[heap[l]]) {
+            m = r;
+        }
+        if (key[last] <= key[heap[m]]) {
+            break;
+        }
+        heap[i] = heap[m];
+        pos[heap[i]] = i;
+        i = m;
+    }
+    heap[i] = last;
+    pos[last] = i;
+    return top;
+}
+
+static inline float nG_PathOctile(int ax, int ay, int bx, int by)
+{
+    int dx = abs(ax - bx);
+    int dy = abs(ay - by);
+
+    return Float(dx + dy) + (nG_PathSqrt2 - 2.0f) * Float(dx < dy ? dx : dy);
+}
+
+
+n_PathGrid* n_NewPathGrid(int width, int height, n_Vec2 origin, float cellSize)
+{
+    if (width <= 0 || height <= 0 || cellSize <= 0.0f) {
+        n_LogErrorf("Invalid path grid size.\n");
+        return NULL;
+    }
+
+    n_PathGrid* grid = n_NewTagged(n_PathGrid, 1, n_AllocTag_Engine);
+    size_t      n = UInt32(width) * UInt32(height);
+
+    if (!grid) {
+        return NULL;
+    }
+
+    grid->width    = width;
+    grid->height   = height;
+    grid->origin   = origin;
+    grid->cellSize = cellSize;
+    grid->blocked  = n_NewTagged(uint8_t, n, n_AllocTag_Engine);
+    grid->g        = n_NewTagged(float, n, n_AllocTag_Engine);
+    grid->f        = n_NewTagged(float, n, n_AllocTag_Engine);
+    grid->parent   = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+    grid->seen     = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+    grid->heap     = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+    grid->heapPos  = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+
+    if (!grid->blocked || !grid->g || !grid->f || !grid->parent || !grid->seen || !grid->heap || !grid->heapPos) {
+        n_LogErrorf("Unable to allocate the path grid.\n");
+        n_DeletePathGrid(&grid);
+        return NULL;
+    }
+
+    memset(grid->heapPos, 0xFF, n * sizeof(uint32_t));
+    return grid;
+}
+
+void n_DeletePathGrid(n_PathGrid** grid)
+{
+    if (grid && *grid) {
+        n_Delete((*grid)->blocked);
+        n_Delete((*grid)->g);
+        n_Delete((*grid)->f);
+        n_Delete((*grid)->parent);
+        n_Delete((*grid)->seen);
+        n_Delete((*grid)->heap);
+        n_Delete((*grid)->heapPos);
+        n_Delete(*grid);
+    }
+}
+
+void n_SetPathCell(n_PathGrid* grid, int x, int y, bool blocked)
+{
+    if (!grid || x < 0 || y < 0 || x >= grid->width || y >= grid->height) {
+        return;
+    }
+
+    uint32_t cell = UInt32(y * grid->width + x);
+    if (grid->blocked[cell] == blocked) {
+        return;
+    }
+
+    grid->blocked[cell] = blocked;
+    grid->changes[grid->version % nG_PATH_CHANGES] = cell;
+    grid->version++;
+}
+
+bool n_IsPathCellBlocked(const n_PathGrid* grid, int x, int y)
+{
+    return !grid || !nG_PathFree(grid, x, y);
+}
+
+bool n_PathCellAt(const n_PathGrid* grid, n_Vec2 p, int* x, int* y)
+{
+    if (!grid || !x || !y) {
+        return false;
+    }
+
+    float fx = floorf((p.x - grid->origin.x) / grid->cellSize);
+    float fy = floorf((p.y - grid->origin.y) / grid->cellSize);
+
+    if (fx < 0.0f || fy < 0.0f || fx >= Float(grid->width) || fy >= Float(grid->height)) {
+        return false;
+    }
+    *x = Int(fx);
+    *y = Int(fy);
+    return true;
+}
+
+n_Vec2 n_PathCellCenter(const n_PathGrid* grid, int x, int y)
+{
+    if (!grid) {
+        return n_Vec2();
+    }
+
+    return n_Vec2(
+        .x = grid->origin.x + (Float(x) + 0.5f) * grid->cellSize,
+        .y = grid->origin.y + (Float(y) + 0.5f) * grid->cellSize
+    );
+}
+
+// Straight jump from (x, y) along (dx, dy): stops at the goal or at a
+// cell with a forced neighbor.
+static bool nG_JumpStraight(const n_PathGrid* grid, int x, int y, int dx, int dy, int gx, int gy, int* jx, int* jy)
+{
+    while (nG_PathFree(grid, x, y)) {
+        if (x == gx && y == gy) {
+            break;
+        }
+        if (dx != 0) {
+            if ((nG_PathFree(grid, x, y - 1) && !nG_PathFree(grid, x - dx, y - 1)) ||
+                (nG_PathFree(grid, x, y + 1) && !nG_PathFree(grid, x - dx, y + 1))) {
+                break;
+            }
+        } else {
+            if ((nG_PathFree(grid, x - 1, y) && !nG_PathFree(grid, x - 1, y - dy)) ||
+                (nG_PathFree(grid, x + 1, y) && !nG_PathFree(grid, x + 1, y - dy))) {
+                break;
+            }
+        }
+        x += dx;
+        y += dy;
+    }
+
+    *jx = x;
+    *jy = y;
+    return nG_PathFree(grid, x, y);
+}
+
+static bool nG_Jump(const n_PathGrid* grid, int x, int y, int dx, int dy, int gx, int gy, int* jx, int* jy)
+{
+    int sx, sy;
+
+    if (dx == 0 || dy == 0) {
+        return nG_JumpStraight(grid, x, y, dx, dy, gx, gy, jx, jy);
+    }
+
+    while (nG_PathFree(grid, x, y)) {
+        if ((x == gx && y == gy)
+            || nG_JumpStraight(grid, x + dx, y, dx, 0, gx, gy, &sx, &sy)
+            || nG_JumpStraight(grid, x, y + dy, 0, dy, gx, gy, &sx, &sy)) {
+            *jx = x;
+            *jy = y;
+            return true;
+        }
+        if (!nG_PathFree(grid, x + dx, y) || !nG_PathFree(grid, x, y + dy)) {
+            return false;
+        }
+        x += dx;
+        y += dy;
+    }
+    return false;
+}
+
+// Directions worth exploring from (x, y) when coming from its parent
+// (all of them at the start). Returns how many were written.
+static int nG_JumpDirections(const n_PathGrid* grid, int x, int y, uint32_t parent, int dirs[8][2])
+{
+    int n = 0;
+
+    if (parent == nG_PathNone) {
+        for (int i = 0; i < 8; i++) {
+            if (nG_PathCanStep(grid, x, y, nG_PathDX[i], nG_PathDY[i])) {
+                dirs[n][0] = nG_PathDX[i];
+                dirs[n][1] = nG_PathDY[i];
+                n++;
+            }
+        }
+        return n;
+    }
+
+    int px = Int(parent % UInt32(grid->width));
+    int py = Int(parent / UInt32(grid->width));
+    int dx = (x > px) - (x < px);
+    int dy = (y > py) - (y < py);
+
+    #define nG_AddDir(a, b) { dirs[n][0] = (a); dirs[n][1] = (b); n++; }
+
+    if (dx != 0 && dy != 0) {
+        bool v = nG_PathFree(grid, x, y + dy);
+        bool h = nG_PathFree(grid, x + dx, y);
+
+        if (v) nG_AddDir(0, dy);
+        if (h) nG_AddDir(dx, 0);
+        if (v && h && nG_PathFree(grid, x + dx, y + dy)) nG_AddDir(dx, dy);
+    } else if (dx != 0) {
+        bool next = nG_PathFree(grid, x + dx, y);
+        bool up   = nG_PathFree(grid, x, y + 1);
+        bool down = nG_PathFree(grid, x, y - 1);
+
+        if (next) {
+            nG_AddDir(dx, 0);
+            if (up && nG_PathFree(grid, x + dx, y + 1))   nG_AddDir(dx, 1);
+            if (down && nG_PathFree(grid, x + dx, y - 1)) nG_AddDir(dx, -1);
+        }
+        if (up)   nG_AddDir(0, 1);
+        if (down) nG_AddDir(0, -1);
+    } else {
+        bool next  = nG_PathFree(grid, x, y + dy);
+        bool right = nG_PathFree(grid, x + 1, y);
+        bool left  = nG_PathFree(grid, x - 1, y);
+
+        if (next) {
+            nG_AddDir(0, dy);
+            if (right && nG_PathFree(grid, x + 1, y + dy)) nG_AddDir(1, dy);
+            if (left && nG_PathFree(grid, x - 1, y + dy))  nG_AddDir(-1, dy);
+        }
+        if (right) nG_AddDir(1, 0);
+        if (left)  nG_AddDir(-1, 0);
+    }
+
+    #undef nG_AddDir
+
+    return n;
+}
+
+int n_FindPath(n_PathGrid* grid, n_Vec2 from, n_Vec2 to, n_Vec2* path, int maxPoints)
+{
+    int sx, sy, gx, gy;
+
+    // n_PathCellAt() fails without a grid
+    if (!n_PathCellAt(grid, from, &sx, &sy) || !n_PathCellAt(grid, to, &gx, &gy) ||
+        !nG_PathFree(grid, sx, sy) || !nG_PathFree(grid, gx, gy)) {
+        return -1;
+    }
+    if (sx == gx && sy == gy) {
+        return 0;
+    }
+
+    uint32_t w = UInt32(grid->width);
+    uint32_t start = UInt32(sy) * w + UInt32(sx);
+    uint32_t goal = UInt32(gy) * w + UInt32(gx);
+
+    // the seen stamps save clearing the buffers on every search; the
+    // low bit tells open from closed
+    grid->search += 2;
+    if (grid->search == 0) {
+        memset(grid->seen, 0, w * UInt32(grid->height) * sizeof(uint32_t));
+        grid->search = 2;
+    }
+    uint32_t open = grid->search;
+    uint32_t closed = grid->search + 1;
+
+    grid->g[start] = 0.0f;
+    grid->f[start] = nG_PathOctile(sx, sy, gx, gy);
+    grid->parent[start] = nG_PathNone;
+    grid->seen[start] = open;
+    grid->heapSize = 0;
+    nG_PathHeapPush(grid->heap, grid->heapPos, grid->f, &grid->heapSize, start);
+
+    bool found = false;
+    while (grid->heapSize > 0) {
+        uint32_t cell = nG_PathHeapPop(grid->heap, grid->heapPos, grid->f, &grid->heapSize);
+        int      x = Int(cell % w);
+        int      y = Int(cell / w);
+        int      dirs[8][2];
+
+        if (cell == goal) {
+            found = true;
+            break;
+        }
+        grid->seen[cell] = closed;
+
+        int nd = nG_JumpDirections(grid, x, y, grid->parent[cell], dirs);
+        for (int i = 0; i < nd; i++) {
+            int jx, jy;
+
+            if (!nG_Jump(grid, x + dirs[i][0], y + dirs[i][1], dirs[i][0], dirs[i][1], gx, gy, &jx, &jy)) {
+                continue;
+            }
+
+            uint32_t next = UInt32(jy) * w + UInt32(jx);
+            float    g = grid->g[cell] + nG_PathOctile(x, y, jx, jy);
+
+            if (grid->seen[next] == closed || (grid->seen[next] == open && g >= grid->g[next])) {
+                continue;
+            }
+            grid->seen[next] = open;
+            grid->g[next] = g;
+            grid->f[next] = g + nG_PathOctile(jx, jy, gx, gy);
+            grid->parent[next] = cell;
+            nG_PathHeapPush(grid->heap, grid->heapPos, grid->f, &grid->heapSize, next);
+        }
+    }
+
+    // leave the heap positions clean for the next search
+    for (uint32_t i = 0; i < grid->heapSize; i++) {
+        grid->heapPos[grid->heap[i]] = nG_PathNone;
+    }
+    grid->heapSize = 0;
+
+    if (!found) {
+        return -1;
+    }
+
+    int count = 0;
+    for (uint32_t c = goal; c != start; c = grid->parent[c]) {
+        count++;
+    }
+
+    int i = count;
+    for (uint32_t c = goal; c != start; c = grid->parent[c]) {
+        i--;
+        if (path && i < maxPoints) {
+            path[i] = (c == goal) ? to : n_PathCellCenter(grid, Int(c % w), Int(c / w));
+        }
+    }
+
+    return count;
+}
+
+n_FlowField* n_NewFlowField(n_PathGrid* grid)
+{
+    if (!grid) {
+        return NULL;
+    }
+
+    n_FlowField* field = n_NewTagged(n_FlowField, 1, n_AllocTag_Engine);
+    size_t       n = UInt32(grid->width) * UInt32(grid->height);
+
+    if (!field) {
+        return NULL;
+    }
+
+    field->grid    = grid;
+    field->target  = nG_PathNone;
+    field->dist    = n_NewTagged(float, n, n_AllocTag_Engine);
+    field->heap    = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+    field->heapPos = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+    field->stack   = n_NewTagged(uint32_t, n, n_AllocTag_Engine);
+
+    if (!field->dist || !field->heap || !field->heapPos || !field->stack) {
+        n_LogErrorf("Unable to allocate the flow field.\n");
+        n_DeleteFlowField(&field);
+        return NULL;
+    }
+
+    memset(field->heapPos, 0xFF, n * sizeof(uint32_t));
+    for (size_t i = 0; i < n; i++) {
+        field->dist[i] = INFINITY;
+    }
+    return field;
+}
+
+void n_DeleteFlowField(n_FlowField** field)
+{
+    if (field && *field) {
+        n_Delete((*field)->dist);
+        n_Delete((*field)->heap);
+        n_Delete((*field)->heapPos);
+        n_Delete((*field)->stack);
+        n_Delete(*field);
+    }
+}
+
+// Dijkstra from whatever is in the heap, only ever lowering distances.
+static void nG_RelaxFlowField(n_FlowField* field)
+{
+    const n_PathGrid* grid = field->grid;
+    uint32_t          w = UInt32(grid->width);
+
+    while (field->heapSize > 0) {
+        uint32_t cell = nG_PathHeapPop(field->heap, field->heapPos, field->dist, &field->heapSize);
+        int      x = Int(cell % w);
+        int      y = Int(cell / w);
+
+        for (int i = 0; i < 8; i++) {
+            int dx = nG_PathDX[i];
+            int dy = nG_PathDY[i];
+
+            if (!nG_PathCanStep(grid, x, y, dx, dy)) {
+                continue;
+            }
+
+            uint32_t next = cell + UInt32(dy * Int(w) + dx);
+            float    d = field->dist[cell] + ((i < 4) ? 1.0f : nG_PathSqrt2);
+
+            if (d < field->dist[next]) {
+                field->dist[next] = d;
+                nG_PathHeapPush(field->heap, field->heapPos, field->dist, &field->heapSize, next);
+            }
+        }
+    }
+}
+
+static void nG_ResetFlowField(n_FlowField* field)
+{
+    size_t n = UInt32(field->grid->width) * UInt32(field->grid->height);
+
+    for (size_t i = 0; i < n; i++) {
+        field->dist[i] = INFINITY;
+    }
+
+    field->version = field->grid->version;
+    if (field->target == nG_PathNone || field->grid->blocked[field->target]) {
+        return;
+    }
+
+    field->dist[field->target] = 0.0f;
+    nG_PathHeapPush(field->heap, field->heapPos, field->dist, &field->heapSize, field->target);
+    nG_RelaxFlowField(field);
+}
+
+bool n_SetFlowTarget(n_FlowField* field, n_Vec2 target)
+{
+    int x, y;
+
+    if (!field) {
+        return false;
+    }
+
+    if (!n_PathCellAt(field->grid, target, &x, &y) || !nG_PathFree(field->grid, x, y)) {
+        field->target = nG_PathNone;
+        nG_ResetFlowField(field);
+        return false;
+    }
+
+    field->target = UInt32(y * field->grid->width + x);
+    field->targetPos = target;
+    nG_ResetFlowField(field);
+    return true;
+}
+
+// Whether <cell>'s distance comes through <from> (one step away).
+static inline bool nG_FlowDependsOn(const n_FlowField* field, uint32_t cell, float fromDist, bool diagonal)
+{
+    float d = fromDist + (diagonal ? nG_PathSqrt2 : 1.0f);
+    return isfinite(field->dist[cell]) && fabsf(field->dist[cell] - d) < 1e-3f;
+}
+
+// A cell got blocked: forgets the distances that went through it (or
+// through a diagonal it now blocks), then recomputes them from the
+// cells around that area.
+static void nG_FlowCellBlocked(n_FlowField* field, uint32_t cell)
+{
+    const n_PathGrid* grid = field->grid;
+    int               w = grid->width;
+    uint32_t          top = 0;
+    uint32_t          n = 0;
+
+    // pairs of orthogonal neighbors of <cell> lose their diagonal
+    for (int i = 0; i < 4; i++) {
+        for (int j = 0; j < 4; j++) {
+            int ax = Int(cell) % w + nG_PathDX[i], ay = Int(cell) / w + nG_PathDY[i];
+            int bx = Int(cell) % w + nG_PathDX[j], by = Int(cell) / w + nG_PathDY[j];
+
+            if ((nG_PathDX[i] != 0) == (nG_PathDX[j] != 0) ||
+                !nG_PathFree(grid, ax, ay) || !nG_PathFree(grid, bx, by)) {
+                continue;
+            }
+
+            uint32_t a = UInt32(ay * w + ax);
+            uint32_t b = UInt32(by * w + bx);
+            if (nG_FlowDependsOn(field, a, field->dist[b], true)) {
+                field->stack[top++] = a;
+                field->dist[a] = -field->dist[a] - 1.0f;
+            }
+        }
+    }
+
+    if (isfinite(field->dist[cell])) {
+        field->stack[top++] = cell;
+        field->dist[cell] = -field->dist[cell] - 1.0f;
+    }
+
+    // the stacked cells hold -(old distance) - 1 until they're done,
+    // which marks them and keeps the value to compare with
+    while (top > 0) {
+        uint32_t c = field->stack[--top];
+        float    old = -field->dist[c] - 1.0f;
+        int      x = Int(c) % w;
+        int      y = Int(c) / w;
+
+        field->dist[c] = INFINITY;
+        field->stack[UInt32(grid->width * grid->height) - 1 - n++] = c;
+
+        for (int i = 0; i < 8; i++) {
+            int nx = x + nG_PathDX[i];
+            int ny = y + nG_PathDY[i];
+
+            if (!nG_PathFree(grid, nx, ny)) {
+                continue;
+            }
+
+            uint32_t next = UInt32(ny * w + nx);
+            if (nG_FlowDependsOn(field, next, old, i >= 4) && field->dist[next] > 0.0f) {
+                field->stack[top++] = next;
+                field->dist[next] = -field->dist[next] - 1.0f;
+            }
+        }
+    }
+
+    // the forgotten cells were moved to the end of the stack buffer;
+    // their settled neighbors seed the search again
+    uint32_t total = UInt32(grid->width * grid->height);
+    for (uint32_t k = 0; k < n; k++) {
+        uint32_t c = field->stack[total - 1 - k];
+        int      x = Int(c) % w;
+        int      y = Int(c) / w;
+
+        for (int i = 0; i < 8; i++) {
+            int nx = x + nG_PathDX[i];
+            int ny = y + nG_PathDY[i];
+
+            if (nG_PathFree(grid, nx, ny) && isfinite(field->dist[ny * w + nx])) {
+                nG_PathHeapPush(field->heap, field->heapPos, field->dist, &field->heapSize, UInt32(ny * w + nx));
+            }
+        }
+    }
+    nG_RelaxFlowField(field);
+}
+
+// A cell got free: it and the diagonals it opens can only shorten
+// distances, so its neighbors are relaxed again.
+static void nG_FlowCellFreed(n_FlowField* field, uint32_t cell)
+{
+    const n_PathGrid* grid = field->grid;
+    int               w = grid->width;
+    int               x = Int(cell) % w;
+    int               y = Int(cell) / w;
+
+    if (cell == field->target) {
+        field->dist[cell] = 0.0f;
+    }
+    if (isfinite(field->dist[cell])) {
+        nG_PathHeapPush(field->heap, field->heapPos, field->dist, &field->heapSize, cell);
+    }
+
+    for (int i = 0; i < 8; i++) {
+        int nx = x + nG_PathDX[i];
+        int ny = y + nG_PathDY[i];
+
+        if (nG_PathFree(grid, nx, ny) && isfinite(field->dist[ny * w + nx])) {
+            nG_PathHeapPush(field->heap, field->heapPos, field->dist, &field->heapSize, UInt32(ny * w + nx));
+        }
+    }
+    nG_RelaxFlowField(field);
+}
+
+void n_UpdateFlowField(n_FlowField* field)
+{
+    if (!field) {
+        return;
+    }
+
+    n_PathGrid* grid = field->grid;
+
+    if (field->version == grid->version) {
+        return;
+    }
+
+    // too far behind (the changes were overwritten) or the target got
+    // blocked: start over
+    if (grid->version - field->version > nG_PATH_CHANGES ||
+        (field->target != nG_PathNone && grid->blocked[field->target])) {
+        nG_ResetFlowField(field);
+        return;
+    }
+
+    for (; field->version != grid->version; field->version++) {
+        uint32_t cell = grid->changes[field->version % nG_PATH_CHANGES];
+
+        if (grid->blocked[cell]) {
+            nG_FlowCellBlocked(field, cell);
+        } else {
+            nG_FlowCellFreed(field, cell);
+        }
+    }
+}
+
+n_Vec2 n_GetFlowDirection(const n_FlowField* field, n_Vec2 pos)
+{
+    int x, y;
+
+    if (!field || !n_PathCellAt(field->grid, pos, &x, &y)) {
+        return n_Vec2();
+    }
+
+    const n_PathGrid* grid = field->grid;
+    uint32_t          cell = UInt32(y * grid->width + x);
+    n_Vec2            to;
+
+    if (cell == field->target) {
+        to = field->targetPos;
+    } else {
+        float best = field->dist[cell];
+        int   dir = -1;
+
+        for (int i = 0; i < 8; i++) {
+            if (!nG_PathCanStep(grid, x, y, nG_PathDX[i], nG_PathDY[i])) {
+                continue;
+            }
+
+            float d = field->dist[Int(cell) + nG_PathDY[i] * grid->width + nG_PathDX[i]];
+            if (d < best) {
+                best = d;
+                dir = i;
+            }
+        }
+
+        if (dir < 0) {
+            return n_Vec2();
+        }
+        to = n_PathCellCenter(grid, x + nG_PathDX[dir], y + nG_PathDY[dir]);
+    }
+
+    float dx = to.x - pos.x;
+    float dy = to.y - pos.y;
+    float len = sqrtf(dx * dx + dy * dy);
+
+    return (len > 0.0f) ? n_Vec2(.x = dx / len, .y = dy / len) : n_Vec2();
+}
+
+float n_GetFlowDistance(const n_FlowField* field, n_Vec2 pos)
+{
+    int x, y;
+
+    if (!field || !n_PathCellAt(field->grid, pos, &x, &y)) {
+        return INFINITY;
+    }
+    return field->dist[y * field->grid->width + x] * field->grid->cellSize;
+}
+
+
+// ========================================================
+//
+// WORLD
+//
+// ========================================================
+
+
+#ifdef nG_POSIX
+    #define nG_WORLD_MMAP 1
+#endif // nG_POSIX
+
+// "NWLD"; files are in the machine's byte order (little endian)
+#define nG_WorldMagic   0x444C574Eu
+#define nG_WorldVersion 1
+
+enum {
+    nG_Chunk_Unloaded,
+    nG_Chunk_Queued,
+    nG_Chunk_Resident
+};
+
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    float    originX;
+    float    originY;
+    float    chunkSize;
+    uint32_t cols;
+    uint32_t rows;
+    uint32_t reserved;
+} nG_WorldHeader;
+
+typedef struct {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t reserved;
+} nG_WorldEntry;
+
+// A chunk back from the loader (NULL data if it was skipped).
+typedef struct {
+    uint32_t index;
+    void*    data;
+} nG_WorldResult;
+
+typedef struct {
+    float    dist;
+    uint32_t index;
+} nG_WorldRequest;
+
+struct n_World {
+    n_WorldOptions   opts;
+    nG_WorldHeader   header;
+    nG_WorldEntry*   entries;
+    uint32_t         nChunks;
+    // per chunk: state (main thread), whether it's still wanted (read by
+    // the loader) and data when resident
+    uint8_t*         state;
+    SDL_atomic_t*    wanted;
+    void**           data;
+    uint32_t*        resident;
+    uint32_t         nResident;
+    nG_WorldRequest* scratch;
+    uint32_t         scratchCap;
+    uint32_t         inflight;
+#ifdef nG_WORLD_MMAP
+    uint8_t*         map;
+    size_t           mapSize;
+#endif // nG_WORLD_MMAP
+    FILE*            file;
+    // main thread -> loader, loader -> main thread
+    uint32_t         requests[nG_WORLD_QUEUE];
+    SDL_atomic_t     reqHead;
+    SDL_atomic_t     reqTail;
+    nG_WorldResult   results[nG_WORLD_QUEUE];
+    SDL_atomic_t     resHead;
+    SDL_atomic_t     resTail;
+    SDL_sem*         sem;
+    SDL_Thread*      thread;
+    SDL_atomic_t     running;
+    SDL_SpinLock     statsLock;
+    n_WorldStats     stats;
+};
+
+
+bool n_WriteWorld(
+    const char *restrict path,
+    n_Vec2               origin,
+    float                chunkSize,
+    int                  cols,
+    int                  rows,
+    const void* const*   chunks,
+    const uint32_t*      sizes
+) {
+    if (cols <= 0 || rows <= 0 || chunkSize <= 0.0f) {
+        return false;
+    }
+
+    FILE* f = fopen(path, "wb");
+
+    if (!f) {
+        n_LogErrorf("Unable to open '%s'.\n", path);
+        return false;
+    }
+
+    uint32_t       n      = UInt32(cols) * UInt32(rows);
+    nG_WorldHeader header = {
+        nG_WorldMagic, nG_WorldVersion, origin.x, origin.y, chunkSize, UInt32(cols), UInt32(rows), 0
+    };
+    uint64_t       offset = sizeof(header) + n * sizeof(nG_WorldEntry);
+    bool           ok     = fwrite(&header, sizeof(header), 1, f) == 1;
+    static const uint8_t zeros[64] = {0};
+
+    for (uint32_t i = 0; ok && i < n; i++) {
+        nG_WorldEntry e = {0, sizes[i], 0};
+
+        if (e.size > 0) {
+            offset   = (offset + nG_WORLD_ALIGN - 1) / nG_WORLD_ALIGN * nG_WORLD_ALIGN;
+            e.offset = offset;
+            offset  += e.size;
+        }
+        ok = fwrite(&e, sizeof(e), 1, f) == 1;
+    }
+
+    offset = sizeof(header) + n * sizeof(nG_WorldEntry);
+    for (uint32_t i = 0; ok && i < n; i++) {
+        if (sizes[i] == 0) {
+            continue;
+        }
+
+        uint64_t at = (offset + nG_WORLD_ALIGN - 1) / nG_WORLD_ALIGN * nG_WORLD_ALIGN;
+
+        for (; ok && offset < at; offset += SDL_min(at - offset, sizeof(zeros))) {
+            ok = fwrite(zeros, SDL_min(at - offset, sizeof(zeros)), 1, f) == 1;
+        }
+        ok = ok && fwrite(chunks[i], sizes[i], 1, f) == 1;
+        offset += sizes[i];
+    }
+
+    ok = (fclose(f) == 0) && ok;
+    if (!ok) {
+        n_LogErrorf("Unable to write the world to '%s'.\n", path);
+    }
+    return ok;
+}
+
+static void* nG_LoadWorldChunk(n_World* w, const nG_WorldEntry* e)
+{
+#ifdef nG_WORLD_MMAP
+    if (w->map) {
+        uint8_t* p     = w->map + e->offset;
+        long     page  = sysconf(_SC_PAGESIZE);
+        uint8_t* start = w->map + (e->offset / page) * page;
+        uint32_t sum   = 0;
+
+        // fault the pages in here rather than on the game thread
+        posix_madvise(start, p + e->size - start, POSIX_MADV_WILLNEED);
+        for (uint32_t i = 0; i < e->size; i += UInt32(page)) {
+            sum += ((volatile uint8_t *) p)[i];
+        }
+        (void) sum;
+        return p;
+    }
+#endif // nG_WORLD_MMAP
+
+    void* buf = n_NewTagged(uint8_t, e->size, n_AllocTag_Engine);
+
+    if (buf && (fseek(w->file, (long) e->offset, SEEK_SET) != 0 || fread(buf, e->size, 1, w->file) != 1)) {
+        n_Delete(buf);
+    }
+    return buf;
+}
+
+static void nG_ReleaseWorldChunk(n_World* w, uint32_t index, void* data)
+{
+#ifdef nG_WORLD_MMAP
+    if (w->map) {
+        const nG_WorldEntry* e    = &w->entries[index];
+        long                 page = sysconf(_SC_PAGESIZE);
+        uint64_t             from = (e->offset + page - 1) / page * page;
+        uint64_t             to   = (e->offset + e->size) / page * page;
+
+        // only the pages no other chunk shares
+        if (to > from) {
+            posix_madvise(w->map + from, to - from, POSIX_MADV_DONTNEED);
+        }
+        return;
+    }
+#endif // nG_WORLD_MMAP
+
+    n_Delete(data);
+}
+
+static int nG_WorldLoader(void* data)
+{
+    n_World* w = data;
+
+    while (true) {
+        bool running = SDL_AtomicGet(&w->running);
+        int  tail    = SDL_AtomicGet(&w->reqTail);
+
+        if (tail == SDL_AtomicGet(&w->reqHead)) {
+            if (!running) {
+                break;
+            }
+            SDL_SemWaitTimeout(w->sem, 100);
+            continue;
+        }
+
+        uint32_t       index = w->requests[tail & (nG_WORLD_QUEUE - 1)];
+        nG_WorldResult res   = {index, NULL};
+
+        SDL_AtomicSet(&w->reqTail, tail + 1);
+
+        if (running && SDL_AtomicGet(&w->wanted[index])) {
+            uint64_t start = SDL_GetPerformanceCounter();
+            float    ms;
+
+            res.data = nG_LoadWorldChunk(w, &w->entries[index]);
+            ms = Float((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+
+            SDL_AtomicLock(&w->statsLock);
+            w->stats.avgLoadMs = (w->stats.avgLoadMs == 0.0f)
+                ? ms
+                : w->stats.avgLoadMs + (ms - w->stats.avgLoadMs) / 16.0f;
+            SDL_AtomicUnlock(&w->statsLock);
+
+            if (!res.data) {
+                n_LogErrorf("Unable to load world chunk %u.\n", index);
+            }
+        }
+
+        // there's always room: at most nG_WORLD_QUEUE chunks are in flight
+        int head = SDL_AtomicGet(&w->resHead);
+
+        w->results[head & (nG_WORLD_QUEUE - 1)] = res;
+        SDL_AtomicSet(&w->resHead, head + 1);
+    }
+    return 0;
+}
+
+// The chunk count has to fit the 32 bit indices, and every chunk the
+// file it's in: a truncated or corrupt file is refused here rather than
+// read past its end by the loader.
+static bool nG_CheckWorldHeader(const n_World* w, uint64_t fileSize)
+{
+    uint64_t n = UInt64(w->header.cols) * w->header.rows;
+
+    return w->header.magic == nG_WorldMagic
+        && n > 0
+        && n <= UINT32_MAX / sizeof(nG_WorldEntry)
+        && sizeof(nG_WorldHeader) + n * sizeof(nG_WorldEntry) <= fileSize;
+}
+
+static bool nG_CheckWorldEntries(const n_World* w, uint64_t fileSize)
+{
+    for (uint32_t i = 0; i < w->nChunks; i++) {
+        const nG_WorldEntry* e = &w->entries[i];
+
+        if (e->offset > fileSize || e->size > fileSize - e->offset) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool nG_MapWorld(n_World* w, const char* path)
+{
+    size_t tableSize;
+
+#ifdef nG_WORLD_MMAP
+    int         fd = open(path, O_RDONLY);
+    struct stat st;
+
+    if (fd >= 0 && fstat(fd, &st) == 0 && UInt64(st.st_size) >= sizeof(nG_WorldHeader)) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (map != MAP_FAILED) {
+            w->map     = map;
+            w->mapSize = st.st_size;
+            memcpy(&w->header, map, sizeof(w->header));
+        }
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+
+    if (w->map) {
+        if (!nG_CheckWorldHeader(w, w->mapSize)) {
+            return false;
+        }
+        w->nChunks = w->header.cols * w->header.rows;
+        w->entries = (nG_WorldEntry *) (w->map + sizeof(w->header));
+        return nG_CheckWorldEntries(w, w->mapSize);
+    }
+#endif // nG_WORLD_MMAP
+
+    long fileSize = -1;
+
+    w->file = fopen(path, "rb");
+    if (w->file && fseek(w->file, 0, SEEK_END) == 0) {
+        fileSize = ftell(w->file);
+        rewind(w->file);
+    }
+
+    if (fileSize < 0
+        || fread(&w->header, sizeof(w->header), 1, w->file) != 1
+        || !nG_CheckWorldHeader(w, UInt64(fileSize))) {
+        return false;
+    }
+
+    w->nChunks = w->header.cols * w->header.rows;
+    tableSize  = w->nChunks * sizeof(nG_WorldEntry);
+    w->entries = n_NewTagged(nG_WorldEntry, w->nChunks, n_AllocTag_Engine);
+    return w->entries
+        && fread(w->entries, tableSize, 1, w->file) == 1
+        && nG_CheckWorldEntries(w, UInt64(fileSize));
+}
+
+n_World* n_OpenWorld(const char *restrict path, n_WorldOptions options)
+{
+    n_World* w = n_NewTagged(n_World, 1, n_AllocTag_Engine);
+
+    if (!w) {
+        return NULL;
+    }
+
+    w->opts = options;
+
+    if (!nG_MapWorld(w, path) || w->header.version != nG_WorldVersion) {
+        n_LogErrorf("Unable to open the world '%s'.\n", path);
+        n_CloseWorld(&w);
+        return NULL;
+    }
+
+    w->state    = n_NewTagged(uint8_t, w->nChunks, n_AllocTag_Engine);
+    w->wanted   = n_NewTagged(SDL_atomic_t, w->nChunks, n_AllocTag_Engine);
+    w->data     = n_NewTagged(void*, w->nChunks, n_AllocTag_Engine);
+    w->resident = n_NewTagged(uint32_t, w->nChunks, n_AllocTag_Engine);
+    w->sem      = SDL_CreateSemaphore(0);
+
+    if (!w->state || !w->wanted || !w->data || !w->resident || !w->sem) {
+        n_LogErrorf("Unable to allocate the world '%s'.\n", path);
+        n_CloseWorld(&w);
+        return NULL;
+    }
+
+    SDL_AtomicSet(&w->running, 1);
+    w->thread = SDL_CreateThread(nG_WorldLoader, "nolib world", w);
+    if (!w->thread) {
+        n_LogErrorf("Unable to start the world loader: %s\n", SDL_GetError());
+        n_CloseWorld(&w);
+    }
+
+    return w;
+}
+
+static void nG_UnloadWorldChunk(n_World* w, uint32_t index)
+{
+    n_WorldChunk chunk = n_GetWorldChunk(w, Int(index % w->header.cols), Int(index / w->header.cols));
+
+    if (w->opts.unload) {
+        w->opts.unload(&chunk, w->opts.data);
+    }
+
+    nG_ReleaseWorldChunk(w, index, w->data[index]);
+    w->data[index]  = NULL;
+    w->state[index] = nG_Chunk_Unloaded;
+    SDL_AtomicSet(&w->wanted[index], 0);
+    w->stats.unloaded++;
+}
+
+void n_CloseWorld(n_World** world)
+{
+    n_World* w = world ? *world : NULL;
+
+    if (!w) {
+        return;
+    }
+
+    SDL_AtomicSet(&w->running, 0);
+    if (w->thread) {
+        SDL_SemPost(w->sem);
+        SDL_WaitThread(w->thread, NULL);
+    }
+
+    // what the loader brought back but wasn't handed out
+    for (int i = SDL_AtomicGet(&w->resTail); i != SDL_AtomicGet(&w->resHead); i++) {
+        nG_WorldResult* res = &w->results[i & (nG_WORLD_QUEUE - 1)];
+
+        if (res->data) {
+            nG_ReleaseWorldChunk(w, res->index, res->data);
+        }
+    }
+    for (uint32_t i = 0; i < w->nResident; i++) {
+        nG_UnloadWorldChunk(w, w->resident[i]);
+    }
+
+    if (w->sem) {
+        SDL_DestroySemaphore(w->sem);
+    }
+#ifdef nG_WORLD_MMAP
+    if (w->map) {
+        munmap(w->map, w->mapSize);
+        w->entries = NULL;
+    }
+#endif // nG_WORLD_MMAP
+    if (w->file) {
+        fclose(w->file);
+    }
+
+    n_Delete(w->entries);
+    n_Delete(w->state);
+    n_Delete(w->wanted);
+    n_Delete(w->data);
+    n_Delete(w->resident);
+    n_Delete(w->scratch);
+    n_Delete(*world);
+}
+
+static int nG_CompareWorldRequests(const void* a, const void* b)
+{
+    float da = ((const nG_WorldRequest *) a)->dist;
+    float db = ((const nG_WorldRequest *) b)->dist;
+
+    return (da > db) - (da < db);
+}
+
+void n_UpdateWorld(n_World* w, const n_Camera *restrict cam)
+{
+    if (!w || !cam) {
+        return;
+    }
+
+    const nG_WorldHeader* h     = &w->header;
+    uint64_t              start = SDL_GetPerformanceCounter();
+    float                 scale = cam->zoom * nG_PPM;
+    int                   sw, sh;
+
+    nG_GetScreenSize(&sw, &sh);
+
+    // the view in meters (see n_Unproject()), stretched along the
+    // camera's velocity
+    float x0 = -cam->x;
+    float y0 = -cam->y;
+    float x1 = x0 + sw / scale;
+    float y1 = y0 + sh / scale;
+    float dx = cam->velocity.x * w->opts.lookahead;
+    float dy = cam->velocity.y * w->opts.lookahead;
+    float cx = 0.5f * (x0 + x1) + dx;
+    float cy = 0.5f * (y0 + y1) + dy;
+
+    x0 += fminf(dx, 0.0f);
+    x1 += fmaxf(dx, 0.0f);
+    y0 += fminf(dy, 0.0f);
+    y1 += fmaxf(dy, 0.0f);
+
+    int m   = w->opts.margin;
+    int cx0 = SDL_max(0, Int(floorf((x0 - h->originX) / h->chunkSize)) - m);
+    int cy0 = SDL_max(0, Int(floorf((y0 - h->originY) / h->chunkSize)) - m);
+    int cx1 = SDL_min(Int(h->cols) - 1, Int(floorf((x1 - h->originX) / h->chunkSize)) + m);
+    int cy1 = SDL_min(Int(h->rows) - 1, Int(floorf((y1 - h->originY) / h->chunkSize)) + m);
+
+    // chunks are dropped a chunk further out than they're loaded, so
+    // that going back and forth over an edge doesn't reload them
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < w->nResident; i++) {
+        uint32_t index = w->resident[i];
+        int      x = Int(index % h->cols);
+        int      y = Int(index / h->cols);
+
+        if (x < cx0 - 1 || x > cx1 + 1 || y < cy0 - 1 || y > cy1 + 1) {
+            nG_UnloadWorldChunk(w, index);
+        } else {
+            w->resident[kept++] = index;
+        }
+    }
+    w->nResident = kept;
+
+    // requests, nearest first; the ones far away are skipped
+    uint32_t n = 0;
+
+    if (cx0 <= cx1 && cy0 <= cy1) {
+        uint32_t need = UInt32(cx1 - cx0 + 1) * UInt32(cy1 - cy0 + 1);
+
+        if (need > w->scratchCap) {
+            nG_WorldRequest* s = n_ResizeTagged(w->scratch, nG_WorldRequest, need, n_AllocTag_Engine);
+
+            if (s) {
+                w->scratch    = s;
+                w->scratchCap = need;
+            }
+        }
+
+        for (int y = cy0; y <= cy1 && w->scratchCap >= need; y++) {
+            for (int x = cx0; x <= cx1; x++) {
+                uint32_t index = UInt32(y) * h->cols + UInt32(x);
+                float    ox    = h->originX + (x + 0.5f) * h->chunkSize - cx;
+                float    oy    = h->originY + (y + 0.5f) * h->chunkSize - cy;
+
+                if (w->state[index] == nG_Chunk_Queued) {
+                    SDL_AtomicSet(&w->wanted[index], 1);
+                } else if (w->state[index] == nG_Chunk_Unloaded && w->entries[index].size > 0) {
+                    w->scratch[n++] = (nG_WorldRequest) {ox * ox + oy * oy, index};
+                }
+            }
+        }
+    }
+
+    qsort(w->scratch, n, sizeof(nG_WorldRequest), nG_CompareWorldRequests);
+
+    int head = SDL_AtomicGet(&w->reqHead);
+
+    for (uint32_t i = 0; i < n && w->inflight < nG_WORLD_QUEUE; i++) {
+        uint32_t index = w->scratch[i].index;
+
+        w->state[index] = nG_Chunk_Queued;
+        SDL_AtomicSet(&w->wanted[index], 1);
+        w->requests[head++ & (nG_WORLD_QUEUE - 1)] = index;
+        w->inflight++;
+    }
+    if (head != SDL_AtomicGet(&w->reqHead)) {
+        SDL_AtomicSet(&w->reqHead, head);
+        SDL_SemPost(w->sem);
+    }
+
+    // queued chunks that went out of range: the loader skips them
+    for (int i = SDL_AtomicGet(&w->reqTail); i != head; i++) {
+        uint32_t index = w->requests[i & (nG_WORLD_QUEUE - 1)];
+        int      x = Int(index % h->cols);
+        int      y = Int(index / h->cols);
+
+        if (x < cx0 || x > cx1 || y < cy0 || y > cy1) {
+            SDL_AtomicSet(&w->wanted[index], 0);
+        }
+    }
+
+    // hand the loaded chunks to the game, within the budget
+    float    freq = Float(SDL_GetPerformanceFrequency()) / 1000.0f;
+    uint64_t integrate = SDL_GetPerformanceCounter();
+    int      tail = SDL_AtomicGet(&w->resTail);
+
+    for (; tail != SDL_AtomicGet(&w->resHead); tail++) {
+        if (tail != SDL_AtomicGet(&w->resTail)
+            && (SDL_GetPerformanceCounter() - integrate) / freq >= w->opts.budgetMs) {
+            break;
+        }
+
+        nG_WorldResult res = w->results[tail & (nG_WORLD_QUEUE - 1)];
+        int            x   = Int(res.index % h->cols);
+        int            y   = Int(res.index / h->cols);
+
+        w->inflight--;
+
+        if (!res.data || x < cx0 - 1 || x > cx1 + 1 || y < cy0 - 1 || y > cy1 + 1) {
+            if (res.data) {
+                nG_ReleaseWorldChunk(w, res.index, res.data);
+            }
+            w->state[res.index] = nG_Chunk_Unloaded;
+            SDL_AtomicSet(&w->wanted[res.index], 0);
+            w->stats.skipped++;
+            continue;
+        }
+
+        w->data[res.index]  = res.data;
+        w->state[res.index] = nG_Chunk_Resident;
+        w->resident[w->nResident++] = res.index;
+        w->stats.loaded++;
+
+        if (w->opts.load) {
+            n_WorldChunk chunk = n_GetWorldChunk(w, x, y);
+            w->opts.load(&chunk, w->opts.data);
+        }
+    }
+    SDL_AtomicSet(&w->resTail, tail);
+
+    w->stats.resident    = w->nResident;
+    w->stats.pending     = w->inflight;
+    w->stats.integrateMs = (SDL_GetPerformanceCounter() - start) / freq;
+}
+
+n_WorldChunk n_GetWorldChunk(const n_World* w, int x, int y)
+{
+    n_WorldChunk chunk = {.x = x, .y = y};
+
+    if (!w || x < 0 || y < 0 || x >= Int(w->header.cols) || y >= Int(w->header.rows)) {
+        return chunk;
+    }
+
+    uint32_t index = UInt32(y) * w->header.cols + UInt32(x);
+
+    chunk.bounds = n_Rect(
+        .x = w->header.originX + x * w->header.chunkSize,
+        .y = w->header.originY + y * w->header.chunkSize,
+        .w = w->header.chunkSize,
+        .h = w->header.chunkSize
+    );
+    if (w->state[index] == nG_Chunk_Resident) {
+        chunk.data = w->data[index];
+        chunk.size = w->entries[index].size;
+    }
+    return chunk;
+}
+
+n_WorldStats n_GetWorldStats(const n_World* w)
+{
+    n_WorldStats st = {0};
+
+    if (w) {
+        SDL_AtomicLock((SDL_SpinLock *) &w->statsLock);
+        st = w->stats;
+        SDL_AtomicUnlock((SDL_SpinLock *) &w->statsLock);
+    }
+    return st;
+}
+
+
+// ========================================================
+//
+// INPUT
+//
+// ========================================================
+
+
+// Recording layout (native byte order): the 4-byte magic, then one
+// record per frame: a flags byte, the delta time and only the blocks
+// that changed since the previous frame.
+#define nG_InputMagic   "NLI1"
+#define nG_InputVersion 1
+
+// Follows the magic. A recording is only replayed by a build with the
+// same limits, since they size the snapshot's blocks.
+typedef struct {
+    uint16_t version;
+    uint16_t axes;
+    uint16_t buttons;
+    uint16_t hats;
+    uint32_t scancodes;
+} nG_InputHeader;
+
+enum {
+    nG_InputBlock_Keys  = 1,
+    nG_InputBlock_Mouse = 1 << 1,
+    nG_InputBlock_Joy   = 1 << 2
+};
+
+
+static n_Input       nG_Input;
+static n_Input       nG_InputPrev;
+static n_InputMode   nG_InputMode = n_InputMode_Live;
+static FILE*         nG_InputFile = NULL;
+static SDL_Joystick* nG_Joystick  = NULL;
+
+
+static void nG_ReadJoystick(n_Input *restrict in);
+
+static void nG_ReadLiveInput(n_Input *restrict in)
+{
+    const uint8_t* ks = SDL_GetKeyboardState(NULL);
+
+    memcpy(in->keys, ks, sizeof(in->keys));
+    for (int i = 0; i < SDL_NUM_SCANCODES; i++) {
+        in->keys[i] = in->keys[i] != 0;
+    }
+
+    in->mouseButtons = SDL_GetMouseState(&in->mouseX, &in->mouseY);
+
+    nG_ReadJoystick(in);
+}
+
+static void nG_ReadJoystick(n_Input *restrict in)
+{
+    // the joystick subsystem is brought up by the first query
+    if (!nG_Joystick && nG_HasSubsystems(n_Subsystem_Joystick) && SDL_NumJoysticks() > 0) {
+        nG_Joystick = SDL_JoystickOpen(0);
+    }
+
+    if (nG_Joystick) {
+        int na = SDL_JoystickNumAxes(nG_Joystick);
+        int nb = SDL_JoystickNumButtons(nG_Joystick);
+        int nh = SDL_JoystickNumHats(nG_Joystick);
+
+        for (int i = 0; i < na && i < nG_INPUT_MAX_AXES; i++) {
+            in->axes[i] = SDL_JoystickGetAxis(nG_Joystick, i);
+        }
+        for (int i = 0; i < nb && i < nG_INPUT_MAX_BUTTONS; i++) {
+            in->buttons[i] = SDL_JoystickGetButton(nG_Joystick, i);
+        }
+        for (int i = 0; i < nh && i < nG_INPUT_MAX_HATS; i++) {
+            in->hats[i] = SDL_JoystickGetHat(nG_Joystick, i);
+        }
+    }
+}
+
+static bool nG_WriteInputFrame(FILE* f, const n_Input *restrict in, const n_Input *restrict prev)
+{
+    uint8_t flags = 0;
+    uint8_t keys[SDL_NUM_SCANCODES / 8];
+
+    if (memcmp(in->keys, prev->keys, sizeof(in->keys)) != 0) {
+        flags |= nG_InputBlock_Keys;
+    }
+
+    if (in->mouseX != prev->mouseX
+        || in->mouseY != prev->mouseY
+        || in->mouseButtons != prev->mouseButtons) {
+        flags |= nG_InputBlock_Mouse;
+    }
+
+    if (memcmp(in->axes, prev->axes, sizeof(in->axes)) != 0
+        || memcmp(in->buttons, prev->buttons, sizeof(in->buttons)) != 0
+        || memcmp(in->hats, prev->hats, sizeof(in->hats)) != 0) {
+        flags |= nG_InputBlock_Joy;
+    }
+
+    bool ok = fwrite(&flags, 1, 1, f) == 1
+        && fwrite(&in->deltaTime, sizeof(float), 1, f) == 1;
+
+    if (ok && (flags & nG_InputBlock_Keys)) {
+        // keys are stored as a bitset
+        memset(keys, 0, sizeof(keys));
+        for (int i = 0; i < SDL_NUM_SCANCODES; i++) {
+            keys[i / 8] |= UInt8(in->keys[i] << (i % 8));
+        }
+        ok = fwrite(keys, sizeof(keys), 1, f) == 1;
+    }
+
+    if (ok && (flags & nG_InputBlock_Mouse)) {
+        ok = fwrite(&in->mouseButtons, sizeof(uint32_t), 1, f) == 1
+            && fwrite(&in->mouseX, sizeof(int32_t), 1, f) == 1
+            && fwrite(&in->mouseY, sizeof(int32_t), 1, f) == 1;
+    }
+
+    if (ok && (flags & nG_InputBlock_Joy)) {
+        ok = fwrite(in->axes, sizeof(in->axes), 1, f) == 1
+            && fwrite(in->buttons, sizeof(in->buttons), 1, f) == 1
+            && fwrite(in->hats, sizeof(in->hats), 1, f) == 1;
+    }
+
+    return ok;
+}
+
+static bool nG_ReadInputFrame(FILE* f, n_Input *restrict in)
+{
+    uint8_t flags;
+    uint8_t keys[SDL_NUM_SCANCODES / 8];
+
+    if (fread(&flags, 1, 1, f) != 1 || fread(&in->deltaTime, sizeof(float), 1, f) != 1) {
+        return false;
+    }
+
+    if (flags & nG_InputBlock_Keys) {
+        if (fread(keys, sizeof(keys), 1, f) != 1) {
+            return false;
+        }
+        for (int i = 0; i < SDL_NUM_SCANCODES; i++) {
+            in->keys[i] = (keys[i / 8] >> (i % 8)) & 1;
+        }
+    }
+
+    if (flags & nG_InputBlock_Mouse) {
+        if (fread(&in->mouseButtons, sizeof(uint32_t), 1, f) != 1
+            || fread(&in->mouseX, sizeof(int32_t), 1, f) != 1
+            || fread(&in->mouseY, sizeof(int32_t), 1, f) != 1) {
+            return false;
+        }
+    }
+
+    if (flags & nG_InputBlock_Joy) {
+        if (fread(in->axes, sizeof(in->axes), 1, f) != 1
+            || fread(in->buttons, sizeof(in->buttons), 1, f) != 1
+            || fread(in->hats, sizeof(in->hats), 1, f) != 1) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool nG_IsInputEvent(const SDL_Event *restrict e)
+{
+    switch (e->type) {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_TEXTINPUT:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEWHEEL:
+    case SDL_JOYAXISMOTION:
+    case SDL_JOYBALLMOTION:
+    case SDL_JOYHATMOTION:
+    case SDL_JOYBUTTONDOWN:
+    case SDL_JOYBUTTONUP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static nG_InputHeader nG_GetInputHeader(void)
+{
+    return (nG_InputHeader) {
+        .version   = nG_InputVersion,
+        .axes      = nG_INPUT_MAX_AXES,
+        .buttons   = nG_INPUT_MAX_BUTTONS,
+        .hats      = nG_INPUT_MAX_HATS,
+        .scancodes = SDL_NUM_SCANCODES
+    };
+}
+
+// Called by n_Run() once per frame. <deltaTime> is the measured delta
+// time; when replaying, it is replaced by the recorded one. Returns
+// false when the recording has ended: the frame must not be stepped.
+static bool nG_UpdateInput(float *restrict deltaTime)
+{
+    switch (nG_InputMode) {
+    case n_InputMode_Replay:
+        if (!nG_ReadInputFrame(nG_InputFile, &nG_Input)) {
+            n_StopInput();
+            n_Quit();
+            return false;
+        }
+        *deltaTime = nG_Input.deltaTime;
+        break;
+
+    case n_InputMode_Record:
+        nG_ReadLiveInput(&nG_Input);
+        nG_Input.deltaTime = *deltaTime;
+
+        if (!nG_WriteInputFrame(nG_InputFile, &nG_Input, &nG_InputPrev)) {
+            n_LogErrorf("Unable to write the input recording.\n");
+            n_StopInput();
+        }
+        nG_InputPrev = nG_Input;
+        break;
+
+    default:
+        nG_ReadLiveInput(&nG_Input);
+        nG_Input.deltaTime = *deltaTime;
+        break;
+    }
+
+    return true;
+}
+
+
+const n_Input* n_GetInput(void)
+{
+    return &nG_Input;
+}
+
+n_InputMode n_GetInputMode(void)
+{
+    return nG_InputMode;
+}
+
+// Brings the joystick subsystem up on the first query and reads the
+// joystick right away, so that the query isn't answered with zeros.
+static void nG_RequireJoystick(void)
+{
+    if (!nG_HasSubsystems(n_Subsystem_Joystick) && n_RequireSubsystems(n_Subsystem_Joystick) &&
+        nG_InputMode == n_InputMode_Live) {
+        nG_ReadJoystick(&nG_Input);
+    }
+}
+
+int16_t n_GetJoystickAxis(int axis)
+{
+    nG_RequireJoystick();
+    return (axis >= 0 && axis < nG_INPUT_MAX_AXES) ? nG_Input.axes[axis] : 0;
+}
+
+bool n_GetJoystickButton(int button)
+{
+    nG_RequireJoystick();
+    return (button >= 0 && button < nG_INPUT_MAX_BUTTONS) && nG_Input.buttons[button];
+}
+
+uint8_t n_GetJoystickHat(int hat)
+{
+    nG_RequireJoystick();
+    return (hat >= 0 && hat < nG_INPUT_MAX_HATS) ? nG_Input.hats[hat] : SDL_HAT_CENTERED;
+}
+
+bool n_IsKeyDown(SDL_Scancode key)
+{
+    return key >= 0 && key < SDL_NUM_SCANCODES && nG_Input.keys[key];
+}
+
+bool n_RecordInput(const char *restrict path)
+{
+    n_StopInput();
+
+    if (!path || !(nG_InputFile = fopen(path, "wb"))) {
+        n_LogErrorf("Unable to open '%s' for recording.\n", path ? path : "(null)");
+        return false;
+    }
+
+    nG_InputHeader h = nG_GetInputHeader();
+
+    if (fwrite(nG_InputMagic, 4, 1, nG_InputFile) != 1 || fwrite(&h, sizeof(h), 1, nG_InputFile) != 1) {
+        n_LogErrorf("Unable to write to '%s'.\n", path);
+        n_StopInput();
+        return false;
+    }
+
+    memset(&nG_InputPrev, 0, sizeof(nG_InputPrev));
+    nG_InputMode = n_InputMode_Record;
+    return true;
+}
+
+bool n_ReplayInput(const char *restrict path)
+{
+    char           magic[4];
+    nG_InputHeader h;
+    nG_InputHeader expected = nG_GetInputHeader();
+
+    n_StopInput();
+
+    if (!path || !(nG_InputFile = fopen(path, "rb"))) {
+        n_LogErrorf("Unable to open '%s' for replaying.\n", path ? path : "(null)");
+        return false;
+    }
+
+    if (fread(magic, 4, 1, nG_InputFile) != 1 || memcmp(magic, nG_InputMagic, 4) != 0) {
+        n_LogErrorf("'%s' is not an input recording.\n", path);
+        n_StopInput();
+        return false;
+    }
+
+    if (fread(&h, sizeof(h), 1, nG_InputFile) != 1 || memcmp(&h, &expected, sizeof(h)) != 0) {
+        n_LogErrorf("'%s' was recorded by a build with other input limits.\n", path);
+        n_StopInput();
+        return false;
+    }
+
+    memset(&nG_Input, 0, sizeof(nG_Input));
+    nG_InputMode = n_InputMode_Replay;
+    return true;
+}
+
+void n_StopInput(void)
+{
+    if (nG_InputFile) {
+        fclose(nG_InputFile);
+        nG_InputFile = NULL;
+    }
+
+    nG_InputMode = n_InputMode_Live;
+}
+
+
+// ========================================================
+//
+// LOADER
+//
+// ========================================================
+
+
+// Decoded images shared by the contexts, by path.
+typedef struct {
+    uint32_t     hash;
+    char*        path;
+    SDL_Surface* surface;
+} nG_SharedImage;
+
+
+static nG_SharedImage* nG_ImageCache     = NULL;
+static uint32_t        nG_ImageCacheSize = 0;
+static uint32_t        nG_ImageCacheCap  = 0;
+static SDL_SpinLock    nG_ImageCacheLock = 0;
+
+
+static SDL_Surface* nG_FindSharedImage(uint32_t hash, const char* path)
+{
+    for (uint32_t i = 0; i < nG_ImageCacheSize; i++) {
+        if (nG_ImageCache[i].hash == hash && strcmp(nG_ImageCache[i].path, path) == 0) {
+            return nG_ImageCache[i].surface;
+        }
+    }
+    return NULL;
+}
+
+// Decodes <path> once for every context. When <cached> is set, the
+// surface stays owned by the cache; otherwise (the cache is out of
+// memory) it's the caller's.
+static SDL_Surface* nG_LoadSharedImage(const char* path, bool* cached)
+{
+    uint32_t     hash = nG_Hash(2166136261u, path, strlen(path));
+    SDL_Surface* s;
+
+    SDL_AtomicLock(&nG_ImageCacheLock);
+    s = nG_FindSharedImage(hash, path);
+    SDL_AtomicUnlock(&nG_ImageCacheLock);
+    if (s) {
+        *cached = true;
+        return s;
+    }
+
+    // decode outside of the lock, in the format every renderer takes
+    SDL_Surface* img = IMG_Load(path);
+    if (!img) {
+        return NULL;
+    }
+    SDL_Surface* conv = SDL_ConvertSurfaceFormat(img, SDL_PIXELFORMAT_ARGB8888, 0);
+    SDL_FreeSurface(img);
+    if (!conv) {
+        return NULL;
+    }
+
+    SDL_AtomicLock(&nG_ImageCacheLock);
+    s = nG_FindSharedImage(hash, path);
+    if (!s && nG_ImageCacheSize == nG_ImageCacheCap) {
+        uint32_t        cap = nG_ImageCacheCap ? 2 * nG_ImageCacheCap : 32;
+        nG_SharedImage* cache = n_ResizeTagged(nG_ImageCache, nG_SharedImage, cap, n_AllocTag_Engine);
+        if (cache) {
+            nG_ImageCache = cache;
+            nG_ImageCacheCap = cap;
+        }
+    }
+    char* copy = (!s && nG_ImageCacheSize < nG_ImageCacheCap)
+        ? n_NewTagged(char, strlen(path) + 1, n_AllocTag_Engine)
+        : NULL;
+    if (copy) {
+        strcpy(copy, path);
+        nG_ImageCache[nG_ImageCacheSize++] = (nG_SharedImage) { hash, copy, conv };
+        s = conv;
+        conv = NULL;
+    }
+    SDL_AtomicUnlock(&nG_ImageCacheLock);
+
+    if (!s) {
+        // the cache is out of memory: hand the surface over uncached
+        *cached = false;
+        return conv;
+    }
+
+    // somebody else got there first
+    if (conv) {
+        SDL_FreeSurface(conv);
+    }
+    *cached = true;
+    return s;
+}
+
+static void nG_ClearImageCache(void)
+{
+    for (uint32_t i = 0; i < nG_ImageCacheSize; i++) {
+        n_Delete(nG_ImageCache[i].path);
+        SDL_FreeSurface(nG_ImageCache[i].surface);
+    }
+    n_Delete(nG_ImageCache);
+    nG_ImageCacheSize = 0;
+    nG_ImageCacheCap = 0;
+}
+
+
+void n_DeleteTexture(SDL_Texture** tex)
+{
+    if (tex && *tex) {
+        nG_UntrackTexture(*tex);
+        nG_RemoveRasterImage(*tex);
+        SDL_DestroyTexture(*tex);
+        *tex = NULL;
+    }
+}
+
+SDL_Texture* n_LoadTexture(const char *restrict path)
+{
+    if (strlen(path) > nG_BaseLoaderPathMaxLen) {
+        n_LogErrorf("path is too long (> %d).", nG_BaseLoaderPathMaxLen - 1);
+    }
+
+    char filepath[2 * nG_BaseLoaderPathMaxLen + 1];
+    
+    snprintf(filepath, 2 * nG_BaseLoaderPathMaxLen, "%s%s", nG_BaseLoaderPath, path);
+
+    // IMG_Load() still manages the formats it can without IMG_Init()
+    n_RequireSubsystems(n_Subsystem_Images);
+
+    bool         shared = SDL_AtomicGet(&nG_ContextCount) > 0;
+    SDL_Surface* s = shared ? nG_LoadSharedImage(filepath, &shared) : IMG_Load(filepath);
+    SDL_Texture* t = NULL;
+
+    
+    if (s && shared) {
+        // SDL may touch a surface's blit map while converting it, so
+        // each load goes through its own surface over the shared pixels
+        SDL_Surface* view = SDL_CreateRGBSurfaceWithFormatFrom(
+            s->pixels,
+            s->w,
+            s->h,
+            32,
+            s->pitch,
+            SDL_PIXELFORMAT_ARGB8888
+        );
+
+        if (view) {
+            t = n_TextureFromSurface(view);
+            SDL_FreeSurface(view);
+        }
+    } else if (s) {
+        t = n_TextureFromSurface(s);
+        SDL_FreeSurface(s);
+    }
+
+    if (!t) {
+        n_LogErrorf("Unable to load texture '%s': %s\n", filepath, SDL_GetError());
+    }
+
+    return t;
+}
+
+TTF_Font* n_LoadFont(const char *restrict path, int ptsize)
+{
+    char filepath[2 * nG_BaseLoaderPathMaxLen + 1];
+
+    snprintf(filepath, 2 * nG_BaseLoaderPathMaxLen, "%s%s", nG_BaseLoaderPath, path);
+
+    if (!n_RequireSubsystems(n_Subsystem_Fonts)) {
+        return NULL;
+    }
+
+    TTF_Font* font = TTF_OpenFont(filepath, ptsize);
+    if (!font) {
+        n_LogErrorf("Unable to load font '%s': %s\n", filepath, TTF_GetError());
+    }
+
+    return font;
+}
+
+void n_DeleteFont(TTF_Font** font)
+{
+    if (font && *font) {
+        TTF_CloseFont(*font);
+        *font = NULL;
+    }
+}
+
+bool n_SetLoaderSearchPath(const char *restrict path)
+{
+    long len = strlen(path);
+ 
+    if (!path) {
+        n_LogErrorf("NULL path.");
+        return false;
+    }
+
+    if (len >= nG_BaseLoaderPathMaxLen) {
+        n_LogErrorf("path is too long (> %d).", nG_BaseLoaderPathMaxLen);
+        return false;
+    }
+
+    if (nG_BaseLoaderPath[len - 1] != '/') {
+        snprintf(
+            nG_BaseLoaderPath,
+            nG_BaseLoaderPathMaxLen - 1,
+            "%s/",
+            path
+        );
+    } else {
+        strncpy(nG_BaseLoaderPath, path, nG_BaseLoaderPathMaxLen);
+    }
+
+    return true;
+}
+
+SDL_Texture* n_TextureFromSurface(SDL_Surface *restrict s)
+{
+    SDL_Texture* t = s ? SDL_CreateTextureFromSurface(nG_Renderer, s) : NULL;
+
+    if (t) {
+        nG_TrackTexture(t);
+        nG_AddRasterImage(t, s);
+    }
+
+    return t;
+}
+
+
+// Managed textures, by the texture they currently have (to find them
+// from n_DrawTexture()). Headless contexts draw them from other
+// threads, so all of this is behind nG_TextureLock (the loads and the
+// frame counter excepted).
+//
+// A texture only belongs to the renderer of its context, so only that
+// context's thread loads or destroys it: the budget picks textures of
+// other contexts for eviction (<evict>), and they destroy them in
+// their next n_Present().
+struct n_Texture {
+    SDL_Texture* tex;
+    // NULL once the context was deleted
+    n_Context*   ctx;
+    char*        path;
+    long         bytes;
+    uint64_t     lastUse;
+    uint32_t     index;
+    // scenes that draw it, which keep it resident
+    uint32_t     pins;
+    // being reloaded by n_GetTexture(), outside of the lock
+    bool         loading;
+    bool         evict;
+};
+
+
+static n_Texture**    nG_Textures        = NULL;
+static uint32_t       nG_TexturesLen     = 0;
+static uint32_t       nG_TexturesCap     = 0;
+static n_Texture**    nG_TextureTable    = NULL;
+static uint32_t       nG_TextureTableLen = 0;
+static uint32_t       nG_TextureTableCap = 0;
+static uint64_t       nG_TextureFrame    = 1;
+static n_TextureStats nG_TextureStats    = {0};
+static SDL_SpinLock   nG_TextureLock     = 0;
+// picked for eviction but still resident, see n_Texture
+static long           nG_EvictBytes      = 0;
+static uint32_t       nG_EvictCount      = 0;
+
+
+static n_Texture** nG_FindTextureSlot(const SDL_Texture* tex)
+{
+    for (uint32_t i = nG_HashPtr(tex, nG_TextureTableCap);; i = (i + 1) & (nG_TextureTableCap - 1)) {
+        if (!nG_TextureTable[i] || nG_TextureTable[i]->tex == tex) {
+            return &nG_TextureTable[i];
+        }
+    }
+}
+
+static bool nG_InsertTexture(n_Texture* t)
+{
+    if (2 * (nG_TextureTableLen + 1) > nG_TextureTableCap) {
+        uint32_t    cap   = nG_TextureTableCap ? 2 * nG_TextureTableCap : 64;
+        n_Texture** table = n_NewTagged(n_Texture*, cap, n_AllocTag_Engine);
+        n_Texture** old   = nG_TextureTable;
+        uint32_t    n     = nG_TextureTableCap;
+
+        if (!table) {
+            return false;
+        }
+
+        nG_TextureTable    = table;
+        nG_TextureTableCap = cap;
+        for (uint32_t i = 0; i < n; i++) {
+            if (old[i]) {
+                *nG_FindTextureSlot(old[i]->tex) = old[i];
+            }
+        }
+        n_Delete(old);
+    }
+
+    *nG_FindTextureSlot(t->tex) = t;
+    nG_TextureTableLen++;
+    return true;
+}
+
+static void nG_RemoveTexture(const n_Texture* t)
+{
+    n_Texture** slot = nG_TextureTableCap ? nG_FindTextureSlot(t->tex) : NULL;
+
+    if (!slot || !*slot) {
+        return;
+    }
+
+    *slot = NULL;
+    nG_TextureTableLen--;
+
+    // re-insert the rest of the cluster (linear probing)
+    uint32_t mask = nG_TextureTableCap - 1;
+
+    for (uint32_t i = (Int(slot - nG_TextureTable) + 1) & mask; nG_TextureTable[i]; i = (i + 1) & mask) {
+        n_Texture* moved = nG_TextureTable[i];
+
+        nG_TextureTable[i] = NULL;
+        *nG_FindTextureSlot(moved->tex) = moved;
+    }
+}
+
+static void nG_CancelEviction(n_Texture* t)
+{
+    if (t->evict) {
+        t->evict = false;
+        nG_EvictBytes -= t->bytes;
+        nG_EvictCount--;
+    }
+}
+
+// Call with nG_TextureLock held.
+static void nG_UseTexture(n_Texture* t)
+{
+    t->lastUse = nG_TextureFrame;
+    nG_CancelEviction(t);
+}
+
+static void nG_PinTexture(SDL_Texture* tex, int delta)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+    if (nG_TextureTableLen > 0) {
+        n_Texture* t = *nG_FindTextureSlot(tex);
+
+        // a texture deleted since, or one that took its address, may
+        // not have been pinned
+        if (t && delta > 0) {
+            t->pins += UInt32(delta);
+            nG_CancelEviction(t);
+        } else if (t && t->pins > 0) {
+            t->pins--;
+        }
+    }
+    SDL_AtomicUnlock(&nG_TextureLock);
+}
+
+static void nG_TouchTexture(SDL_Texture* tex)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+    if (nG_TextureTableLen > 0) {
+        n_Texture* t = *nG_FindTextureSlot(tex);
+
+        if (t) {
+            nG_UseTexture(t);
+        }
+    }
+    SDL_AtomicUnlock(&nG_TextureLock);
+}
+
+// On the texture's context's thread.
+static void nG_EvictTexture(n_Texture* t)
+{
+    nG_CancelEviction(t);
+    nG_RemoveTexture(t);
+    n_DeleteTexture(&t->tex);
+    nG_TextureStats.bytes -= t->bytes;
+    nG_TextureStats.resident--;
+}
+
+// Frames are counted by the main context only: a headless one
+// presenting would otherwise end the frame of the textures still in
+// use by the others. Every context evicts its own textures that the
+// budget picked.
+static void nG_EndTextureFrame(void)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+
+    for (uint32_t i = 0; i < nG_TexturesLen && nG_EvictCount > 0; i++) {
+        n_Texture* t = nG_Textures[i];
+
+        if (t->evict && t->ctx == nG_Ctx) {
+            nG_EvictTexture(t);
+            nG_TextureStats.evictions++;
+        }
+    }
+
+    if (nG_Ctx == &nG_DefaultContext) {
+        nG_TextureFrame++;
+    }
+
+    SDL_AtomicUnlock(&nG_TextureLock);
+}
+
+// Evicts the least recently used textures until the budget is met,
+// sparing the ones used in this frame. Those of other contexts are
+// only picked, see n_Texture.
+static void nG_EnforceTextureBudget(void)
+{
+    while (nG_TextureStats.budget > 0 && nG_TextureStats.bytes - nG_EvictBytes > nG_TextureStats.budget) {
+        n_Texture* lru = NULL;
+
+        for (uint32_t i = 0; i < nG_TexturesLen; i++) {
+            n_Texture* t = nG_Textures[i];
+
+            if (t->tex && !t->evict && !t->pins && t->lastUse < nG_TextureFrame
+                && (!lru || t->lastUse < lru->lastUse)) {
+                lru = t;
+            }
+        }
+
+        if (!lru) {
+            return;
+        }
+
+        if (lru->ctx == nG_Ctx) {
+            nG_EvictTexture(lru);
+            nG_TextureStats.evictions++;
+        } else {
+            lru->evict     = true;
+            nG_EvictBytes += lru->bytes;
+            nG_EvictCount++;
+        }
+    }
+}
+
+// Decodes and uploads outside of the lock, into the current context
+// (the texture's).
+static bool nG_LoadManagedTexture(n_Texture* t)
+{
+    SDL_Texture* tex = n_LoadTexture(t->path);
+
+    if (!tex) {
+        return false;
+    }
+
+    SDL_AtomicLock(&nG_TextureLock);
+    t->tex = tex;
+    if (!nG_InsertTexture(t)) {
+        t->tex = NULL;
+        SDL_AtomicUnlock(&nG_TextureLock);
+        n_DeleteTexture(&tex);
+        return false;
+    }
+
+    t->bytes   = nG_TextureBytes(t->tex);
+    t->lastUse = nG_TextureFrame;
+    nG_TextureStats.bytes += t->bytes;
+    nG_TextureStats.resident++;
+    nG_EnforceTextureBudget();
+    SDL_AtomicUnlock(&nG_TextureLock);
+    return true;
+}
+
+void n_SetTextureBudget(long bytes)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+    nG_TextureStats.budget = bytes > 0 ? bytes : 0;
+    nG_EnforceTextureBudget();
+    SDL_AtomicUnlock(&nG_TextureLock);
+}
+
+n_Texture* n_LoadManagedTexture(const char *restrict path)
+{
+    n_Texture* t = n_NewTagged(n_Texture, 1, n_AllocTag_Engine);
+
+    if (!t || !(t->path = n_NewTagged(char, strlen(path) + 1, n_AllocTag_Engine))) {
+        n_Delete(t);
+        return NULL;
+    }
+
+    strcpy(t->path, path);
+    t->ctx = n_GetContext();
+
+    if (!nG_LoadManagedTexture(t)) {
+        n_Delete(t->path);
+        n_Delete(t);
+        return NULL;
+    }
+
+    SDL_AtomicLock(&nG_TextureLock);
+    if (nG_TexturesLen == nG_TexturesCap) {
+        uint32_t    cap  = nG_TexturesCap ? 2 * nG_TexturesCap : 32;
+        n_Texture** list = n_ResizeTagged(nG_Textures, n_Texture*, cap, n_AllocTag_Engine);
+
+        if (!list) {
+            nG_EvictTexture(t);
+            SDL_AtomicUnlock(&nG_TextureLock);
+            n_Delete(t->path);
+            n_Delete(t);
+            return NULL;
+        }
+        nG_Textures    = list;
+        nG_TexturesCap = cap;
+    }
+
+    t->index = nG_TexturesLen;
+    nG_Textures[nG_TexturesLen++] = t;
+    nG_TextureStats.textures++;
+    SDL_AtomicUnlock(&nG_TextureLock);
+    return t;
+}
+
+void n_DeleteManagedTexture(n_Texture** tex)
+{
+    n_Texture* t = tex ? *tex : NULL;
+
+    if (!t) {
+        return;
+    }
+
+    SDL_AtomicLock(&nG_TextureLock);
+    if (t->tex) {
+        nG_EvictTexture(t);
+    }
+
+    nG_Textures[t->index] = nG_Textures[--nG_TexturesLen];
+    nG_Textures[t->index]->index = t->index;
+    nG_TextureStats.textures--;
+    SDL_AtomicUnlock(&nG_TextureLock);
+
+    n_Delete(t->path);
+    n_Delete(*tex);
+}
+
+SDL_Texture* n_GetTexture(n_Texture* tex)
+{
+    SDL_Texture* t      = NULL;
+    bool         reload = false;
+
+    if (!tex) {
+        return NULL;
+    }
+
+    SDL_AtomicLock(&nG_TextureLock);
+    if (tex->ctx != nG_Ctx) {
+        // not in this renderer
+    } else if (tex->tex) {
+        nG_UseTexture(tex);
+        t = tex->tex;
+    } else if (!tex->loading) {
+        // another thread on this context may ask at the same time:
+        // it gets NULL rather than loading it twice
+        tex->loading = true;
+        reload       = true;
+    }
+    SDL_AtomicUnlock(&nG_TextureLock);
+
+    if (reload) {
+        bool loaded = nG_LoadManagedTexture(tex);
+
+        SDL_AtomicLock(&nG_TextureLock);
+        tex->loading = false;
+        if (loaded) {
+            nG_TextureStats.reloads++;
+            t = tex->tex;
+        }
+        SDL_AtomicUnlock(&nG_TextureLock);
+    }
+
+    return t;
+}
+
+n_TextureStats n_GetTextureStats(void)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+    n_TextureStats stats = nG_TextureStats;
+    SDL_AtomicUnlock(&nG_TextureLock);
+
+    return stats;
+}
+
+// Destroys the textures of <ctx> before its renderer goes away; the
+// n_Texture stay valid (n_GetTexture() returns NULL) until deleted.
+static void nG_DetachTextures(n_Context* ctx)
+{
+    SDL_AtomicLock(&nG_TextureLock);
+    for (uint32_t i = 0; i < nG_TexturesLen; i++) {
+        n_Texture* t = nG_Textures[i];
+
+        if (t->ctx != ctx) {
+            continue;
+        }
+
+        if (t->tex) {
+            nG_EvictTexture(t);
+        }
+        t->ctx = NULL;
+    }
+    SDL_AtomicUnlock(&nG_TextureLock);
+}
+
+static void nG_ClearTextures(void)
+{
+    while (nG_TexturesLen > 0) {
+        n_Texture* t = nG_Textures[nG_TexturesLen - 1];
+        n_DeleteManagedTexture(&t);
+    }
+    n_Delete(nG_Textures);
+    n_Delete(nG_TextureTable);
+    nG_TexturesCap     = 0;
+    nG_TextureTableLen = 0;
+    nG_TextureTableCap = 0;
+}
+
+
+// ========================================================
+//
+// AUDIO
+//
+// ========================================================
+
+
+typedef enum {
+    nG_AudioCmd_Play,
+    nG_AudioCmd_Stop,
+    nG_AudioCmd_StopAll,
+    nG_AudioCmd_Volume,
+    nG_AudioCmd_Master,
+    nG_AudioCmd_Release
+} nG_AudioCmdType;
+
+typedef struct {
+    uint8_t  type;
+    uint8_t  loop;
+    uint16_t voice;
+    uint16_t gen;
+    n_Sound* sound;
+    float    gain[2];
+} nG_AudioCmd;
+
+// Owned by the audio callback.
+typedef struct {
+    n_Sound* sound;
+    uint32_t pos;
+    uint16_t gen;
+    bool     loop;
+    float    gain[2];
+    float    target[2];
+} nG_AudioVoice;
+
+
+static SDL_AudioDeviceID nG_AudioDevice = 0;
+static nG_AudioVoice     nG_AudioVoices[nG_AUDIO_VOICES];
+static float             nG_AudioMaster = 1.0f;
+
+// single producer (main thread), single consumer (callback)
+static nG_AudioCmd  nG_AudioCmds[nG_AUDIO_COMMANDS];
+static SDL_atomic_t nG_AudioCmdHead;
+static SDL_atomic_t nG_AudioCmdTail;
+
+// per voice: main thread generations, and whether the callback is
+// (or is about to be) playing it
+static uint16_t     nG_VoiceGen[nG_AUDIO_VOICES];
+static SDL_atomic_t nG_VoicePlaying[nG_AUDIO_VOICES];
+static int          nG_VoiceNext = 0;
+
+// written by the callback, read through a seqlock
+static n_AudioStats nG_AudioStats;
+static SDL_atomic_t nG_AudioStatsSeq;
+static SDL_atomic_t nG_AudioDropped;
+static uint64_t     nG_AudioLastCallback = 0;
+
+
+static bool nG_PushAudioCmd(const nG_AudioCmd* cmd)
+{
+    int head = SDL_AtomicGet(&nG_AudioCmdHead);
+
+    if (!nG_AudioDevice) {
+        return false;
+    }
+    if (head - SDL_AtomicGet(&nG_AudioCmdTail) >= nG_AUDIO_COMMANDS) {
+        SDL_AtomicAdd(&nG_AudioDropped, 1);
+        return false;
+    }
+
+    nG_AudioCmds[head & (nG_AUDIO_COMMANDS - 1)] = *cmd;
+    SDL_AtomicSet(&nG_AudioCmdHead, head + 1);
+    return true;
+}
+
+// Constant power panning.
+static void nG_AudioGain(float volume, float pan, float gain[2])
+{
+    float a = (fminf(fmaxf(pan, -1.0f), 1.0f) + 1.0f) * Float(M_PI / 4.0);
+
+    gain[0] = volume * cosf(a);
+    gain[1] = volume * sinf(a);
+}
+
+static void nG_StopAudioVoice(int i)
+{
+    nG_AudioVoices[i].sound = NULL;
+    SDL_AtomicSet(&nG_VoicePlaying[i], 0);
+}
+
+static void nG_RunAudioCmd(const nG_AudioCmd* cmd)
+{
+    nG_AudioVoice* v = &nG_AudioVoices[cmd->voice];
+
+    switch (cmd->type) {
+    case nG_AudioCmd_Play:
+        v->sound = cmd->sound;
+        v->pos = 0;
+        v->gen = cmd->gen;
+        v->loop = cmd->loop;
+        v->gain[0] = v->target[0] = cmd->gain[0];
+        v->gain[1] = v->target[1] = cmd->gain[1];
+        break;
+    case nG_AudioCmd_Stop:
+        if (v->sound && v->gen == cmd->gen) {
+            nG_StopAudioVoice(cmd->voice);
+        }
+        break;
+    case nG_AudioCmd_Volume:
+        if (v->sound && v->gen == cmd->gen) {
+            v->target[0] = cmd->gain[0];
+            v->target[1] = cmd->gain[1];
+        }
+        break;
+    case nG_AudioCmd_StopAll:
+    case nG_AudioCmd_Release:
+        for (int i = 0; i < nG_AUDIO_VOICES; i++) {
+            if (nG_AudioVoices[i].sound &&
+                (cmd->type == nG_AudioCmd_StopAll || nG_AudioVoices[i].sound == cmd->sound)) {
+                nG_StopAudioVoice(i);
+            }
+        }
+        break;
+    case nG_AudioCmd_Master:
+        nG_AudioMaster = cmd->gain[0];
+        break;
+    }
+}
+
+static void nG_RunAudioCmds(void)
+{
+    int tail = SDL_AtomicGet(&nG_AudioCmdTail);
+    int head = SDL_AtomicGet(&nG_AudioCmdHead);
+
+    for (; tail != head; tail++) {
+        nG_RunAudioCmd(&nG_AudioCmds[tail & (nG_AUDIO_COMMANDS - 1)]);
+    }
+
+    SDL_AtomicSet(&nG_AudioCmdTail, tail);
+}
+
+// out += src * gain, for <frames> stereo frames, with the gain moving
+// by <step> per frame.
+static void nG_MixVoice(float* out, const float* src, int frames, const float gain[2], const float step[2])
+{
+    int i = 0;
+
+#ifdef nG_SIMD_SSE
+    __m128 g0 = _mm_setr_ps(gain[0], gain[1], gain[0] + step[0], gain[1] + step[1]);
+    __m128 g1 = _mm_add_ps(g0, _mm_setr_ps(2.0f * step[0], 2.0f * step[1], 2.0f * step[0], 2.0f * step[1]));
+    __m128 d  = _mm_setr_ps(4.0f * step[0], 4.0f * step[1], 4.0f * step[0], 4.0f * step[1]);
+
+    for (; i + 4 <= frames; i += 4) {
+        __m128 o0 = _mm_loadu_ps(out + 2 * i);
+        __m128 o1 = _mm_loadu_ps(out + 2 * i + 4);
+        __m128 s0 = _mm_loadu_ps(src + 2 * i);
+        __m128 s1 = _mm_loadu_ps(src + 2 * i + 4);
+
+        _mm_storeu_ps(out + 2 * i,     _mm_add_ps(o0, _mm_mul_ps(s0, g0)));
+        _mm_storeu_ps(out + 2 * i + 4, _mm_add_ps(o1, _mm_mul_ps(s1, g1)));
+        g0 = _mm_add_ps(g0, d);
+        g1 = _mm_add_ps(g1, d);
+    }
+#endif // nG_SIMD_SSE
+
+    for (; i < frames; i++) {
+        out[2 * i]     += src[2 * i]     * (gain[0] + step[0] * i);
+        out[2 * i + 1] += src[2 * i + 1] * (gain[1] + step[1] * i);
+    }
+}
+
+// Applies the master volume and clamps to [-1, 1].
+static void nG_FinishAudio(float* out, int n)
+{
+    int i = 0;
+
+#ifdef nG_SIMD_SSE
+    __m128 m  = _mm_set1_ps(nG_AudioMaster);
+    __m128 lo = _mm_set1_ps(-1.0f);
+    __m128 hi = _mm_set1_ps(1.0f);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(out + i), m);
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(x, lo), hi));
+    }
+#endif // nG_SIMD_SSE
+
+    for (; i < n; i++) {
+        out[i] = fminf(fmaxf(out[i] * nG_AudioMaster, -1.0f), 1.0f);
+    }
+}
+
+static void nG_UpdateAudioStats(uint64_t start, int frames, int voices)
+{
+    uint64_t end = SDL_GetPerformanceCounter();
+    double   freq = Double(SDL_GetPerformanceFrequency());
+    float    ms = Float((end - start) * 1000.0 / freq);
+    float    budget = 1000.0f * frames / nG_AUDIO_FREQ;
+
+    SDL_AtomicAdd(&nG_AudioStatsSeq, 1);
+
+    n_AudioStats* st = &nG_AudioStats;
+    st->avgCallbackMs = (st->callbacks == 0) ? ms : st->avgCallbackMs + (ms - st->avgCallbackMs) / 16.0f;
+    st->maxCallbackMs = SDL_max(st->maxCallbackMs, ms);
+    st->budgetMs = budget;
+    st->overBudget += (ms > budget);
+    if (nG_AudioLastCallback != 0 && (start - nG_AudioLastCallback) * 1000.0 / freq > 1.5 * budget) {
+        st->underruns++;
+    }
+    st->voices = voices;
+    st->callbacks++;
+
+    SDL_AtomicAdd(&nG_AudioStatsSeq, 1);
+    nG_AudioLastCallback = start;
+}
+
+static void SDLCALL nG_AudioCallback(void* data, Uint8* stream, int len)
+{
+    uint64_t start = SDL_GetPerformanceCounter();
+    float*   out = (float *) stream;
+    int      frames = len / Int(2 * sizeof(float));
+    int      voices = 0;
+
+    memset(stream, 0, len);
+    nG_RunAudioCmds();
+
+    for (int i = 0; i < nG_AUDIO_VOICES; i++) {
+        nG_AudioVoice* v = &nG_AudioVoices[i];
+        float          step[2];
+        int            done = 0;
+
+        if (!v->sound) {
+            continue;
+        }
+
+        voices++;
+        step[0] = (v->target[0] - v->gain[0]) / frames;
+        step[1] = (v->target[1] - v->gain[1]) / frames;
+
+        while (done < frames && v->sound) {
+            int   n = SDL_min(frames - done, Int(v->sound->frames - v->pos));
+            float gain[2] = { v->gain[0] + step[0] * done, v->gain[1] + step[1] * done };
+
+            nG_MixVoice(out + 2 * done, v->sound->samples + 2 * v->pos, n, gain, step);
+            done += n;
+            v->pos += n;
+
+            if (v->pos >= v->sound->frames) {
+                if (v->loop && v->sound->frames > 0) {
+                    v->pos = 0;
+                } else {
+                    nG_StopAudioVoice(i);
+                }
+            }
+        }
+
+        v->gain[0] = v->target[0];
+        v->gain[1] = v->target[1];
+    }
+
+    nG_FinishAudio(out, 2 * frames);
+    nG_UpdateAudioStats(start, frames, voices);
+}
+
+static bool nG_InitAudio(void)
+{
+    SDL_AudioSpec want = {
+        .freq = nG_AUDIO_FREQ,
+        .format = AUDIO_F32SYS,
+        .channels = 2,
+        .samples = nG_AUDIO_SAMPLES,
+        .callback = nG_AudioCallback
+    };
+
+    // no allowed changes: SDL converts if the hardware differs
+    nG_AudioDevice = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (!nG_AudioDevice) {
+        n_LogErrorf("Unable to open the audio device: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_PauseAudioDevice(nG_AudioDevice, 0);
+    return true;
+}
+
+static void nG_QuitAudio(void)
+{
+    if (nG_AudioDevice) {
+        SDL_CloseAudioDevice(nG_AudioDevice);
+        nG_AudioDevice = 0;
+    }
+}
+
+n_Sound* n_LoadSound(const char *restrict path)
+{
+    char filepath[2 * nG_BaseLoaderPathMaxLen + 1];
+
+    snprintf(filepath, 2 * nG_BaseLoaderPathMaxLen, "%s%s", nG_BaseLoaderPath, path);
+
+    SDL_AudioSpec spec;
+    Uint8*        buf;
+    Uint32        len;
+
+    if (!SDL_LoadWAV(filepath, &spec, &buf, &len)) {
+        n_LogErrorf("Unable to load sound '%s': %s\n", filepath, SDL_GetError());
+        return NULL;
+    }
+
+    SDL_AudioStream* stream = SDL_NewAudioStream(
+        spec.format, spec.channels, spec.freq, AUDIO_F32SYS, 2, nG_AUDIO_FREQ
+    );
+    n_Sound* sound = NULL;
+
+    if (stream && SDL_AudioStreamPut(stream, buf, len) == 0 && SDL_AudioStreamFlush(stream) == 0) {
+        int bytes = SDL_AudioStreamAvailable(stream);
+
+        sound = n_NewTagged(n_Sound, 1, n_AllocTag_Sounds);
+        if (sound) {
+            sound->samples = n_NewTagged(float, bytes / sizeof(float) + 1, n_AllocTag_Sounds);
+            sound->frames = UInt32(bytes / (2 * sizeof(float)));
+        }
+        if (!sound || !sound->samples || SDL_AudioStreamGet(stream, sound->samples, bytes) < 0) {
+            n_DeleteSound(&sound);
+        }
+    }
+
+    if (!sound) {
+        n_LogErrorf("Unable to decode sound '%s': %s\n", filepath, SDL_GetError());
+    }
+
+    SDL_FreeAudioStream(stream);
+    SDL_FreeWAV(buf);
+    return sound;
+}
+
+void n_DeleteSound(n_Sound** sound)
+{
+    if (sound && *sound) {
+        if (nG_AudioDevice) {
+            // the callback doesn't run while the device is locked (even
+            // if it's paused or lost): the queued commands, plays of this
+            // sound included, are run here and its voices are stopped
+            nG_AudioCmd cmd = { .type = nG_AudioCmd_Release, .sound = *sound };
+
+            SDL_LockAudioDevice(nG_AudioDevice);
+            nG_RunAudioCmds();
+            nG_RunAudioCmd(&cmd);
+            SDL_UnlockAudioDevice(nG_AudioDevice);
+        }
+
+        n_Delete((*sound)->samples);
+        n_Delete(*sound);
+    }
+}
+
+n_Voice n_PlaySound(n_Sound* sound, float volume, float pan, bool loop)
+{
+    if (!sound || !n_RequireSubsystems(n_Subsystem_Audio)) {
+        return 0;
+    }
+
+    for (int k = 0; k < nG_AUDIO_VOICES; k++) {
+        int i = (nG_VoiceNext + k) % nG_AUDIO_VOICES;
+
+        if (SDL_AtomicGet(&nG_VoicePlaying[i])) {
+            continue;
+        }
+
+        // marked as playing before the callback can see the command,
+        // which clears the flag once a short sound is over
+        nG_VoiceGen[i]++;
+        SDL_AtomicSet(&nG_VoicePlaying[i], 1);
+
+        nG_AudioCmd cmd = {
+            .type = nG_AudioCmd_Play,
+            .loop = loop,
+            .voice = UInt16(i),
+            .gen = nG_VoiceGen[i],
+            .sound = sound
+        };
+        nG_AudioGain(volume, pan, cmd.gain);
+        if (!nG_PushAudioCmd(&cmd)) {
+            SDL_AtomicSet(&nG_VoicePlaying[i], 0);
+            nG_VoiceGen[i]--;
+            return 0;
+        }
+
+        nG_VoiceNext = i + 1;
+        return (UInt32(nG_VoiceGen[i]) << 16) | UInt32(i + 1);
+    }
+
+    return 0;
+}
+
+// Index of a voice handle that is still current, or -1.
+static int nG_VoiceIndex(n_Voice voice)
+{
+    int i = Int(voice & 0xFFFF) - 1;
+
+    if (i < 0 || i >= nG_AUDIO_VOICES || nG_VoiceGen[i] != (voice >> 16)) {
+        return -1;
+    }
+    return i;
+}
+
+void n_StopVoice(n_Voice voice)
+{
+    int i = nG_VoiceIndex(voice);
+
+    if (i >= 0) {
+        nG_AudioCmd cmd = { .type = nG_AudioCmd_Stop, .voice = UInt16(i), .gen = nG_VoiceGen[i] };
+        nG_PushAudioCmd(&cmd);
+    }
+}
+
+void n_StopAllVoices(void)
+{
+    nG_AudioCmd cmd = { .type = nG_AudioCmd_StopAll };
+    nG_PushAudioCmd(&cmd);
+}
+
+void n_SetVoiceVolume(n_Voice voice, float volume, float pan)
+{
+    int i = nG_VoiceIndex(voice);
+
+    if (i >= 0) {
+        nG_AudioCmd cmd = { .type = nG_AudioCmd_Volume, .voice = UInt16(i), .gen = nG_VoiceGen[i] };
+        nG_AudioGain(volume, pan, cmd.gain);
+        nG_PushAudioCmd(&cmd);
+    }
+}
+
+bool n_IsVoicePlaying(n_Voice voice)
+{
+    int i = nG_VoiceIndex(voice);
+    return i >= 0 && SDL_AtomicGet(&nG_VoicePlaying[i]);
+}
+
+void n_SetMasterVolume(float volume)
+{
+    nG_AudioCmd cmd = { .type = nG_AudioCmd_Master, .gain = { volume, volume } };
+
+    // no callback running yet
+    if (!nG_AudioDevice) {
+        nG_AudioMaster = volume;
+        return;
+    }
+    nG_PushAudioCmd(&cmd);
+}
+
+void n_GetAudioStats(n_AudioStats* stats)
+{
+    int seq;
+
+    do {
+        seq = SDL_AtomicGet(&nG_AudioStatsSeq);
+        *stats = nG_AudioStats;
+    } while ((seq & 1) || seq != SDL_AtomicGet(&nG_AudioStatsSeq));
+
+    stats->droppedCommands = UInt32(SDL_AtomicGet(&nG_AudioDropped));
+}
+
+
+// ========================================================
+//
+// CAPTURE
+//
+// ========================================================
+
+
+#define nG_CapturePathMaxLen 255
+
+
+// Owned by the main thread until the head passes it, then by the writer
+// until the tail does.
+static uint8_t*        nG_CaptureBuffers[nG_CAPTURE_BUFFERS];
+static SDL_atomic_t    nG_CaptureHead;
+static SDL_atomic_t    nG_CaptureTail;
+static SDL_atomic_t    nG_CaptureRunning;
+static SDL_sem*        nG_CaptureSem     = NULL;
+static SDL_Thread*     nG_CaptureThread  = NULL;
+static n_Context*      nG_CaptureCtx     = NULL;
+static FILE*           nG_CaptureFile    = NULL;
+static n_CaptureFormat nG_CaptureFormat  = n_CaptureFormat_Raw;
+static char            nG_CapturePath[nG_CapturePathMaxLen + 1];
+static int             nG_CaptureWidth   = 0;
+static int             nG_CaptureHeight  = 0;
+static uint32_t        nG_CaptureEvery   = 1;
+static uint32_t        nG_CaptureFrames  = 0;
+static n_CaptureStats  nG_CaptureStats;
+static SDL_SpinLock    nG_CaptureLock    = 0;
+
+
+static float nG_MsSince(uint64_t start)
+{
+    return Float((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static bool nG_WriteCapture(const uint8_t* pixels, uint32_t n)
+{
+    if (nG_CaptureFormat == n_CaptureFormat_Raw) {
+        size_t size = 4 * UInt64(nG_CaptureWidth) * nG_CaptureHeight;
+        return fwrite(pixels, 1, size, nG_CaptureFile) == size;
+    }
+
+    char         name[nG_CapturePathMaxLen + 16];
+    SDL_Surface* s = SDL_CreateRGBSurfaceWithFormatFrom(
+        (void *) pixels,
+        nG_CaptureWidth,
+        nG_CaptureHeight,
+        32,
+        4 * nG_CaptureWidth,
+        SDL_PIXELFORMAT_ARGB8888
+    );
+    bool ok = s != NULL;
+
+    snprintf(name, sizeof(name), "%s%06u.png", nG_CapturePath, n);
+    ok = ok && IMG_SavePNG(s, name) == 0;
+    SDL_FreeSurface(s);
+    return ok;
+}
+
+static int nG_CaptureWriter(void* data)
+{
+    uint32_t n = 0;
+    bool     failed = false;
+
+    while (true) {
+        bool running = SDL_AtomicGet(&nG_CaptureRunning);
+        int  tail = SDL_AtomicGet(&nG_CaptureTail);
+
+        if (tail == SDL_AtomicGet(&nG_CaptureHead)) {
+            if (!running) {
+                break;
+            }
+            SDL_SemWaitTimeout(nG_CaptureSem, 100);
+            continue;
+        }
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        bool     ok = nG_WriteCapture(nG_CaptureBuffers[tail % nG_CAPTURE_BUFFERS], n++);
+        float    ms = nG_MsSince(start);
+
+        SDL_AtomicSet(&nG_CaptureTail, tail + 1);
+
+        if (!ok && !failed) {
+            n_LogErrorf("Unable to write the captured frames to '%s'.\n", nG_CapturePath);
+            failed = true;
+        }
+
+        SDL_AtomicLock(&nG_CaptureLock);
+        if (ok) {
+            n_CaptureStats* st = &nG_CaptureStats;
+
+            st->avgWriteMs = (st->written == 0) ? ms : st->avgWriteMs + (ms - st->avgWriteMs) / 16.0f;
+            st->written++;
+        }
+        SDL_AtomicUnlock(&nG_CaptureLock);
+    }
+    return 0;
+}
+
+// Called by n_Present() before the frame is shown.
+static void nG_CaptureFrame(void)
+{
+    if (!SDL_AtomicGet(&nG_CaptureRunning) || nG_Ctx != nG_CaptureCtx) {
+        return;
+    }
+    if ((nG_CaptureFrames++ % nG_CaptureEvery) != 0) {
+        return;
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    int      head = SDL_AtomicGet(&nG_CaptureHead);
+    int      w, h;
+    bool     ok = SDL_GetRendererOutputSize(nG_Renderer, &w, &h) == 0
+        && w == nG_CaptureWidth
+        && h == nG_CaptureHeight
+        && (head - SDL_AtomicGet(&nG_CaptureTail)) < nG_CAPTURE_BUFFERS;
+
+    ok = ok && SDL_RenderReadPixels(
+        nG_Renderer,
+        NULL,
+        SDL_PIXELFORMAT_ARGB8888,
+        nG_CaptureBuffers[head % nG_CAPTURE_BUFFERS],
+        4 * nG_CaptureWidth
+    ) == 0;
+
+    if (ok) {
+        SDL_AtomicSet(&nG_CaptureHead, head + 1);
+        SDL_SemPost(nG_CaptureSem);
+    }
+
+    float ms = nG_MsSince(start);
+
+    SDL_AtomicLock(&nG_CaptureLock);
+    n_CaptureStats* st = &nG_CaptureStats;
+    if (ok) {
+        st->avgReadbackMs = (st->captured == 0) ? ms : st->avgReadbackMs + (ms - st->avgReadbackMs) / 16.0f;
+        st->maxReadbackMs = SDL_max(st->maxReadbackMs, ms);
+        st->captured++;
+    } else {
+        st->dropped++;
+    }
+    SDL_AtomicUnlock(&nG_CaptureLock);
+}
+
+bool n_StartCapture(const char *restrict path, n_CaptureFormat format, uint32_t interval)
+{
+    if (SDL_AtomicGet(&nG_CaptureRunning)) {
+        n_StopCapture();
+    }
+
+    if (!path || strlen(path) > nG_CapturePathMaxLen) {
+        n_LogErrorf("Invalid capture path.\n");
+        return false;
+    }
+    if (format == n_CaptureFormat_PNG && !n_RequireSubsystems(n_Subsystem_Images)) {
+        return false;
+    }
+    if (SDL_GetRendererOutputSize(nG_Renderer, &nG_CaptureWidth, &nG_CaptureHeight) < 0) {
+        n_LogErrorf("Unable to get the size of the frames to capture: %s\n", SDL_GetError());
+        return false;
+    }
+
+    strcpy(nG_CapturePath, path);
+    nG_CaptureFormat = format;
+    nG_CaptureEvery  = interval > 0 ? interval : 1;
+    nG_CaptureFrames = 0;
+    nG_CaptureCtx    = nG_Ctx;
+    nG_CaptureStats  = (n_CaptureStats) {0};
+    SDL_AtomicSet(&nG_CaptureHead, 0);
+    SDL_AtomicSet(&nG_CaptureTail, 0);
+
+    bool ok = true;
+    for (int i = 0; i < nG_CAPTURE_BUFFERS; i++) {
+        nG_CaptureBuffers[i] = n_NewTagged(uint8_t, 4 * nG_CaptureWidth * nG_CaptureHeight, n_AllocTag_Engine);
+        ok = ok && nG_CaptureBuffers[i];
+    }
+
+    if (ok && format == n_CaptureFormat_Raw && !(nG_CaptureFile = fopen(path, "wb"))) {
+        n_LogErrorf("Unable to open '%s'.\n", path);
+        ok = false;
+    }
+
+    ok = ok && (nG_CaptureSem = SDL_CreateSemaphore(0)) != NULL;
+    if (ok) {
+        SDL_AtomicSet(&nG_CaptureRunning, 1);
+        nG_CaptureThread = SDL_CreateThread(nG_CaptureWriter, "nolib capture", NULL);
+        ok = nG_CaptureThread != NULL;
+    }
+
+    if (!ok) {
+        n_LogErrorf("Unable to start capturing: %s\n", SDL_GetError());
+        SDL_AtomicSet(&nG_CaptureRunning, 0);
+        n_StopCapture();
+        return false;
+    }
+
+    n_LogInfof("Capturing %dx%d frames to '%s'.\n", nG_CaptureWidth, nG_CaptureHeight, path);
+    return true;
+}
+
+void n_StopCapture(void)
+{
+    SDL_AtomicSet(&nG_CaptureRunning, 0);
+
+    if (nG_CaptureThread) {
+        SDL_SemPost(nG_CaptureSem);
+        SDL_WaitThread(nG_CaptureThread, NULL);
+        nG_CaptureThread = NULL;
+    }
+    if (nG_CaptureSem) {
+        SDL_DestroySemaphore(nG_CaptureSem);
+        nG_CaptureSem = NULL;
+    }
+    if (nG_CaptureFile) {
+        fclose(nG_CaptureFile);
+        nG_CaptureFile = NULL;
+    }
+    for (int i = 0; i < nG_CAPTURE_BUFFERS; i++) {
+        n_Delete(nG_CaptureBuffers[i]);
+    }
+    nG_CaptureCtx = NULL;
+}
+
+bool n_IsCapturing(void)
+{
+    return SDL_AtomicGet(&nG_CaptureRunning) != 0;
+}
+
+n_CaptureStats n_GetCaptureStats(void)
+{
+    SDL_AtomicLock(&nG_CaptureLock);
+    n_CaptureStats st = nG_CaptureStats;
+    SDL_AtomicUnlock(&nG_CaptureLock);
+
+    return st;
+}
+
+
+// ========================================================
+//
+// TIMER
+//
+// ========================================================
+
+
+#define nG_TimerWheelBits   6
+#define nG_TimerWheelSlots  (1 << nG_TimerWheelBits)
+#define nG_TimerWheelMask   (nG_TimerWheelSlots - 1)
+#define nG_TimerWheelLevels 4
+#define nG_TimerWheelRange  (UINT64_C(1) << (nG_TimerWheelBits * nG_TimerWheelLevels))
+
+// per clock: one list per slot plus the list being expired
+#define nG_TimerLists       (nG_TimerWheelLevels * nG_TimerWheelSlots + 1)
+#define nG_TimerNil         UINT32_MAX
+#define nG_TimerFree        UINT16_MAX
+
+#if nG_TIMER_CAPACITY >= 0xFFFF
+    #error "nG_TIMER_CAPACITY must be less than 65535"
+#endif
+
+
+typedef struct {
+    n_TimerFn fn;
+    void*     data;
+    uint64_t  expires;
+    uint32_t  interval;
+    uint32_t  next;
+    uint32_t  prev;
+    uint16_t  list;
+    uint16_t  generation;
+    uint8_t   clock;
+} nG_TimerNode;
+
+typedef struct {
+    double   time;
+    uint64_t tick;
+    uint32_t heads[nG_TimerLists];
+} nG_TimerWheel;
+
+
+static nG_TimerNode  nG_Timers[nG_TIMER_CAPACITY];
+static nG_TimerWheel nG_TimerWheels[2];
+static uint32_t      nG_TimerFreeList;
+static bool          nG_TimerInitialized = false;
+static float         nG_TimeScale        = 1.0f;
+
+
+static void nG_InitTimers(void)
+{
+    for (uint32_t i = 0; i < nG_TIMER_CAPACITY; i++) {
+        nG_Timers[i].next = (i + 1 < nG_TIMER_CAPACITY) ? i + 1 : nG_TimerNil;
+        nG_Timers[i].list = nG_TimerFree;
+    }
+
+    for (int c = 0; c < 2; c++) {
+        for (int l = 0; l < nG_TimerLists; l++) {
+            nG_TimerWheels[c].heads[l] = nG_TimerNil;
+        }
+    }
+
+    nG_TimerFreeList    = 0;
+    nG_TimerInitialized = true;
+}
+
+static void nG_LinkTimer(nG_TimerWheel* w, uint32_t i, uint16_t list)
+{
+    nG_TimerNode* t = &nG_Timers[i];
+
+    t->list = list;
+    t->prev = nG_TimerNil;
+    t->next = w->heads[list];
+
+    if (t->next != nG_TimerNil) {
+        nG_Timers[t->next].prev = i;
+    }
+
+    w->heads[list] = i;
+}
+
+static void nG_UnlinkTimer(nG_TimerWheel* w, uint32_t i)
+{
+    nG_TimerNode* t = &nG_Timers[i];
+
+    if (t->prev != nG_TimerNil) {
+        nG_Timers[t->prev].next = t->next;
+    } else {
+        w->heads[t->list] = t->next;
+    }
+
+    if (t->next != nG_TimerNil) {
+        nG_Timers[t->next].prev = t->prev;
+    }
+}
+
+// Picks the wheel level by how far in the future the timer expires.
+static void nG_ScheduleTimer(nG_TimerWheel* w, uint32_t i)
+{
+    uint64_t expires = nG_Timers[i].expires;
+    uint64_t delta   = expires - w->tick;
+    int      level   = 0;
+
+    if (delta >= nG_TimerWheelRange) {
+        // too far away: park it in the last level, it will be
+        // rescheduled when that slot is cascaded.
+        expires = w->tick + nG_TimerWheelRange - 1;
+        delta   = nG_TimerWheelRange - 1;
+    }
+
+    while (delta >= (UINT64_C(1) << (nG_TimerWheelBits * (level + 1)))) {
+        level++;
+    }
+
+    uint32_t slot = UInt32(expires >> (nG_TimerWheelBits * level)) & nG_TimerWheelMask;
+
+    nG_LinkTimer(w, i, UInt16(level * nG_TimerWheelSlots + slot));
+}
+
+static void nG_CascadeTimers(nG_TimerWheel* w, int level)
+{
+    uint32_t slot = UInt32(w->tick >> (nG_TimerWheelBits * level)) & nG_TimerWheelMask;
+    uint16_t list = UInt16(level * nG_TimerWheelSlots + slot);
+    uint32_t i    = w->heads[list];
+
+    w->heads[list] = nG_TimerNil;
+
+    while (i != nG_TimerNil) {
+        uint32_t next = nG_Timers[i].next;
+        nG_ScheduleTimer(w, i);
+        i = next;
+    }
+}
+
+static void nG_ReleaseTimer(uint32_t i)
+{
+    nG_Timers[i].list = nG_TimerFree;
+    nG_Timers[i].generation++;
+    nG_Timers[i].next = nG_TimerFreeList;
+    nG_TimerFreeList  = i;
+}
+
+static void nG_AdvanceTimers(n_Clock clock, float seconds)
+{
+    if (!nG_TimerInitialized) {
+        return;
+    }
+
+    const uint16_t expiring = nG_TimerLists - 1;
+    nG_TimerWheel* w        = &nG_TimerWheels[clock];
+    uint64_t       target;
+
+    w->time += seconds;
+    target   = UInt64(w->time * 1000.0);
+
+    while (w->tick < target) {
+        w->tick++;
+
+        for (int l = 1; l < nG_TimerWheelLevels; l++) {
+            // a level is cascaded every time the one below wraps
+            if ((w->tick & ((UINT64_C(1) << (nG_TimerWheelBits * l)) - 1)) != 0) {
+                break;
+            }
+
+            nG_CascadeTimers(w, l);
+        }
+
+        // move the due slot aside, so that callbacks may add and
+        // cancel timers (including the ones still to run).
+        uint16_t due = UInt16(w->tick & nG_TimerWheelMask);
+        uint32_t i   = w->heads[due];
+
+        w->heads[due] = nG_TimerNil;
+        while (i != nG_TimerNil) {
+            uint32_t next = nG_Timers[i].next;
+            nG_LinkTimer(w, i, expiring);
+            i = next;
+        }
+
+        while ((i = w->heads[expiring]) != nG_TimerNil) {
+            nG_TimerNode* t   = &nG_Timers[i];
+            n_Timer       id  = (UInt32(t->generation) << 16) | (i + 1);
+
+            nG_UnlinkTimer(w, i);
+
+            if (t->interval > 0) {
+                t->expires += t->interval;
+                nG_ScheduleTimer(w, i);
+                t->fn(id, t->data);
+            } else {
+                n_TimerFn fn   = t->fn;
+                void*     data = t->data;
+
+                nG_ReleaseTimer(i);
+                fn(id, data);
+            }
+        }
+    }
+}
+
+
+n_Timer n_AddTimer(
+    n_Clock   clock,
+    float     delay,
+    float     interval,
+    n_TimerFn fn,
+    void*     data
+) {
+    if (!fn || (clock != n_Clock_Game && clock != n_Clock_Wall)) {
+        return 0;
+    }
+
+    if (!nG_TimerInitialized) {
+        nG_InitTimers();
+    }
+
+    if (nG_TimerFreeList == nG_TimerNil) {
+        n_LogWarnf("No free timers (nG_TIMER_CAPACITY = %d).\n", nG_TIMER_CAPACITY);
+        return 0;
+    }
+
+    nG_TimerWheel* w     = &nG_TimerWheels[clock];
+    uint32_t       i     = nG_TimerFreeList;
+    nG_TimerNode*  t     = &nG_Timers[i];
+    uint64_t       ticks = delay > 0.0f ? UInt64(delay * 1000.0f) : 0;
+
+    nG_TimerFreeList = t->next;
+
+    t->fn       = fn;
+    t->data     = data;
+    t->clock    = UInt8(clock);
+    t->expires  = w->tick + (ticks > 0 ? ticks : 1);
+    t->interval = 0;
+
+    if (interval > 0.0f) {
+        uint32_t it = UInt32(interval * 1000.0f);
+        t->interval = it > 0 ? it : 1;
+    }
+
+    nG_ScheduleTimer(w, i);
+
+    return (UInt32(t->generation) << 16) | (i + 1);
+}
+
+bool n_CancelTimer(n_Timer timer)
+{
+    uint32_t i = (timer & 0xFFFF) - 1;
+
+    if (!nG_TimerInitialized || timer == 0 || i >= nG_TIMER_CAPACITY) {
+        return false;
+    }
+
+    nG_TimerNode* t = &nG_Timers[i];
+
+    if (t->list == nG_TimerFree || t->generation != UInt16(timer >> 16)) {
+        return false;
+    }
+
+    nG_UnlinkTimer(&nG_TimerWheels[t->clock], i);
+    nG_ReleaseTimer(i);
+
+    return true;
+}
+
+void n_SetTimeScale(float scale)
+{
+    nG_TimeScale = scale > 0.0f ? scale : 0.0f;
+}
+
+
+// ========================================================
+//
+// COROUTINES
+//
+// ========================================================
+
+
+#define nG_CoroutineNil UINT16_MAX
+
+#if nG_COROUTINE_CAPACITY >= 0xFFFF
+    #error "nG_COROUTINE_CAPACITY must be less than 65535"
+#endif
+
+
+typedef struct {
+    n_Co          co;
+    n_CoroutineFn fn;
+    void*         data;
+    uint16_t      id;
+} nG_CoroutineSlot;
+
+
+// Running coroutines, packed in the order they started. Handles go
+// through an id (index and generation) to their slot.
+static nG_CoroutineSlot nG_Coroutines[nG_COROUTINE_CAPACITY];
+static uint32_t         nG_CoroutineCount = 0;
+static uint16_t         nG_CoroutineSlots[nG_COROUTINE_CAPACITY];
+static uint16_t         nG_CoroutineGens[nG_COROUTINE_CAPACITY];
+static uint16_t         nG_CoroutineFree[nG_COROUTINE_CAPACITY];
+static uint32_t         nG_CoroutineNFree = 0;
+static uint32_t         nG_CoroutineNIds  = 0;
+
+
+static nG_CoroutineSlot* nG_FindCoroutine(n_Coroutine co)
+{
+    uint32_t id = (co & 0xFFFF) - 1;
+
+    if (co == 0 || id >= nG_CoroutineNIds || nG_CoroutineGens[id] != UInt16(co >> 16)) {
+        return NULL;
+    }
+
+    uint16_t slot = nG_CoroutineSlots[id];
+
+    if (slot == nG_CoroutineNil || nG_Coroutines[slot].co.wait == nG_CoWait_Done) {
+        return NULL;
+    }
+    return &nG_Coroutines[slot];
+}
+
+// Called by n_Run() every frame, with the game time step.
+static void nG_ResumeCoroutines(float dt)
+{
+    // the ones started meanwhile wait for the next frame
+    uint32_t n = nG_CoroutineCount;
+    uint32_t kept = 0;
+
+    for (uint32_t i = 0; i < n; i++) {
+        nG_CoroutineSlot* c = &nG_Coroutines[i];
+
+        switch (c->co.wait) {
+        case nG_CoWait_Seconds:
+            c->co.until.seconds -= dt;
+            if (c->co.until.seconds > 0.0f) {
+                continue;
+            }
+            break;
+        case nG_CoWait_Frames:
+            // 0 frames resumes in the next one, like 1
+            if (c->co.until.frames > 1) {
+                c->co.until.frames--;
+                continue;
+            }
+            break;
+        case nG_CoWait_Done:
+            continue;
+        }
+
+        c->co.wait = nG_CoWait_None;
+        c->fn(&c->co, c->data);
+    }
+
+    // drop the ones that ended (or were stopped), keeping the order
+    for (uint32_t i = 0; i < nG_CoroutineCount; i++) {
+        nG_CoroutineSlot* c = &nG_Coroutines[i];
+
+        if (c->co.wait == nG_CoWait_Done) {
+            nG_CoroutineGens[c->id]++;
+            nG_CoroutineSlots[c->id] = nG_CoroutineNil;
+            nG_CoroutineFree[nG_CoroutineNFree++] = c->id;
+            continue;
+        }
+
+        nG_CoroutineSlots[c->id] = UInt16(kept);
+        nG_Coroutines[kept++] = *c;
+    }
+    nG_CoroutineCount = kept;
+}
+
+n_Coroutine n_StartCoroutine(n_CoroutineFn fn, void* data)
+{
+    if (!fn) {
+        return 0;
+    }
+
+    if (nG_CoroutineCount == nG_COROUTINE_CAPACITY) {
+        n_LogWarnf("No free coroutines (nG_COROUTINE_CAPACITY = %d).\n", nG_COROUTINE_CAPACITY);
+        return 0;
+    }
+
+    uint16_t id = nG_CoroutineNFree > 0
+        ? nG_CoroutineFree[--nG_CoroutineNFree]
+        : UInt16(nG_CoroutineNIds++);
+
+    nG_Coroutines[nG_CoroutineCount] = (nG_CoroutineSlot) {
+        .co   = {.line = 0, .wait = nG_CoWait_Frames, .until.frames = 1},
+        .fn   = fn,
+        .data = data,
+        .id   = id
+    };
+    nG_CoroutineSlots[id] = UInt16(nG_CoroutineCount++);
+
+    return (UInt32(nG_CoroutineGens[id]) << 16) | (id + 1);
+}
+
+bool n_StopCoroutine(n_Coroutine co)
+{
+    nG_CoroutineSlot* c = nG_FindCoroutine(co);
+
+    // it's removed at the end of the frame's pass
+    if (c) {
+        c->co.wait = nG_CoWait_Done;
+    }
+    return c != NULL;
+}
+
+bool n_IsCoroutineRunning(n_Coroutine co)
+{
+    return nG_FindCoroutine(co) != NULL;
+}
+
+
+// ========================================================
+//
+// RUNTIME
+//
+// ========================================================
+
+
+void n_Quit(void)
+{
+    n_ShouldQuit = true;
+}
+
+
+static bool           nG_LowLatency   = false;
+static n_LatencyStats nG_LatencyStats = {0};
+// when the last SDL_RenderPresent() returned (about the vsync)
+static uint64_t       nG_LastPresent  = 0;
+
+
+static double nG_CounterMs(uint64_t ticks)
+{
+    return ticks * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static double nG_FramePeriodMs(int frameTime)
+{
+    SDL_DisplayMode mode;
+    int             display = nG_Window ? SDL_GetWindowDisplayIndex(nG_Window) : -1;
+    double          period  = frameTime;
+
+    if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0) {
+        period = fmax(period, 1000.0 / mode.refresh_rate);
+    }
+    return period;
+}
 
+// Sleeps until the next vsync that the frame can still make is only
+// the expected frame time (plus a margin) away. Returns the ms slept.
+static float nG_WaitForVsync(int frameTime)
+{
+    if (nG_LastPresent == 0) {
+        return 0.0f;
+    }
 
-static SDL_Renderer* nG_Renderer;
+    // a frame time of 0 without a known refresh rate has no period
+    double period = fmax(nG_FramePeriodMs(frameTime), 1.0);
+    double lead   = nG_LatencyStats.workMs + nG_LATENCY_MARGIN;
+    double since  = nG_CounterMs(SDL_GetPerformanceCounter() - nG_LastPresent);
+    double wake   = period - lead;
 
-static SDL_Window* nG_Window;
+    // the first vsync after now (after a long frame, several went by)
+    if (wake < since) {
+        wake += ceil((since - wake) / period) * period;
+    }
 
+    // sleep coarsely, then spin over the scheduler's granularity
+    if (wake - since > 2.0) {
+        SDL_Delay(UInt32(wake - since - 2.0));
+    }
 
-// ========================================================
-//
-// MATH
-//
-// ========================================================
+    uint64_t target = nG_LastPresent + UInt64(wake * SDL_GetPerformanceFrequency() / 1000.0);
+
+    while (SDL_GetPerformanceCounter() < target) {
+        SDL_Delay(0);
+    }
 
+    return Float(wake - since);
+}
 
-bool n_IsValidRect(const n_Rect *restrict r)
+static void nG_EndLatencyFrame(uint64_t sampled, uint32_t oldestEvent, float slept)
 {
-    return !r ? false : (r->w > 0.0f && r->h > 0.0f);
+    n_LatencyStats* st   = &nG_LatencyStats;
+    uint64_t        now  = SDL_GetPerformanceCounter();
+    float           in   = Float(nG_CounterMs(now - sampled));
+    float           work = Float(nG_CounterMs(nG_PresentStart - sampled));
+    float           ev   = oldestEvent ? Float(SDL_GetTicks() - oldestEvent) : in;
+
+    st->avgInputMs = (st->frames == 0) ? in : st->avgInputMs + (in - st->avgInputMs) / 16.0f;
+    st->avgEventMs = (st->frames == 0) ? ev : st->avgEventMs + (ev - st->avgEventMs) / 16.0f;
+    st->avgSleepMs = (st->frames == 0) ? slept : st->avgSleepMs + (slept - st->avgSleepMs) / 16.0f;
+    st->maxInputMs = SDL_max(st->maxInputMs, in);
+    st->maxEventMs = SDL_max(st->maxEventMs, ev);
+    // a slowly decaying peak, so that a spike doesn't miss the vsync twice
+    st->workMs     = SDL_max(0.95f * st->workMs, work);
+    st->frames++;
+
+    nG_LastPresent = now;
 }
 
-bool n_RectsOverlap(n_Rect *restrict a, n_Rect *restrict b)
+void n_SetLowLatency(bool enabled)
 {
-    if (a && b) {
-        return a->x < (b->x + b->w)
-            && b->x < (a->x + a->w)
-            && a->y < (b->y + b->h)
-            && b->y < (a->y + a->h);
+    nG_LowLatency   = enabled;
+    nG_LatencyStats = (n_LatencyStats) {0};
+}
+
+n_LatencyStats n_GetLatencyStats(void)
+{
+    return nG_LatencyStats;
+}
+
+void n_Run(uint32_t fps, n_IGame *restrict game)
+{
+    const int FRAME_TIME = Int(1000.0 / fps);
+    n_GameTime gt = {0.0f, 0.0f};
+    uint32_t  curr  = 0;
+    uint32_t  prev  = 0;
+    uint32_t  delta = 0;
+    SDL_Event e;
+
+    game->init(game, gt);
+    prev = SDL_GetTicks();
+
+    while (!n_ShouldQuit) {
+        float    slept  = nG_LowLatency ? nG_WaitForVsync(FRAME_TIME) : 0.0f;
+        uint32_t oldest = 0;
+
+        curr  = SDL_GetTicks();
+        delta = curr - prev;
+
+        if (nG_LowLatency || delta >=  FRAME_TIME) {
+            uint64_t started = SDL_GetPerformanceCounter();
+
+            nG_ScaleFrameStart = started;
+
+            n_ClearBackground(
+                n_DefaultBGColor.r,
+                n_DefaultBGColor.g,
+                n_DefaultBGColor.b,
+                n_DefaultBGColor.a
+            );
+
+            while (!n_ShouldQuit && SDL_PollEvent(&e) > 0) {
+                switch(e.type)
+                {
+                case SDL_QUIT:
+                    n_ShouldQuit = true;
+                    break;
+                case SDL_WINDOWEVENT:
+                    n_InvalidateScreen();
+                    game->ehandler(game, &e);
+                    break;
+                default:
+                    if (nG_InputMode != n_InputMode_Replay || !nG_IsInputEvent(&e)) {
+                        game->ehandler(game, &e);
+                    }
+                    if (nG_IsInputEvent(&e) && (!oldest || e.common.timestamp < oldest)) {
+                        oldest = e.common.timestamp;
+                    }
+                    break;
+                }
+            }
+
+            float dt = Float(delta) / 1000.0f;
+
+            if (!nG_UpdateInput(&dt)) {
+                // the recording has ended
+                break;
+            }
+
+            uint64_t sampled = SDL_GetPerformanceCounter();
+
+            gt.deltaTime  = nG_TimeScale * dt;
+            gt.totalTime += gt.deltaTime;
+            prev = curr;
+
+            nG_AdvanceTimers(n_Clock_Wall, dt);
+            nG_AdvanceTimers(n_Clock_Game, gt.deltaTime);
+            nG_ResumeCoroutines(gt.deltaTime);
+            nG_RunSystems(gt);
+
+            game->step(game, gt);
+
+            uint64_t stepped = SDL_GetPerformanceCounter();
+
+            n_Present();
+            nG_EndLatencyFrame(sampled, oldest, slept);
+            nG_EndAllocFrame();
+            nG_EndTelemetryFrame(started, sampled, stepped);
+        }
     }
-    return false;
+
+    game->finalize(game, gt);
+}
+
+void n_Step(n_IGame *restrict game, n_GameTime *restrict gt, float dt)
+{
+    n_ClearBackground(
+        n_DefaultBGColor.r,
+        n_DefaultBGColor.g,
+        n_DefaultBGColor.b,
+        n_DefaultBGColor.a
+    );
+
+    gt->deltaTime  = dt;
+    gt->totalTime += dt;
+    game->step(game, *gt);
+
+    n_Present();
+}
+
+void n_SetBackgroundColor(const SDL_Color *restrict color)
+{
+    n_DefaultBGColor = SDL_Color(
+        .r = color->r,
+        .g = color->g,
+        .b = color->b,
+        .a = color->a
+    );
 }
 
 
 // ========================================================
 //
-// GRAPHICS
+// SYSTEMS
 //
 // ========================================================
 
 
-static float nG_PPM;
+#if nG_SYSTEM_CAPACITY > 64
+    #error "nG_SYSTEM_CAPACITY must be 64 at most"
+#endif
 
 
-void n_Animate(n_Animation *restrict a, float totalTime)
+typedef struct {
+    n_SystemDesc desc;
+    // systems ordered after this one by n_OrderSystems(), and all the
+    // ones that wait for it once the graph is built
+    uint64_t     after;
+    uint64_t     next;
+    int          nPrev;
+    SDL_atomic_t pending;
+    n_Rng        rng;
+} nG_System;
+
+
+static nG_System     nG_Systems[nG_SYSTEM_CAPACITY];
+static n_SystemStats nG_SystemStats[nG_SYSTEM_CAPACITY];
+static int           nG_SystemCount = 0;
+static bool          nG_SystemGraphDirty = true;
+static float         nG_SystemFrameMs = 0.0f;
+static uint64_t      nG_SystemSeed = 0;
+
+// This frame's systems ready to run, and the ones not done yet. Every
+// push posts nG_SystemWake once.
+static int           nG_SystemReady[nG_SYSTEM_CAPACITY];
+static int           nG_SystemReadyHead = 0;
+static int           nG_SystemReadyTail = 0;
+static SDL_SpinLock  nG_SystemLock = 0;
+static SDL_atomic_t  nG_SystemLeft;
+static n_GameTime    nG_SystemTime;
+
+static SDL_Thread**  nG_SystemThreads  = NULL;
+static int           nG_SystemNThreads = 0;
+static SDL_sem*      nG_SystemStart    = NULL;
+static SDL_sem*      nG_SystemDone     = NULL;
+static SDL_sem*      nG_SystemWake     = NULL;
+static bool          nG_SystemExit     = false;
+static bool          nG_SystemStarted  = false;
+
+
+static inline bool nG_SystemsConflict(const n_SystemDesc* a, const n_SystemDesc* b)
 {
-    if (!a) {
-        return;
-    }
+    return (a->writes & (b->reads | b->writes)) || (b->writes & a->reads);
+}
 
-    float frameTime = a->frameDuration;
-    int   animSize  = a->size;
-    float duration  = animSize * frameTime;
-    float dt        = totalTime - a->totalTime;
+// Whether <to> can be reached from <from> through n_OrderSystems().
+static bool nG_SystemReaches(int from, int to)
+{
+    uint64_t seen  = UInt64(1) << from;
+    uint64_t front = seen;
 
-    if (dt <= duration) {
-        a->index  = UInt16(totalTime / frameTime) % animSize;
-        a->angle += a->angleInc;
-    } else {
-        // if a long time has passed without animating, restart
-        // the animation.
-        a->index = 0;
+    while (front) {
+        uint64_t reached = 0;
+
+        for (int i = 0; i < nG_SystemCount; i++) {
+            if (front & (UInt64(1) << i)) {
+                reached |= nG_Systems[i].after;
+            }
+        }
+
+        if (reached & (UInt64(1) << to)) {
+            return true;
+        }
+
+        front = reached & ~seen;
+        seen |= reached;
     }
 
-    a->totalTime = totalTime;
+    return false;
 }
 
-void n_CenterCamera(n_Camera *restrict cam, n_Vec2 center)
+// Orders the systems as n_OrderSystems() says, then as they were added,
+// and makes each conflicting pair wait for the one that comes first.
+static void nG_BuildSystemGraph(void)
 {
-    if (!cam) {
-        return;
+    int      order[nG_SYSTEM_CAPACITY];
+    uint64_t placed = 0;
+    int      n      = nG_SystemCount;
+
+    for (int k = 0; k < n; k++) {
+        // the first system whose n_OrderSystems() predecessors are placed
+        for (int i = 0; i < n; i++) {
+            bool ready = !(placed & (UInt64(1) << i));
+
+            for (int j = 0; ready && j < n; j++) {
+                ready = !(nG_Systems[j].after & (UInt64(1) << i)) || (placed & (UInt64(1) << j));
+            }
+
+            if (ready) {
+                order[k] = i;
+                placed  |= UInt64(1) << i;
+                break;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        nG_Systems[i].next  = nG_Systems[i].after;
+        nG_Systems[i].nPrev = 0;
+    }
+
+    for (int a = 0; a < n; a++) {
+        for (int b = a + 1; b < n; b++) {
+            int i = order[a];
+            int j = order[b];
+
+            if (nG_SystemsConflict(&nG_Systems[i].desc, &nG_Systems[j].desc)) {
+                nG_Systems[i].next |= UInt64(1) << j;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) {
+            if (nG_Systems[j].next & (UInt64(1) << i)) {
+                nG_Systems[i].nPrev++;
+            }
+        }
     }
+
+    nG_SystemGraphDirty = false;
 }
 
-void n_ClearBackground(uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+static void nG_PushSystem(int i)
 {
-    SDL_SetRenderDrawColor(nG_Renderer, r, g, b, a);
-    SDL_RenderClear(nG_Renderer);
+    SDL_AtomicLock(&nG_SystemLock);
+    nG_SystemReady[nG_SystemReadyTail++] = i;
+    SDL_AtomicUnlock(&nG_SystemLock);
+
+    SDL_SemPost(nG_SystemWake);
 }
 
-void n_DeleteAnimation(n_Animation** a)
+static int nG_PopSystem(void)
 {
-    if (a && *a) {
-        n_Delete((*a)->frames);
-        n_Delete(*a);
+    int i = -1;
+
+    SDL_AtomicLock(&nG_SystemLock);
+    if (nG_SystemReadyHead < nG_SystemReadyTail) {
+        i = nG_SystemReady[nG_SystemReadyHead++];
     }
+    SDL_AtomicUnlock(&nG_SystemLock);
+
+    return i;
 }
 
-void n_DrawAnimation(const n_Camera *restrict cam, const n_Animation *restrict a) {
-    if (!cam || !a) {
-        return;
-    }
+static void nG_RunSystem(int i, int thread)
+{
+    nG_System*     sys   = &nG_Systems[i];
+    n_SystemStats* st    = &nG_SystemStats[i];
+    uint64_t       start = SDL_GetPerformanceCounter();
 
-    uint32_t i = a->index;
+    sys->desc.run(nG_SystemTime, sys->desc.data);
 
-    n_DrawTexture(cam, a->tex, &a->frames[i], &a->dest, a->angle, a->flip);
+    float ms = nG_MsSince(start);
+
+    st->avgMs  = st->lastMs > 0.0f ? st->avgMs + (ms - st->avgMs) / 16.0f : ms;
+    st->lastMs = ms;
+    st->maxMs  = SDL_max(st->maxMs, ms);
+    st->thread = thread;
+
+    for (int j = 0; j < nG_SystemCount; j++) {
+        if ((sys->next & (UInt64(1) << j)) && SDL_AtomicDecRef(&nG_Systems[j].pending)) {
+            nG_PushSystem(j);
+        }
+    }
+
+    // the last one wakes everybody up, the frame is over
+    if (SDL_AtomicDecRef(&nG_SystemLeft)) {
+        for (int t = 0; t <= nG_SystemNThreads; t++) {
+            SDL_SemPost(nG_SystemWake);
+        }
+    }
 }
 
-void n_DrawFilledRect(const n_Camera *restrict cam, const n_Rect *restrict rect)
+// Runs ready systems until all of this frame's are done.
+static void nG_SystemLoop(int thread)
 {
-    if (cam && n_IsValidRect(rect)) {
-        SDL_Rect r = n_Unproject(cam, rect);
-        SDL_RenderFillRect(nG_Renderer, &r);
+    while (SDL_AtomicGet(&nG_SystemLeft) > 0) {
+        int i = nG_PopSystem();
+
+        if (i >= 0) {
+            nG_RunSystem(i, thread);
+        } else {
+            SDL_SemWait(nG_SystemWake);
+        }
     }
 }
 
-void n_DrawRect(const n_Camera *restrict cam, const n_Rect *restrict rect)
+static int nG_SystemWorker(void* data)
 {
-    if (cam && n_IsValidRect(rect)) {
-        SDL_Rect r = n_Unproject(cam, rect);
-        SDL_RenderDrawRect(nG_Renderer, &r);
+    int thread = Int((intptr_t) data);
+
+    for (;;) {
+        SDL_SemWait(nG_SystemStart);
+
+        if (nG_SystemExit) {
+            break;
+        }
+
+        nG_SystemLoop(thread);
+        SDL_SemPost(nG_SystemDone);
     }
+
+    return 0;
 }
 
-void n_DrawSprite(const n_Camera *restrict cam, const n_Sprite *restrict sprite)
+static bool nG_StartSystems(void)
 {
-    if (cam && sprite) {
-        n_DrawTexture(
-            cam,
-            sprite->tex,
-            &sprite->src,
-            &sprite->dest,
-            sprite->angle,
-            sprite->flip
+    int threads = nG_SYSTEM_THREADS >= 0 ? nG_SYSTEM_THREADS : SDL_GetCPUCount() - 1;
+
+    nG_SystemStarted = true;
+    nG_SystemExit    = false;
+    nG_SystemStart   = SDL_CreateSemaphore(0);
+    nG_SystemDone    = SDL_CreateSemaphore(0);
+    nG_SystemWake    = SDL_CreateSemaphore(0);
+
+    if (!nG_SystemStart || !nG_SystemDone || !nG_SystemWake) {
+        n_LogErrorf("Unable to create the system semaphores: %s\n", SDL_GetError());
+        return false;
+    }
+
+    if (threads > 0) {
+        nG_SystemThreads = n_NewTagged(SDL_Thread*, threads, n_AllocTag_Engine);
+    }
+
+    for (int i = 0; nG_SystemThreads && i < threads; i++) {
+        SDL_Thread* t = SDL_CreateThread(
+            &nG_SystemWorker,
+            "nolib systems",
+            (void*) (intptr_t) (i + 1)
         );
+
+        if (!t) {
+            n_LogErrorf("Unable to create a system thread: %s\n", SDL_GetError());
+            break;
+        }
+
+        nG_SystemThreads[nG_SystemNThreads++] = t;
     }
+
+    return true;
 }
 
-void n_DrawTexture(
-    const n_Camera *restrict cam,
-    SDL_Texture* tex,
-    const SDL_Rect *restrict src,
-    const n_Rect *restrict dest,
-    float angle,
-    SDL_RendererFlip flip
-) {
-    if (!cam || !tex) {
+static void nG_RunSystems(n_GameTime gt)
+{
+    if (nG_SystemCount == 0) {
         return;
     }
 
-    SDL_Rect d = n_Unproject(cam, dest);
+    if (!nG_SystemStarted) {
+        nG_StartSystems();
+    }
+    if (!nG_SystemWake) {
+        return;
+    }
 
-    SDL_RenderCopyEx(
-        nG_Renderer,
-        tex,
-        src,
-        dest ? &d : NULL,
-        angle,
-        NULL,
-        flip
-    );
+    if (nG_SystemGraphDirty) {
+        nG_BuildSystemGraph();
+    }
+
+    uint64_t start = SDL_GetPerformanceCounter();
+
+    nG_SystemTime      = gt;
+    nG_SystemReadyHead = 0;
+    nG_SystemReadyTail = 0;
+    SDL_AtomicSet(&nG_SystemLeft, nG_SystemCount);
+
+    for (int i = 0; i < nG_SystemCount; i++) {
+        SDL_AtomicSet(&nG_Systems[i].pending, nG_Systems[i].nPrev);
+    }
+    for (int i = 0; i < nG_SystemCount; i++) {
+        if (nG_Systems[i].nPrev == 0) {
+            nG_PushSystem(i);
+        }
+    }
+
+    for (int i = 0; i < nG_SystemNThreads; i++) {
+        SDL_SemPost(nG_SystemStart);
+    }
+
+    // the main thread runs systems as well
+    nG_SystemLoop(0);
+
+    for (int i = 0; i < nG_SystemNThreads; i++) {
+        SDL_SemWait(nG_SystemDone);
+    }
+
+    // wake-ups nobody waited for
+    while (SDL_SemTryWait(nG_SystemWake) == 0) {
+    }
+
+    nG_SystemFrameMs = nG_MsSince(start);
 }
 
-n_Animation* n_NewAnimation(
-    SDL_Texture* tex,
-    SDL_Rect*    frames,
-    uint32_t     nOfFrames,
-    float        frameDuration
-) {
-    if (!tex || !frames || nOfFrames < 2) {
-        // TODO error message
-        return NULL;
+static void nG_QuitSystems(void)
+{
+    nG_SystemExit = true;
+
+    for (int i = 0; i < nG_SystemNThreads; i++) {
+        SDL_SemPost(nG_SystemStart);
+    }
+    for (int i = 0; i < nG_SystemNThreads; i++) {
+        SDL_WaitThread(nG_SystemThreads[i], NULL);
+    }
+
+    if (nG_SystemStart) {
+        SDL_DestroySemaphore(nG_SystemStart);
+        nG_SystemStart = NULL;
     }
+    if (nG_SystemDone) {
+        SDL_DestroySemaphore(nG_SystemDone);
+        nG_SystemDone = NULL;
+    }
+    if (nG_SystemWake) {
+        SDL_DestroySemaphore(nG_SystemWake);
+        nG_SystemWake = NULL;
+    }
+
+    n_Delete(nG_SystemThreads);
+
+    nG_SystemNThreads = 0;
+    nG_SystemStarted  = false;
+    n_ClearSystems();
+}
 
-    SDL_Rect* fs = n_New(SDL_Rect, nOfFrames);
 
-    if (!fs) {
-        // TODO error message
-        return NULL;
+n_System n_AddSystem(n_SystemDesc desc)
+{
+    if (!desc.run) {
+        n_LogErrorf("System '%s' with no run function.\n", desc.name ? desc.name : "");
+        return -1;
     }
 
-    n_Animation* a = n_New(n_Animation, 1);
-
-    if (!a) {
-        // TODO error message
-        n_Delete(fs);
-        return NULL;
+    if (nG_SystemCount == nG_SYSTEM_CAPACITY) {
+        n_LogWarnf("No free systems (nG_SYSTEM_CAPACITY = %d).\n", nG_SYSTEM_CAPACITY);
+        return -1;
     }
 
-    memcpy(fs, frames, nOfFrames * sizeof(SDL_Rect));
+    int i = nG_SystemCount++;
 
-    *a = n_Animation(
-        .tex           = tex,
-        .frames        = fs,
-        .dest          = n_Rect(.x = 1.0f, .y = 1.0f, .w = 1.0f, .h = 1.0f),
-        .size          = nOfFrames,
-        .index         = 0,
-        .frameDuration = frameDuration,
-        .totalTime     = 0,
-        .angle         = 0,
-        .angleInc      = 0,
-        .flip          = SDL_FLIP_NONE
-    );
+    nG_Systems[i]       = (nG_System) { .desc = desc };
+    nG_SystemStats[i]   = (n_SystemStats) { .name = desc.name };
+    nG_SystemGraphDirty = true;
 
-    return a;
+    n_SeedRng(&nG_Systems[i].rng, nG_SystemSeed, UInt64(i));
+
+    return i;
 }
 
-void n_Present(void)
+bool n_OrderSystems(n_System first, n_System then)
 {
-    SDL_RenderPresent(nG_Renderer);
+    if (first < 0 || first >= nG_SystemCount || then < 0 || then >= nG_SystemCount) {
+        return false;
+    }
+
+    if (first == then || nG_SystemReaches(then, first)) {
+        n_LogErrorf(
+            "Ordering system '%s' before '%s' makes a cycle.\n",
+            nG_Systems[first].desc.name ? nG_Systems[first].desc.name : "",
+            nG_Systems[then].desc.name ? nG_Systems[then].desc.name : ""
+        );
+        return false;
+    }
+
+    nG_Systems[first].after |= UInt64(1) << then;
+    nG_SystemGraphDirty = true;
+    return true;
 }
 
-void n_SetRendererDrawColor(SDL_Color color)
+void n_ClearSystems(void)
 {
-    SDL_SetRenderDrawColor(nG_Renderer, color.r, color.g, color.b, color.a);
+    nG_SystemCount      = 0;
+    nG_SystemFrameMs    = 0.0f;
+    nG_SystemGraphDirty = true;
 }
 
-SDL_Rect n_Unproject(const n_Camera *restrict cam, const n_Rect *restrict r)
+int n_GetSystemStats(const n_SystemStats** stats, float* frameMs)
 {
-    SDL_Rect out = SDL_Rect();
-
-    if (cam && n_IsValidRect(r)) {
-        float ppm = nG_PPM;
-        float cx  = cam->x;
-        float cy  = cam->y;
-        float z   = cam->zoom;
-        int   h   = Int(z * r->h * ppm);
-        int   maxH;
+    if (stats) {
+        *stats = nG_SystemStats;
+    }
+    if (frameMs) {
+        *frameMs = nG_SystemFrameMs;
+    }
 
-        SDL_GetWindowSize(nG_Window, NULL, &maxH);
+    return nG_SystemCount;
+}
 
-        out.x =        Int(z * ppm * (r->x + cx));
-        out.y = maxH - Int(z * ppm * (r->y + cy)) - h;
-        out.w = Int(cam->zoom * r->w * ppm);
-        out.h = h;
+n_Rng* n_GetSystemRng(n_System system)
+{
+    if (system < 0 || system >= nG_SystemCount) {
+        return NULL;
     }
 
-    return out;
+    return &nG_Systems[system].rng;
+}
+
+void n_SeedSystemRngs(uint64_t seed)
+{
+    nG_SystemSeed = seed;
+
+    for (int i = 0; i < nG_SystemCount; i++) {
+        n_SeedRng(&nG_Systems[i].rng, seed, UInt64(i));
+    }
 }
 
 
 // ========================================================
 //
-// LOADER
+// TELEMETRY
 //
 // ========================================================
 
 
-#define nG_BaseLoaderPathMaxLen 255
+#ifdef nG_POSIX
+    #define nG_TELEMETRY_SHM 1
+#endif // nG_POSIX
 
 
-static char nG_BaseLoaderPath[nG_BaseLoaderPathMaxLen + 1] = "";
+// The mapped block, and the frame's values until they are published.
+static n_Telemetry* nG_Telemetry = NULL;
+static n_Telemetry  nG_TelemetryNext;
+#ifdef nG_TELEMETRY_SHM
+static char         nG_TelemetryName[256];
+#endif // nG_TELEMETRY_SHM
+static uint64_t     nG_TelemetryStart = 0;
+static uint64_t     nG_TelemetryLast  = 0;
 
 
-SDL_Texture* n_LoadTexture(const char *restrict path)
+static inline float nG_TicksToMs(uint64_t ticks)
 {
-    if (strlen(path) > nG_BaseLoaderPathMaxLen) {
-        n_Logf("path is too long (> %d).", nG_BaseLoaderPathMaxLen - 1);
+    return Float(ticks * 1000.0 / SDL_GetPerformanceFrequency());
+}
+
+static void nG_EndTelemetryFrame(uint64_t start, uint64_t sampled, uint64_t stepped)
+{
+    if (!nG_Telemetry) {
+        return;
     }
 
-    char filepath[2 * nG_BaseLoaderPathMaxLen + 1];
-    
-    snprintf(filepath, 2 * nG_BaseLoaderPathMaxLen, "%s%s", nG_BaseLoaderPath, path);
-    
-    SDL_Surface* s = IMG_Load(filepath);
-    SDL_Texture* t = NULL;
+    n_Telemetry*   t   = &nG_TelemetryNext;
+    n_TextureStats tex = n_GetTextureStats();
+    uint64_t       now = SDL_GetPerformanceCounter();
+
+    t->frame++;
+    t->uptime    = (now - nG_TelemetryStart) / Double(SDL_GetPerformanceFrequency());
+    t->eventsMs  = nG_TicksToMs(sampled - start);
+    t->updateMs  = nG_TicksToMs(stepped - sampled);
+    t->systemsMs = nG_SystemFrameMs;
+    t->presentMs = nG_TicksToMs(now - stepped);
+
+    if (nG_TelemetryLast) {
+        float ms = nG_TicksToMs(start - nG_TelemetryLast);
+        int   b  = SDL_min(Int(ms), nG_TELEMETRY_BUCKETS - 1);
+
+        t->avgFrameMs = t->frameMs > 0.0f ? t->avgFrameMs + (ms - t->avgFrameMs) / 16.0f : ms;
+        t->frameMs    = ms;
+        t->maxFrameMs = SDL_max(t->maxFrameMs, ms);
+        t->histogram[b]++;
+    }
+    nG_TelemetryLast = start;
 
-    
-    if (s) {
-        t = SDL_CreateTextureFromSurface(nG_Renderer, s);
-        SDL_FreeSurface(s);
+    t->frameAllocs = nG_LastFrameAllocs;
+    t->memoryBytes = 0;
+
+    SDL_AtomicLock(&nG_AllocLock);
+    for (int i = 0; i < nG_ALLOC_TAGS; i++) {
+        t->memoryBytes += nG_AllocTags[i].bytes;
+    }
+    SDL_AtomicUnlock(&nG_AllocLock);
+
+    t->textureBytes     = tex.bytes;
+    t->textures         = tex.textures;
+    t->residentTextures = tex.resident;
+    t->evictions        = tex.evictions;
+    t->reloads          = tex.reloads;
+
+    // seqlock: odd while writing, so that readers retry
+    volatile uint32_t* seq = &nG_Telemetry->seq;
+    size_t             at  = offsetof(n_Telemetry, nGauges);
+
+    *seq = *seq + 1;
+    SDL_MemoryBarrierRelease();
+    memcpy((uint8_t*) nG_Telemetry + at, (const uint8_t*) t + at, sizeof(n_Telemetry) - at);
+    SDL_MemoryBarrierRelease();
+    *seq = *seq + 1;
+}
+
+bool n_StartTelemetry(const char *restrict name)
+{
+#ifdef nG_TELEMETRY_SHM
+    if (!name || strlen(name) >= sizeof(nG_TelemetryName)) {
+        n_LogErrorf("Invalid telemetry name.\n");
+        return false;
     }
 
-    if (!t) {
-        n_Logf("Unable to load texture '%s': %s\n", filepath, SDL_GetError());
+    n_StopTelemetry();
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+
+    if (fd < 0) {
+        n_LogErrorf("Unable to open the telemetry segment '%s'.\n", name);
+        return false;
     }
 
-    return t;
+    void* map = MAP_FAILED;
+
+    if (ftruncate(fd, sizeof(n_Telemetry)) == 0) {
+        map = mmap(NULL, sizeof(n_Telemetry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+
+    if (map == MAP_FAILED) {
+        n_LogErrorf("Unable to map the telemetry segment '%s'.\n", name);
+        shm_unlink(name);
+        return false;
+    }
+
+    // the gauges set before starting are kept
+    n_Telemetry* t = &nG_TelemetryNext;
+
+    memset(&t->frame, 0, offsetof(n_Telemetry, gauges) - offsetof(n_Telemetry, frame));
+    t->magic   = n_TelemetryMagic;
+    t->version = n_TelemetryVersion;
+    t->size    = sizeof(n_Telemetry);
+    t->pid     = UInt32(getpid());
+    t->seq     = 0;
+
+    memcpy(map, t, sizeof(n_Telemetry));
+    strcpy(nG_TelemetryName, name);
+
+    nG_Telemetry      = map;
+    nG_TelemetryStart = SDL_GetPerformanceCounter();
+    nG_TelemetryLast  = 0;
+
+    n_LogInfof("Publishing telemetry in '%s'.\n", name);
+    return true;
+#else
+    (void) name;
+    n_LogErrorf(
+        "Telemetry needs POSIX shared memory, which this build leaves out "
+        "(nG_NO_POSIX, or a strict C99 build without _POSIX_C_SOURCE).\n"
+    );
+    return false;
+#endif // nG_TELEMETRY_SHM
 }
 
-bool n_SetLoaderSearchPath(const char *restrict path)
+void n_StopTelemetry(void)
 {
-    long len = strlen(path);
- 
-    if (!path) {
-        n_Logf("NULL path.");
-        return false;
+#ifdef nG_TELEMETRY_SHM
+    if (!nG_Telemetry) {
+        return;
     }
 
-    if (len >= nG_BaseLoaderPathMaxLen) {
-        n_Logf("path is too long (> %d).", nG_BaseLoaderPathMaxLen);
+    munmap(nG_Telemetry, sizeof(n_Telemetry));
+    shm_unlink(nG_TelemetryName);
+    nG_Telemetry = NULL;
+#endif // nG_TELEMETRY_SHM
+}
+
+bool n_SetTelemetryGauge(const char *restrict name, float value)
+{
+    n_Telemetry* t = &nG_TelemetryNext;
+    uint32_t     i = 0;
+
+    if (!name) {
         return false;
     }
 
-    if (nG_BaseLoaderPath[len - 1] != '/') {
-        snprintf(
-            nG_BaseLoaderPath,
-            nG_BaseLoaderPathMaxLen - 1,
-            "%s/",
-            path
-        );
-    } else {
-        strncpy(nG_BaseLoaderPath, path, nG_BaseLoaderPathMaxLen);
+    while (i < t->nGauges && strncmp(t->gauges[i].name, name, sizeof(t->gauges[i].name) - 1) != 0) {
+        i++;
+    }
+
+    if (i == t->nGauges) {
+        if (i == nG_TELEMETRY_GAUGES) {
+            return false;
+        }
+
+        snprintf(t->gauges[i].name, sizeof(t->gauges[i].name), "%s", name);
+        t->nGauges++;
     }
 
+    t->gauges[i].value = value;
     return true;
 }
 
 
 // ========================================================
 //
-// RUNTIME
+// INITIALIZATION AND FINALIZATION
 //
 // ========================================================
 
 
-static bool n_ShouldQuit = false;
+#define nG_StartupMaxSteps 16
 
-static SDL_Color n_DefaultBGColor = SDL_Color(
-    .r = 0x00,
-    .g = 0x00,
-    .b = 0x00,
-    .a = 0xFF,
-);
 
+static n_StartupStep nG_StartupSteps[nG_StartupMaxSteps];
+static int           nG_StartupNSteps = 0;
+static bool          nG_Started       = false;
 
-void n_Quit(void)
+
+static void nG_AddStartupStep(const char* step, uint64_t start)
 {
-    n_ShouldQuit = true;
+    if (nG_StartupNSteps < nG_StartupMaxSteps) {
+        uint64_t end = SDL_GetPerformanceCounter();
+
+        nG_StartupSteps[nG_StartupNSteps++] = (n_StartupStep) {
+            .step = step,
+            .ms   = Float((end - start) * 1000.0 / SDL_GetPerformanceFrequency()),
+            .lazy = nG_Started
+        };
+    }
 }
 
-void n_Run(uint32_t fps, n_IGame *restrict game)
+static bool nG_InitSubsystem(n_Subsystem sub)
 {
-    const int FRAME_TIME = Int(1000.0 / fps);
-    n_GameTime gt = {0.0f, 0.0f};
-    uint32_t  curr  = 0;
-    uint32_t  prev  = 0;
-    uint32_t  delta = 0;
-    SDL_Event e;
+    switch (sub) {
+    case n_Subsystem_Audio:
+        // the game runs without sound if there's no audio device
+        return SDL_InitSubSystem(SDL_INIT_AUDIO) == 0 && nG_InitAudio();
+    case n_Subsystem_Joystick:
+        return SDL_InitSubSystem(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER) == 0;
+    case n_Subsystem_Haptic:
+        return SDL_InitSubSystem(SDL_INIT_HAPTIC) == 0;
+    case n_Subsystem_Images:
+        if ((IMG_Init(nG_IMG_FLAGS) & nG_IMG_FLAGS) != nG_IMG_FLAGS) {
+            SDL_SetError("%s", IMG_GetError());
+            return false;
+        }
+        return true;
+    case n_Subsystem_Fonts:
+        return TTF_Init() == 0;
+    default:
+        return false;
+    }
+}
 
-    game->init(game, gt);
+bool n_RequireSubsystems(uint32_t subsystems)
+{
+    static const char* names[] = { "audio", "joystick", "haptic", "SDL_image", "SDL_ttf" };
 
-    while (!n_ShouldQuit) {
-        curr  = SDL_GetTicks();
-        delta = curr - prev;
+    // already up: no lock (n_LoadTexture() gets here every time)
+    if (nG_HasSubsystems(subsystems & n_Subsystem_All)) {
+        return true;
+    }
 
-        if (delta >=  FRAME_TIME) {
-            n_ClearBackground(
-                n_DefaultBGColor.r,
-                n_DefaultBGColor.g,
-                n_DefaultBGColor.b,
-                n_DefaultBGColor.a
-            );
+    // contexts on other threads may get here at the same time
+    SDL_LockMutex(nG_SubsystemLock);
 
-            while (!n_ShouldQuit && SDL_PollEvent(&e) > 0) {
-                switch(e.type)
-                {
-                case SDL_QUIT:
-                    n_ShouldQuit = true;
-                    break;
-                default:
-                    game->ehandler(game, &e);
-                    break;
-                }
-            }
+    uint32_t missing = subsystems & n_Subsystem_All & ~UInt32(SDL_AtomicGet(&nG_Subsystems));
 
-            gt.deltaTime = Float(delta) / 1000.0f;
-            gt.totalTime = Float(curr) / 1000.0f;
-            prev = curr;
-            game->step(game, gt);
+    for (int i = 0; missing != 0; i++, missing >>= 1) {
+        uint32_t sub = UInt32(1) << i;
 
-            n_Present();
+        if (!(missing & 1) || (nG_SubsystemsFailed & sub)) {
+            continue;
+        }
+
+        uint64_t start = SDL_GetPerformanceCounter();
+        if (!nG_InitSubsystem(sub)) {
+            n_LogErrorf("Error while initializing %s: %s\n", names[i], SDL_GetError());
+            nG_SubsystemsFailed |= sub;
+            continue;
         }
+        SDL_AtomicSet(&nG_Subsystems, Int(UInt32(SDL_AtomicGet(&nG_Subsystems)) | sub));
+        nG_AddStartupStep(names[i], start);
     }
 
-    game->finalize(game, gt);
+    SDL_UnlockMutex(nG_SubsystemLock);
+    return nG_HasSubsystems(subsystems & n_Subsystem_All);
 }
 
-void n_SetBackgroundColor(const SDL_Color *restrict color)
+bool n_Init(const char* gameName, int windowWidth, int windowHeight, float ppm)
 {
-    n_DefaultBGColor = SDL_Color(
-        .r = color->r,
-        .g = color->g,
-        .b = color->b,
-        .a = color->a
-    );
+    return n_InitWithOptions(n_InitOptions(
+        .gameName = gameName,
+        .width    = windowWidth,
+        .height   = windowHeight,
+        .ppm      = ppm,
+        .backend  = nG_InitBackend
+    ));
 }
 
-
-// ========================================================
-//
-// INITIALIZATION AND FINALIZATION
-//
-// ========================================================
-
-
-bool n_Init(const char* gameName, int windowWidth, int windowHeight, float ppm)
+bool n_InitWithOptions(n_InitOptions opts)
 {
-    nG_PPM = ppm;
+    nG_Ctx = &nG_DefaultContext;
+    nG_Ctx->ppm = opts.ppm;
+    nG_StartLog();
 
-    if (SDL_Init(SDL_INIT_EVERYTHING) < 0) {
-        n_Logf("Error while initializing SDL: %s\n", SDL_GetError());
+    if (!nG_SubsystemLock && !(nG_SubsystemLock = SDL_CreateMutex())) {
+        n_LogErrorf("Error while creating a mutex: %s\n", SDL_GetError());
         n_Finalize();
         return false;
     }
 
-    if ((IMG_Init(nG_IMG_FLAGS) & nG_IMG_FLAGS) != nG_IMG_FLAGS) {
-        n_Logf("Error while initializing SDL_image: %s\n", IMG_GetError());
-        n_Finalize();
-        return false;
-    }
+    nG_Started = false;
+    nG_StartupNSteps = 0;
 
-    if (TTF_Init() < 0) {
-        n_Logf("Error while initializing SDL_ttf: %s\n", TTF_GetError());
+    uint64_t start = SDL_GetPerformanceCounter();
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_EVENTS | SDL_INIT_TIMER) < 0) {
+        n_LogErrorf("Error while initializing SDL: %s\n", SDL_GetError());
         n_Finalize();
         return false;
     }
+    nG_AddStartupStep("SDL video", start);
 
+    start = SDL_GetPerformanceCounter();
     nG_Window = SDL_CreateWindow(
-        gameName,
+        opts.gameName,
         SDL_WINDOWPOS_CENTERED,
         SDL_WINDOWPOS_CENTERED,
-        windowWidth,
-        windowHeight,
+        opts.width,
+        opts.height,
         nG_WINDOW_FLAGS
     );
     if (!nG_Window) {
-        n_Logf("Error while creating the window: %s\n", SDL_GetError());
+        n_LogErrorf("Error while creating the window: %s\n", SDL_GetError());
         n_Finalize();
         return false;
     }
+    nG_AddStartupStep("window", start);
 
+    start = SDL_GetPerformanceCounter();
     nG_Renderer = SDL_CreateRenderer(nG_Window, -1, nG_RENDERER_FLAGS);
     if (!nG_Renderer) {
-        n_Logf("Error while creating the renderer: %s\n", SDL_GetError());
+        n_LogErrorf("Error while creating the renderer: %s\n", SDL_GetError());
+        n_Finalize();
+        return false;
+    }
+    nG_AddStartupStep("renderer", start);
+
+    nG_Backend = opts.backend;
+    if (nG_Backend == n_RenderBackend_Raster) {
+        start = SDL_GetPerformanceCounter();
+        if (!nG_InitRaster()) {
+            n_Finalize();
+            return false;
+        }
+        nG_AddStartupStep("raster backend", start);
+    }
+
+    // images and fonts are needed; the audio and input devices can
+    // be missing
+    uint32_t required = opts.subsystems & (n_Subsystem_Images | n_Subsystem_Fonts);
+    if (!n_RequireSubsystems(opts.subsystems) && !nG_HasSubsystems(required)) {
         n_Finalize();
         return false;
     }
 
     SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+
+    nG_Started = true;
+    if (opts.reportStartup) {
+        n_LogStartupReport();
+    }
     return true;
 }
 
+n_Context* n_NewHeadlessContext(int width, int height, float ppm)
+{
+    n_Context* ctx = n_NewTagged(n_Context, 1, n_AllocTag_Engine);
+
+    if (!ctx) {
+        return NULL;
+    }
+
+    ctx->surface = SDL_CreateRGBSurfaceWithFormat(0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    ctx->renderer = ctx->surface ? SDL_CreateSoftwareRenderer(ctx->surface) : NULL;
+    if (!ctx->renderer) {
+        n_LogErrorf("Error while creating a headless context: %s\n", SDL_GetError());
+        SDL_FreeSurface(ctx->surface);
+        n_Delete(ctx);
+        return NULL;
+    }
+
+    ctx->ppm       = ppm;
+    ctx->ppmScale  = 1.0f;
+    ctx->bgColor   = nG_DefaultContext.bgColor;
+    ctx->backend   = n_RenderBackend_SDL;
+    ctx->drawColor = nG_DefaultContext.drawColor;
+    memcpy(ctx->loaderPath, nG_DefaultContext.loaderPath, sizeof(ctx->loaderPath));
+
+    SDL_AtomicAdd(&nG_ContextCount, 1);
+    return ctx;
+}
+
+void n_DeleteContext(n_Context** ctx)
+{
+    if (ctx && *ctx && *ctx != &nG_DefaultContext) {
+        if (nG_Ctx == *ctx) {
+            nG_Ctx = &nG_DefaultContext;
+        }
+
+        nG_DetachTextures(*ctx);
+        nG_DeleteDirtyState(&(*ctx)->dirty);
+#ifndef nG_NO_DEBUG_DRAW
+        nG_DeleteDebugQueue(&(*ctx)->debug);
+#endif // !nG_NO_DEBUG_DRAW
+        SDL_DestroyRenderer((*ctx)->renderer);
+        SDL_FreeSurface((*ctx)->surface);
+        n_Delete(*ctx);
+
+        SDL_AtomicAdd(&nG_ContextCount, -1);
+    }
+}
+
+void n_SetContext(n_Context* ctx)
+{
+    nG_Ctx = ctx ? ctx : &nG_DefaultContext;
+}
+
+n_Context* n_GetContext(void)
+{
+    return nG_Ctx;
+}
+
+SDL_Surface* n_GetContextSurface(n_Context* ctx)
+{
+    return ctx ? ctx->surface : NULL;
+}
+
+int n_GetStartupReport(const n_StartupStep** steps)
+{
+    if (!steps) {
+        return 0;
+    }
+
+    *steps = nG_StartupSteps;
+    return nG_StartupNSteps;
+}
+
+void n_LogStartupReport(void)
+{
+    float total = 0.0f;
+
+    n_Logf("%-16s %10s\n", "startup step", "ms");
+    for (int i = 0; i < nG_StartupNSteps; i++) {
+        const n_StartupStep* st = &nG_StartupSteps[i];
+
+        n_Logf("%-16s %10.3f%s\n", st->step, st->ms, st->lazy ? " (lazy)" : "");
+        total += st->lazy ? 0.0f : st->ms;
+    }
+    n_Logf("%-16s %10.3f\n", "n_Init total", total);
+}
+
 void n_Finalize(void)
 {
+    nG_Ctx = &nG_DefaultContext;
+
+    n_StopInput();
+    n_StopCapture();
+    n_StopTelemetry();
+    nG_QuitSystems();
+
+    if (nG_Joystick) {
+        SDL_JoystickClose(nG_Joystick);
+        nG_Joystick = NULL;
+    }
+
+    nG_ClearTextures();
+
+#ifndef nG_NO_DEBUG_DRAW
+    nG_DeleteDebugQueue(&nG_Ctx->debug);
+#endif // !nG_NO_DEBUG_DRAW
+
+    if (nG_Backend == n_RenderBackend_Raster) {
+        nG_QuitRaster();
+    }
+
+    n_SetDirtyRectMode(false);
+    if (nG_ScaleTarget) {
+        n_SetRenderScale(n_RenderScale());
+    }
+
     SDL_DestroyRenderer(nG_Renderer);
     SDL_DestroyWindow(nG_Window);
 
-    TTF_Quit();
-    IMG_Quit();
+    nG_StopLog();
+
+    nG_QuitAudio();
+
+    if (nG_HasSubsystems(n_Subsystem_Fonts)) {
+        TTF_Quit();
+    }
+    if (nG_HasSubsystems(n_Subsystem_Images)) {
+        IMG_Quit();
+    }
     SDL_Quit();
+
+    SDL_AtomicSet(&nG_Subsystems, 0);
+    nG_SubsystemsFailed = 0;
+    SDL_DestroyMutex(nG_SubsystemLock);
+    nG_SubsystemLock = NULL;
+
+    nG_ClearImageCache();
+
+    nG_ReportLeaks();
 }
 
 